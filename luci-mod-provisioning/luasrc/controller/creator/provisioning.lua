@@ -11,7 +11,7 @@ local conn = ubus.connect();
 function index()
     entry({"admin", "creator"}, call("creator_provisioning"), "Creator", 50).dependent=false
     entry({"admin", "creator", "provisioning"}, call("creator_provisioning"), "Provisioning", 11).dependent=false
-    entry({"admin", "creator", "provisioning", "clicker_list"}, call("clicker_list"), nil, nil).dependent=false
+    entry({"admin", "creator", "provisioning", "state_updates"}, call("state_updates"), nil, nil).dependent=false
     entry({"admin", "creator", "provisioning", "start_provisioning"}, call("start_provisioning"), nil, nil).dependent=false
     entry({"admin", "creator", "provisioning", "select_clicker"}, call("select_clicker"), nil, nil).dependent=false
     entry({"admin", "creator", "provisioning", "start_daemon"}, call("start_daemon"), nil, nil).dependent=false
@@ -36,15 +36,22 @@ function creator_provisioning()
 
 end
 
-function clicker_list()
-    luci.http.prepare_content("text/html")
-
-    local response = provisioning.getProvisioningDaemonState()
-
-    if response then
-        luci.template.render("creator_provisioning/clicker_list", {clickers=response})
+-- Long poll used by provisioning page, replies with JSON state (see getState) as soon as it changes since version
+-- passed by page, or after STATE_UPDATES_TIMEOUT_MS with no changes. Without version whole state is sent at once.
+-- Waiting request holds one of uhttpd Lua workers (max_requests, 3 by default), so hold is kept short to leave workers
+-- for other pages and tabs.
+local STATE_UPDATES_TIMEOUT_MS = 5000
+
+function state_updates()
+    local version = tonumber(luci.http.formvalue("version"))
+    local ok, response = pcall(provisioning.waitForProvisioningDaemonState, version, STATE_UPDATES_TIMEOUT_MS)
+    if not ok then
+        luci.http.status(503, type(response) == "table" and response.message or "Provisioning daemon is not available")
+        return
     end
 
+    luci.http.prepare_content("application/json")
+    luci.http.write(jsonc.stringify(response))
 end
 
 function start_provisioning()
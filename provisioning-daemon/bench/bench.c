@@ -0,0 +1,312 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bench.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#define DEFAULT_WARMUPS         (1)
+#define DEFAULT_REPETITIONS     (7)
+#define DEFAULT_MIN_TIME_MS     (100)
+
+static bool _FirstEntry = true;
+
+uint64_t bench_GetTimeNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define CYCLE_SOURCE "rdtsc"
+
+static uint64_t ReadCycles(void)
+{
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+static uint64_t CyclesDelta(uint64_t start, uint64_t end)
+{
+    return end - start;
+}
+
+#elif defined(__mips__) && defined(__mips_isa_rev) && (__mips_isa_rev >= 2)
+
+#define CYCLE_SOURCE "rdhwr"
+
+static uint64_t ReadCycles(void)
+{
+    uint32_t count;
+    __asm__ __volatile__(".set push\n.set mips32r2\nrdhwr %0, $2\n.set pop" : "=r"(count));
+    return count;
+}
+
+static uint64_t CyclesDelta(uint64_t start, uint64_t end)
+{
+    //counter is 32 bit wide and ticks once every CCRes cycles
+    uint32_t resolution;
+    __asm__ __volatile__(".set push\n.set mips32r2\nrdhwr %0, $3\n.set pop" : "=r"(resolution));
+    return (uint64_t) ((uint32_t) end - (uint32_t) start) * resolution;
+}
+
+#else
+
+#define CYCLE_SOURCE NULL
+
+static uint64_t ReadCycles(void)
+{
+    return 0;
+}
+
+static uint64_t CyclesDelta(uint64_t start, uint64_t end)
+{
+    return 0;
+}
+
+#endif
+
+static void PrintUsage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-w warmups] [-r repetitions] [-t min repetition time ms] [-m cpu MHz] [-f filter]\n",
+            name);
+}
+
+bool bench_ParseArgs(BenchConfig* config, int argc, char** argv)
+{
+    config->warmups = DEFAULT_WARMUPS;
+    config->repetitions = DEFAULT_REPETITIONS;
+    config->minTimeNs = DEFAULT_MIN_TIME_MS * 1000000ULL;
+    config->cpuMHz = 0;
+    config->filter = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:r:t:m:f:")) != -1) {
+        switch (opt) {
+            case 'w':
+                config->warmups = atoi(optarg);
+                break;
+
+            case 'r':
+                config->repetitions = atoi(optarg);
+                break;
+
+            case 't':
+                config->minTimeNs = strtoull(optarg, NULL, 10) * 1000000ULL;
+                break;
+
+            case 'm':
+                config->cpuMHz = atof(optarg);
+                break;
+
+            case 'f':
+                config->filter = optarg;
+                break;
+
+            default:
+                PrintUsage(argv[0]);
+                return false;
+        }
+    }
+
+    if (config->warmups < 0 || config->repetitions < 1 || config->repetitions > BENCH_MAX_REPETITIONS) {
+        fprintf(stderr, "Repetitions must be in range 1..%d and warmups can't be negative\n", BENCH_MAX_REPETITIONS);
+        return false;
+    }
+    return true;
+}
+
+static int CompareDoubles(const void* a, const void* b)
+{
+    double d1 = *(const double*) a;
+    double d2 = *(const double*) b;
+    return (d1 > d2) - (d1 < d2);
+}
+
+static double Median(double* values, int count)
+{
+    qsort(values, count, sizeof(double), CompareDoubles);
+    return (count % 2) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+static BenchStat ComputeStat(const double* samples, int count)
+{
+    double sorted[BENCH_MAX_REPETITIONS];
+    double deviations[BENCH_MAX_REPETITIONS];
+    BenchStat stat;
+
+    memcpy(sorted, samples, count * sizeof(double));
+    stat.median = Median(sorted, count);
+    for (int t = 0; t < count; t++) {
+        deviations[t] = fabs(samples[t] - stat.median);
+    }
+    stat.mad = Median(deviations, count);
+    return stat;
+}
+
+static uint64_t Calibrate(BenchFunction function, void* context, uint64_t minTimeNs)
+{
+    uint64_t iterations = 1;
+    while (true) {
+        uint64_t start = bench_GetTimeNs();
+        function(context, iterations);
+        uint64_t elapsed = bench_GetTimeNs() - start;
+
+        if (elapsed >= minTimeNs) {
+            return iterations;
+        }
+        if (elapsed < minTimeNs / 100) {
+            iterations *= 10;
+        } else {
+            //aim slightly above target so next round usually ends calibration
+            iterations = iterations * minTimeNs * 11 / (elapsed * 10) + 1;
+        }
+    }
+}
+
+static void PrintJsonString(const char* value)
+{
+    if (value == NULL) {
+        printf("null");
+        return;
+    }
+    putchar('"');
+    for (; *value; value++) {
+        if (*value == '"' || *value == '\\') {
+            putchar('\\');
+        }
+        putchar(*value);
+    }
+    putchar('"');
+}
+
+static void BeginEntry(const char* name)
+{
+    printf("%s\n    {\"name\": ", _FirstEntry ? "" : ",");
+    PrintJsonString(name);
+    _FirstEntry = false;
+}
+
+void bench_Begin(const char* suite, const BenchConfig* config)
+{
+    struct utsname host;
+    if (uname(&host) != 0) {
+        memset(&host, 0, sizeof(host));
+    }
+
+    printf("{\n  \"suite\": ");
+    PrintJsonString(suite);
+    printf(",\n  \"host\": {\"system\": ");
+    PrintJsonString(host.sysname);
+    printf(", \"release\": ");
+    PrintJsonString(host.release);
+    printf(", \"machine\": ");
+    PrintJsonString(host.machine);
+    printf(", \"compiler\": ");
+    PrintJsonString(__VERSION__);
+    printf(", \"cycleSource\": ");
+    PrintJsonString(CYCLE_SOURCE != NULL ? CYCLE_SOURCE : (config->cpuMHz > 0 ? "estimated" : NULL));
+    printf("},\n  \"config\": {\"warmups\": %d, \"repetitions\": %d, \"minTimeMs\": %llu, \"cpuMHz\": %g},\n",
+            config->warmups, config->repetitions, (unsigned long long) (config->minTimeNs / 1000000), config->cpuMHz);
+    printf("  \"results\": [");
+    _FirstEntry = true;
+}
+
+bool bench_Run(const char* name, BenchFunction function, void* context, const BenchConfig* config,
+        BenchResult* result)
+{
+    if (config->filter != NULL && strstr(name, config->filter) == NULL) {
+        return false;
+    }
+
+    BenchResult localResult;
+    if (result == NULL) {
+        result = &localResult;
+    }
+
+    result->iterations = Calibrate(function, context, config->minTimeNs);
+    for (int t = 0; t < config->warmups; t++) {
+        function(context, result->iterations);
+    }
+
+    double nsSamples[BENCH_MAX_REPETITIONS];
+    double cycleSamples[BENCH_MAX_REPETITIONS];
+    for (int t = 0; t < config->repetitions; t++) {
+        uint64_t startCycles = ReadCycles();
+        uint64_t start = bench_GetTimeNs();
+        function(context, result->iterations);
+        uint64_t elapsed = bench_GetTimeNs() - start;
+        uint64_t cycles = CyclesDelta(startCycles, ReadCycles());
+
+        nsSamples[t] = (double) elapsed / result->iterations;
+        if (CYCLE_SOURCE != NULL) {
+            cycleSamples[t] = (double) cycles / result->iterations;
+        } else {
+            cycleSamples[t] = nsSamples[t] * config->cpuMHz / 1000;
+        }
+    }
+
+    result->nsPerOp = ComputeStat(nsSamples, config->repetitions);
+    result->cyclesPerOp = ComputeStat(cycleSamples, config->repetitions);
+    result->opsPerSecond = result->nsPerOp.median > 0 ? 1e9 / result->nsPerOp.median : 0;
+
+    BeginEntry(name);
+    printf(", \"iterations\": %llu, \"nsPerOp\": {\"median\": %.2f, \"mad\": %.2f}, \"opsPerSecond\": %.2f",
+            (unsigned long long) result->iterations, result->nsPerOp.median, result->nsPerOp.mad,
+            result->opsPerSecond);
+    if (CYCLE_SOURCE != NULL || config->cpuMHz > 0) {
+        printf(", \"cyclesPerOp\": {\"median\": %.2f, \"mad\": %.2f}}", result->cyclesPerOp.median,
+                result->cyclesPerOp.mad);
+    } else {
+        printf(", \"cyclesPerOp\": null}");
+    }
+    fflush(stdout);
+    return true;
+}
+
+void bench_ReportValue(const char* name, double value)
+{
+    BeginEntry(name);
+    printf(", \"value\": %.4f}", value);
+    fflush(stdout);
+}
+
+void bench_End(void)
+{
+    printf("\n  ]\n}\n");
+}
@@ -0,0 +1,112 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  bench.h
+ * @brief Timing, statistics and JSON reporting shared by benchmark tools.
+ */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define BENCH_MAX_REPETITIONS   (101)
+
+/**
+ * @brief Runs measured operation given number of times.
+ * @param[in] context value passed to bench_Run
+ * @param[in] iterations how many operations should be done
+ */
+typedef void (*BenchFunction)(void* context, uint64_t iterations);
+
+typedef struct {
+    int warmups;            /**< repetitions run before measuring, results are dropped */
+    int repetitions;        /**< measured repetitions, median and MAD are computed from them */
+    uint64_t minTimeNs;     /**< single repetition runs at least that long */
+    double cpuMHz;          /**< used to estimate cycles when there is no cycle counter, 0 - unknown */
+    const char* filter;     /**< only benchmarks which name contains this string are run, NULL - all */
+} BenchConfig;
+
+typedef struct {
+    double median;
+    double mad;             /**< median absolute deviation */
+} BenchStat;
+
+typedef struct {
+    uint64_t iterations;    /**< operations per repetition */
+    BenchStat nsPerOp;
+    BenchStat cyclesPerOp;
+    double opsPerSecond;    /**< computed from median ns/op */
+} BenchResult;
+
+/**
+ * @brief Fill config with defaults and override them with command line options:
+ * -w warmups, -r repetitions, -t min time of repetition in ms, -m cpu MHz, -f name filter.
+ * @return false if arguments are invalid, usage is printed then
+ */
+bool bench_ParseArgs(BenchConfig* config, int argc, char** argv);
+
+/**
+ * @brief Start JSON report on stdout, must be followed by bench_End.
+ * @param[in] suite name of the benchmark tool
+ */
+void bench_Begin(const char* suite, const BenchConfig* config);
+
+/**
+ * @brief Calibrate, warm up and measure given function, then append its results to the report.
+ * @return false if benchmark has been skipped by filter
+ */
+bool bench_Run(const char* name, BenchFunction function, void* context, const BenchConfig* config,
+        BenchResult* result);
+
+/**
+ * @brief Append free form numeric value to the report, e.g. ratio of two results.
+ */
+void bench_ReportValue(const char* name, double value);
+
+/**
+ * @brief Close JSON report.
+ */
+void bench_End(void);
+
+/**
+ * @brief Monotonic time in nanoseconds.
+ */
+uint64_t bench_GetTimeNs(void);
+
+/**
+ * @brief Compiler barrier which makes value look used, so measured code is not optimised out.
+ */
+#define BENCH_USE(x) __asm__ __volatile__("" : : "g"(x) : "memory")
+
+#endif /* __BENCH_H__ */
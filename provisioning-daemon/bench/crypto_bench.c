@@ -0,0 +1,630 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  crypto_bench.c
+ * @brief Microbenchmarks of the crypto library, prints JSON report on stdout.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "crypto/aes_backend.h"
+#include "crypto/bigint.h"
+#include "crypto/crypto_config.h"
+#include "crypto/dh_table.h"
+#include "crypto/diffie_hellman_keys_exchanger.h"
+#include "crypto/encoder.h"
+#include "crypto/random.h"
+#include "crypto/rijndael.h"
+#include "crypto/x25519.h"
+
+#include <glib.h>
+
+/** Size of pd_DeviceServerConfig, the biggest payload encoded by daemon */
+#define PAYLOAD_SIZE    (234)
+
+static uint32_t _RandomState = 0x12345678;
+
+static uint8_t NextRandomByte(void)
+{
+    //xorshift32, deterministic so runs are comparable
+    _RandomState ^= _RandomState << 13;
+    _RandomState ^= _RandomState >> 17;
+    _RandomState ^= _RandomState << 5;
+    return (uint8_t) _RandomState;
+}
+
+static void FillRandom(uint8_t* buffer, int length)
+{
+    for (int t = 0; t < length; t++) {
+        buffer[t] = NextRandomByte();
+    }
+}
+
+static bool BenchRandomizer(unsigned char* array, int length)
+{
+    FillRandom(array, length);
+    return true;
+}
+
+/**
+ * Returns random number which is smaller than P module.
+ */
+static BigInt* CreateRandomBelowModule(void)
+{
+    uint8_t buffer[P_MODULE_LENGTH];
+    FillRandom(buffer, sizeof(buffer));
+    buffer[P_MODULE_LENGTH - 1] &= 0x7F;
+    return bi_Create(buffer, P_MODULE_LENGTH);
+}
+
+typedef struct {
+    BigInt* a;
+    BigInt* b;
+    BigInt* module;
+    BigInt* work;
+} BigIntContext;
+
+static void BenchAdd(void* context, uint64_t iterations)
+{
+    BigIntContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        bi_Add(ctx->work, ctx->b);
+    }
+    BENCH_USE(ctx->work->buffer[0]);
+}
+
+static void BenchMultiply(void* context, uint64_t iterations)
+{
+    BigIntContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        bi_Assign(ctx->work, ctx->a);
+        bi_Multiply(ctx->work, ctx->b);
+    }
+    BENCH_USE(ctx->work->buffer[0]);
+}
+
+static void BenchModulo(void* context, uint64_t iterations)
+{
+    BigIntContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        bi_Assign(ctx->work, ctx->a);
+        bi_Modulo(ctx->work, ctx->module);
+    }
+    BENCH_USE(ctx->work->buffer[0]);
+}
+
+static void BenchMultiplyAmodB(void* context, uint64_t iterations)
+{
+    BigIntContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        bi_Assign(ctx->work, ctx->a);
+        bi_MultiplyAmodB(ctx->work, ctx->b, ctx->module);
+    }
+    BENCH_USE(ctx->work->buffer[0]);
+}
+
+static void BenchBigInt(const BenchConfig* config)
+{
+    BigIntContext ctx;
+    uint8_t half[P_MODULE_LENGTH];
+
+    //operands of Add and Multiply use half of the buffer, so results don't overflow
+    memset(half, 0, sizeof(half));
+    FillRandom(half, P_MODULE_LENGTH / 2);
+    ctx.b = bi_Create(half, P_MODULE_LENGTH);
+    ctx.work = bi_Create(NULL, P_MODULE_LENGTH);
+    ctx.module = bi_Create(g_KeyBuffer, P_MODULE_LENGTH);
+
+    FillRandom(half, P_MODULE_LENGTH / 2);
+    ctx.a = bi_Create(half, P_MODULE_LENGTH);
+    bench_Run("bi_Add", BenchAdd, &ctx, config, NULL);
+    bench_Run("bi_Multiply", BenchMultiply, &ctx, config, NULL);
+    bi_Release(&ctx.a);
+
+    //Modulo and MultiplyAmodB get full size operands, like during key exchange
+    ctx.a = CreateRandomBelowModule();
+    bi_Multiply(ctx.a, ctx.b);
+    bench_Run("bi_Modulo", BenchModulo, &ctx, config, NULL);
+    bi_Release(&ctx.a);
+    bi_Release(&ctx.b);
+
+    ctx.a = CreateRandomBelowModule();
+    ctx.b = CreateRandomBelowModule();
+    bench_Run("bi_MultiplyAmodB", BenchMultiplyAmodB, &ctx, config, NULL);
+
+    bi_Release(&ctx.a);
+    bi_Release(&ctx.b);
+    bi_Release(&ctx.module);
+    bi_Release(&ctx.work);
+}
+
+typedef struct {
+    DiffieHellmanKeysExchanger* exchanger;
+    uint8_t remoteKey[P_MODULE_LENGTH];
+    char tablePath[64];
+} DhContext;
+
+static void BenchGenerateExchangeData(void* context, uint64_t iterations)
+{
+    DhContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        unsigned char* key = dh_GenerateExchangeData(ctx->exchanger);
+        BENCH_USE(key);
+        free(key);
+    }
+}
+
+static void BenchCompleteExchangeData(void* context, uint64_t iterations)
+{
+    DhContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        unsigned char* key = dh_CompleteExchangeData(ctx->exchanger, ctx->remoteKey, P_MODULE_LENGTH);
+        BENCH_USE(key);
+        free(key);
+    }
+}
+
+static void BenchBuildTable(void* context, uint64_t iterations)
+{
+    for (uint64_t t = 0; t < iterations; t++) {
+        DhTable* table = dh_BuildTable(g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, DH_TABLE_DEFAULT_WINDOW_BITS);
+        BENCH_USE(table);
+        dh_ReleaseTable(&table);
+    }
+}
+
+static void BenchLoadTable(void* context, uint64_t iterations)
+{
+    DhContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        DhTable* table = dh_LoadTable(ctx->tablePath, g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE,
+                DH_TABLE_DEFAULT_WINDOW_BITS);
+        BENCH_USE(table);
+        dh_ReleaseTable(&table);
+    }
+}
+
+/**
+ * Exchange key generation with fixed-base table, and startup cost of computing the table versus mapping saved one.
+ */
+static void BenchFixedBaseTable(DhContext* ctx, const BenchConfig* config, const BenchResult* plain)
+{
+    BenchResult fixedBase;
+    DhTable* table = dh_BuildTable(g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, DH_TABLE_DEFAULT_WINDOW_BITS);
+
+    dh_SetFixedBaseTable(table);
+    if (bench_Run("dh_GenerateExchangeData:fixed_base", BenchGenerateExchangeData, ctx, config, &fixedBase) &&
+            plain != NULL) {
+        bench_ReportValue("dh_GenerateExchangeData:fixed_base:speedup",
+                plain->nsPerOp.median / fixedBase.nsPerOp.median);
+    }
+    dh_SetFixedBaseTable(NULL);
+
+    //wider windows trade table size for multiplications, the daemon autotuner picks one of these
+    for (int windowBits = 2; windowBits <= 6; windowBits++) {
+        char name[64];
+        DhTable* window = dh_BuildTable(g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, windowBits);
+        snprintf(name, sizeof(name), "dh_GenerateExchangeData:window_%d", windowBits);
+        dh_SetFixedBaseTable(window);
+        bench_Run(name, BenchGenerateExchangeData, ctx, config, NULL);
+        dh_SetFixedBaseTable(NULL);
+        dh_ReleaseTable(&window);
+    }
+
+    bench_Run("dh_BuildTable", BenchBuildTable, ctx, config, NULL);
+    strcpy(ctx->tablePath, "/tmp/crypto_bench_dh_table.XXXXXX");
+    int fd = mkstemp(ctx->tablePath);
+    if (fd >= 0) {
+        close(fd);
+        if (dh_SaveTable(table, ctx->tablePath)) {
+            bench_Run("dh_LoadTable", BenchLoadTable, ctx, config, NULL);
+        }
+        unlink(ctx->tablePath);
+    }
+    dh_ReleaseTable(&table);
+}
+
+static void BenchDiffieHellman(const BenchConfig* config)
+{
+    DhContext ctx;
+    BenchResult plain;
+    ctx.exchanger = dh_NewKeyExchanger((char*) g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, BenchRandomizer);
+
+    //remote key is a real exchange key from other party
+    DiffieHellmanKeysExchanger* remote = dh_NewKeyExchanger((char*) g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE,
+            BenchRandomizer);
+    unsigned char* remoteKey = dh_GenerateExchangeData(remote);
+    memcpy(ctx.remoteKey, remoteKey, P_MODULE_LENGTH);
+    free(remoteKey);
+    dh_Release(&remote);
+
+    bool hasPlain = bench_Run("dh_GenerateExchangeData", BenchGenerateExchangeData, &ctx, config, &plain);
+    bench_Run("dh_CompleteExchangeData", BenchCompleteExchangeData, &ctx, config, NULL);
+    bench_ReportValue("dh_WorstStepUs", dh_GetWorstStepTime());
+    BenchFixedBaseTable(&ctx, config, hasPlain ? &plain : NULL);
+
+    dh_Release(&ctx.exchanger);
+}
+
+typedef struct {
+    DiffieHellmanKeysExchanger* exchanger;
+    uint8_t remoteKey[P_MODULE_LENGTH];
+    uint8_t remotePublic[X25519_KEY_SIZE];
+    uint8_t sharedKey[AES_KEY_SIZE];
+} SessionContext;
+
+static void BenchX25519ScalarMult(void* context, uint64_t iterations)
+{
+    SessionContext* ctx = context;
+    uint8_t privateKey[X25519_KEY_SIZE];
+    uint8_t result[X25519_KEY_SIZE];
+    FillRandom(privateKey, sizeof(privateKey));
+    for (uint64_t t = 0; t < iterations; t++) {
+        x25519_ScalarMult(result, privateKey, ctx->remotePublic);
+        BENCH_USE(result[0]);
+    }
+}
+
+/**
+ * Daemon side of a whole legacy exchange: exchange key sent to clicker and shared key.
+ */
+static void BenchDhSession(void* context, uint64_t iterations)
+{
+    SessionContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        unsigned char* localKey = dh_GenerateExchangeData(ctx->exchanger);
+        unsigned char* sharedKey = dh_CompleteExchangeData(ctx->exchanger, ctx->remoteKey, P_MODULE_LENGTH);
+        BENCH_USE(sharedKey);
+        free(localKey);
+        free(sharedKey);
+    }
+}
+
+/**
+ * Daemon side of a whole X25519 exchange, as done by X25519KeyExchange in clicker_sm.c.
+ */
+static void BenchX25519Session(void* context, uint64_t iterations)
+{
+    SessionContext* ctx = context;
+    uint8_t privateKey[X25519_KEY_SIZE];
+    uint8_t localPublic[X25519_KEY_SIZE];
+    for (uint64_t t = 0; t < iterations; t++) {
+        rng_GetBytes(privateKey, sizeof(privateKey));
+        x25519_PublicKey(localPublic, privateKey);
+        x25519_DeriveKey(ctx->sharedKey, AES_KEY_SIZE, privateKey, ctx->remotePublic, localPublic, false);
+        BENCH_USE(ctx->sharedKey[0]);
+    }
+}
+
+/**
+ * Per session CPU cost of legacy 128-bit Diffie-Hellman and X25519, speedup is reported as extra value.
+ */
+static void BenchKeyExchangeSession(const BenchConfig* config)
+{
+    SessionContext ctx;
+    BenchResult dh, x25519;
+    uint8_t remotePrivate[X25519_KEY_SIZE];
+
+    ctx.exchanger = dh_NewKeyExchanger((char*) g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, BenchRandomizer);
+    DiffieHellmanKeysExchanger* remote = dh_NewKeyExchanger((char*) g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE,
+            BenchRandomizer);
+    unsigned char* remoteKey = dh_GenerateExchangeData(remote);
+    memcpy(ctx.remoteKey, remoteKey, P_MODULE_LENGTH);
+    free(remoteKey);
+    dh_Release(&remote);
+    FillRandom(remotePrivate, sizeof(remotePrivate));
+    x25519_PublicKey(ctx.remotePublic, remotePrivate);
+
+    bench_Run("x25519_ScalarMult", BenchX25519ScalarMult, &ctx, config, NULL);
+    bool hasDh = bench_Run("session:dh", BenchDhSession, &ctx, config, &dh);
+    bool hasX25519 = bench_Run("session:x25519", BenchX25519Session, &ctx, config, &x25519);
+    if (hasDh && hasX25519) {
+        bench_ReportValue("session:x25519:speedup", dh.nsPerOp.median / x25519.nsPerOp.median);
+    }
+
+    dh_Release(&ctx.exchanger);
+}
+
+typedef struct {
+    uint8_t key[32];
+    rijndael_ctx aes;
+    uint8_t block[16];
+    uint8_t payload[PAYLOAD_SIZE + 16];
+    uint8_t encoded[PAYLOAD_SIZE + 16];
+    SoftapKey sessionKey;
+} AesContext;
+
+static void BenchSetKey(void* context, uint64_t iterations)
+{
+    AesContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        rijndael_set_key(&ctx->aes, ctx->key, 128);
+    }
+    BENCH_USE(ctx->aes.ek[0]);
+}
+
+static void BenchEncrypt(void* context, uint64_t iterations)
+{
+    AesContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        rijndael_encrypt(&ctx->aes, ctx->block, ctx->block);
+    }
+    BENCH_USE(ctx->block[0]);
+}
+
+static void BenchEncodeBytes(void* context, uint64_t iterations)
+{
+    AesContext* ctx = context;
+    uint8_t outputSize;
+    for (uint64_t t = 0; t < iterations; t++) {
+        uint8_t* encoded = softap_EncodeBytes(ctx->payload, PAYLOAD_SIZE, ctx->key, &outputSize);
+        BENCH_USE(encoded);
+        free(encoded);
+    }
+}
+
+static void BenchEncodeBytesWithKey(void* context, uint64_t iterations)
+{
+    AesContext* ctx = context;
+    uint8_t outputSize;
+    for (uint64_t t = 0; t < iterations; t++) {
+        uint8_t* encoded = softap_EncodeBytesWithKey(ctx->payload, PAYLOAD_SIZE, &ctx->sessionKey, &outputSize);
+        BENCH_USE(encoded);
+        free(encoded);
+    }
+}
+
+static void BenchDecodeBytes(void* context, uint64_t iterations)
+{
+    AesContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        softap_DecodeBytes(ctx->encoded, sizeof(ctx->encoded), ctx->key);
+    }
+    BENCH_USE(ctx->encoded[0]);
+}
+
+static void BenchAes(const BenchConfig* config)
+{
+    AesContext ctx;
+    FillRandom(ctx.key, sizeof(ctx.key));
+    FillRandom(ctx.block, sizeof(ctx.block));
+    FillRandom(ctx.payload, sizeof(ctx.payload));
+    FillRandom(ctx.encoded, sizeof(ctx.encoded));
+    rijndael_set_key(&ctx.aes, ctx.key, 128);
+
+    bench_Run("rijndael_set_key", BenchSetKey, &ctx, config, NULL);
+    bench_Run("rijndael_encrypt", BenchEncrypt, &ctx, config, NULL);
+    bench_Run("softap_EncodeBytes", BenchEncodeBytes, &ctx, config, NULL);
+    softap_SetKey(&ctx.sessionKey, ctx.key);
+    bench_Run("softap_EncodeBytesWithKey", BenchEncodeBytesWithKey, &ctx, config, NULL);
+    softap_WipeKey(&ctx.sessionKey);
+    bench_Run("softap_DecodeBytes", BenchDecodeBytes, &ctx, config, NULL);
+}
+
+/** Payload sizes of the allocation free encoder, from a single config field up to bulk data */
+static const size_t _EncodeSizes[] = {32, 256, 4096, 65536};
+
+#define MAX_ENCODE_SIZE (65536)
+
+typedef struct {
+    uint8_t key[32];
+    SoftapKey sessionKey;
+    size_t size;
+    uint8_t* data;
+} EncodeContext;
+
+static void BenchEncodeInto(void* context, uint64_t iterations)
+{
+    EncodeContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        softap_EncodeInto(ctx->data, ctx->size, ctx->data, &ctx->sessionKey);
+    }
+    BENCH_USE(ctx->data[0]);
+}
+
+static void BenchDecodeInto(void* context, uint64_t iterations)
+{
+    EncodeContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        softap_DecodeInto(ctx->data, ctx->size, ctx->data, ctx->key);
+    }
+    BENCH_USE(ctx->data[0]);
+}
+
+/**
+ * softap_EncodeInto and softap_DecodeInto in place over growing payloads, throughput is reported in MB/s.
+ */
+static void BenchEncodeSizes(const BenchConfig* config)
+{
+    EncodeContext ctx;
+    BenchResult result;
+    char name[64];
+
+    FillRandom(ctx.key, sizeof(ctx.key));
+    ctx.data = malloc(MAX_ENCODE_SIZE);
+    FillRandom(ctx.data, MAX_ENCODE_SIZE);
+    softap_SetKey(&ctx.sessionKey, ctx.key);
+    for (size_t t = 0; t < sizeof(_EncodeSizes) / sizeof(_EncodeSizes[0]); t++) {
+        ctx.size = _EncodeSizes[t];
+        snprintf(name, sizeof(name), "softap_EncodeInto:%zu", ctx.size);
+        if (bench_Run(name, BenchEncodeInto, &ctx, config, &result)) {
+            snprintf(name, sizeof(name), "softap_EncodeInto:%zu:MBps", ctx.size);
+            bench_ReportValue(name, ctx.size * 1000.0 / result.nsPerOp.median);
+        }
+        snprintf(name, sizeof(name), "softap_DecodeInto:%zu", ctx.size);
+        if (bench_Run(name, BenchDecodeInto, &ctx, config, &result)) {
+            snprintf(name, sizeof(name), "softap_DecodeInto:%zu:MBps", ctx.size);
+            bench_ReportValue(name, ctx.size * 1000.0 / result.nsPerOp.median);
+        }
+    }
+    softap_WipeKey(&ctx.sessionKey);
+    free(ctx.data);
+}
+
+typedef struct {
+    const AesBackend* backend;
+    uint8_t userKey[AES_KEY_SIZE];
+    AesKey key;
+    size_t blocks;
+    uint8_t data[16 * AES_BLOCK_SIZE];
+} AesBackendContext;
+
+static void BenchBackendSetKey(void* context, uint64_t iterations)
+{
+    AesBackendContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        aes_SetKey(&ctx->key, ctx->backend, ctx->userKey);
+    }
+    BENCH_USE(ctx->key.schedule[0]);
+}
+
+static void BenchBackendEncrypt(void* context, uint64_t iterations)
+{
+    AesBackendContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        aes_Encrypt(&ctx->key, ctx->data, ctx->data, ctx->blocks);
+    }
+    BENCH_USE(ctx->data[0]);
+}
+
+/**
+ * Every backend supported by this CPU, single block and whole daemon payload.
+ */
+static void BenchAesBackends(const BenchConfig* config)
+{
+    AesBackendContext ctx;
+    char name[64];
+    const AesBackend* backend;
+
+    FillRandom(ctx.userKey, sizeof(ctx.userKey));
+    FillRandom(ctx.data, sizeof(ctx.data));
+    for (int t = 0; (backend = aes_GetBackendAt(t)) != NULL; t++) {
+        if (aes_FindBackend(backend->name) == NULL) {
+            continue;
+        }
+        ctx.backend = backend;
+        snprintf(name, sizeof(name), "aes_SetKey:%s", backend->name);
+        bench_Run(name, BenchBackendSetKey, &ctx, config, NULL);
+
+        ctx.blocks = 1;
+        snprintf(name, sizeof(name), "aes_Encrypt:%s", backend->name);
+        bench_Run(name, BenchBackendEncrypt, &ctx, config, NULL);
+
+        ctx.blocks = (PAYLOAD_SIZE + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+        snprintf(name, sizeof(name), "aes_EncryptPayload:%s", backend->name);
+        bench_Run(name, BenchBackendEncrypt, &ctx, config, NULL);
+    }
+}
+
+/**
+ * Exponent generator used by the daemon before rng_GetBytes, kept as the baseline.
+ */
+static bool LegacyRandomizer(unsigned char* array, int length)
+{
+    for (int i = 0; i < length; ++i) {
+        array[i] = g_random_int() % 9;
+    }
+    return true;
+}
+
+#define MAX_RANDOM_SIZE (4096)
+
+typedef struct {
+    Randomizer randomizer;
+    int length;
+    unsigned char buffer[MAX_RANDOM_SIZE];
+} RandomContext;
+
+static void BenchRandomBytes(void* context, uint64_t iterations)
+{
+    RandomContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        ctx->randomizer(ctx->buffer, ctx->length);
+    }
+    BENCH_USE(ctx->buffer[0]);
+}
+
+/**
+ * Cost of one DH private exponent and bulk throughput in MB/s, for the legacy generator and rng_GetBytes.
+ */
+static void BenchRandom(const BenchConfig* config)
+{
+    static const struct {
+        const char* name;
+        Randomizer randomizer;
+    } randomizers[] = {
+        {"GenerateRandomX", LegacyRandomizer},
+        {"rng_GetBytes", rng_GetBytes},
+    };
+    const int lengths[] = {P_MODULE_LENGTH, MAX_RANDOM_SIZE};
+    RandomContext ctx;
+    BenchResult result;
+    char name[64];
+
+    for (size_t r = 0; r < sizeof(randomizers) / sizeof(randomizers[0]); r++) {
+        ctx.randomizer = randomizers[r].randomizer;
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            ctx.length = lengths[l];
+            snprintf(name, sizeof(name), "%s:%d", randomizers[r].name, ctx.length);
+            if (bench_Run(name, BenchRandomBytes, &ctx, config, &result)) {
+                snprintf(name, sizeof(name), "%s:%d:MBps", randomizers[r].name, ctx.length);
+                bench_ReportValue(name, ctx.length * 1000.0 / result.nsPerOp.median);
+            }
+        }
+    }
+    rng_WipePool();
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    if (!bench_ParseArgs(&config, argc, argv)) {
+        return 1;
+    }
+
+    bi_GenerateConst();
+    bench_Begin("crypto", &config);
+
+    BenchBigInt(&config);
+    BenchDiffieHellman(&config);
+    BenchKeyExchangeSession(&config);
+    BenchAes(&config);
+    BenchEncodeSizes(&config);
+    BenchAesBackends(&config);
+    BenchRandom(&config);
+
+    bench_End();
+    bi_ReleaseConst();
+    return 0;
+}
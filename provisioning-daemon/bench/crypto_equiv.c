@@ -0,0 +1,1220 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  crypto_equiv.c
+ * @brief Differential test of crypto backends. Every case feeds edge-case and random inputs to a reference
+ * implementation and to a candidate (new backend or independent oracle) and stops on the first divergence.
+ * With -b the throughput of both sides is measured as well, so the JSON report on stdout contains correctness
+ * and speedup of every case.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "crypto/aes_backend.h"
+#include "crypto/bigint.h"
+#include "crypto/crypto_config.h"
+#include "crypto/dh_table.h"
+#include "crypto/diffie_hellman_keys_exchanger.h"
+#include "crypto/encoder.h"
+#include "crypto/rijndael.h"
+#include "crypto/x25519.h"
+
+#define MAX_INPUT_SIZE          (512)
+#define MAX_OUTPUT_SIZE         (256)
+#define THROUGHPUT_INPUTS       (64)
+#define DEFAULT_SEED            (0x5EED5EEDULL)
+
+/** Size of pd_DeviceServerConfig, the biggest payload encoded by daemon */
+#define MAX_PAYLOAD_SIZE        (234)
+
+typedef struct EquivCase EquivCase;
+
+/**
+ * @brief Computes output of one side of a case from the input bytes.
+ */
+typedef void (*EquivFunction)(const uint8_t* input, uint8_t* output);
+
+/**
+ * @brief Fills input of a case. Indexes below the number of edge-case combinations select them, other indexes
+ * produce random inputs.
+ */
+typedef void (*EquivGenerator)(const EquivCase* equivCase, uint8_t* input, uint64_t index);
+
+struct EquivCase {
+    const char* name;
+    int operandCount;
+    int operandSize;            /**< bytes per operand, input size is operandCount * operandSize */
+    int outputSize;
+    uint64_t defaultInputs;     /**< inputs checked when -n is not given, depends on cost of the case */
+    EquivGenerator generate;
+    EquivFunction reference;
+    EquivFunction candidate;
+    bool (*isAvailable)(void);  /**< NULL - case can always run, otherwise it's skipped when false */
+};
+
+typedef struct {
+    const EquivCase* equivCase;
+    EquivFunction function;
+    uint8_t inputs[THROUGHPUT_INPUTS][MAX_INPUT_SIZE];
+    uint8_t output[MAX_OUTPUT_SIZE];
+} ThroughputContext;
+
+static uint64_t _RandomState;
+
+static uint64_t NextRandom(void)
+{
+    //xorshift64*, reproducible from the seed printed in the report
+    _RandomState ^= _RandomState >> 12;
+    _RandomState ^= _RandomState << 25;
+    _RandomState ^= _RandomState >> 27;
+    return _RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+static void FillRandom(uint8_t* buffer, int length)
+{
+    for (int t = 0; t < length; t++) {
+        buffer[t] = (uint8_t) (NextRandom() >> 56);
+    }
+}
+
+static void PrintHex(const char* label, const uint8_t* buffer, int length)
+{
+    fprintf(stderr, "  %-10s", label);
+    for (int t = 0; t < length; t++) {
+        fprintf(stderr, "%02x", buffer[t]);
+    }
+    fprintf(stderr, "\n");
+}
+
+/*
+ * Independent big number oracle. Plain 32-bit limbs and bit-by-bit long division, simple enough to be obviously
+ * correct, so that the nibble based bigint.c is not only compared to itself.
+ */
+
+#define ORACLE_LIMBS    (16)
+
+typedef struct {
+    uint32_t limb[ORACLE_LIMBS];
+} OracleInt;
+
+static void OracleLoad(OracleInt* result, const uint8_t* bytes, int length)
+{
+    memset(result, 0, sizeof(OracleInt));
+    for (int t = 0; t < length; t++) {
+        result->limb[t / 4] |= (uint32_t) bytes[t] << (8 * (t % 4));
+    }
+}
+
+static void OracleStore(const OracleInt* value, uint8_t* bytes, int length)
+{
+    for (int t = 0; t < length; t++) {
+        bytes[t] = (uint8_t) (value->limb[t / 4] >> (8 * (t % 4)));
+    }
+}
+
+static int OracleCompare(const OracleInt* a, const OracleInt* b)
+{
+    for (int t = ORACLE_LIMBS - 1; t >= 0; t--) {
+        if (a->limb[t] != b->limb[t]) {
+            return a->limb[t] > b->limb[t] ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+static int OracleBitLength(const OracleInt* value)
+{
+    for (int t = ORACLE_LIMBS - 1; t >= 0; t--) {
+        if (value->limb[t]) {
+            return t * 32 + 32 - __builtin_clz(value->limb[t]);
+        }
+    }
+    return 0;
+}
+
+static bool OracleBit(const OracleInt* value, int bit)
+{
+    return (value->limb[bit / 32] >> (bit % 32)) & 1;
+}
+
+static void OracleAdd(OracleInt* result, const OracleInt* a, const OracleInt* b)
+{
+    uint64_t carry = 0;
+    for (int t = 0; t < ORACLE_LIMBS; t++) {
+        carry += (uint64_t) a->limb[t] + b->limb[t];
+        result->limb[t] = (uint32_t) carry;
+        carry >>= 32;
+    }
+}
+
+static void OracleSub(OracleInt* result, const OracleInt* a, const OracleInt* b)
+{
+    uint64_t borrow = 0;
+    for (int t = 0; t < ORACLE_LIMBS; t++) {
+        uint64_t difference = (uint64_t) a->limb[t] - b->limb[t] - borrow;
+        result->limb[t] = (uint32_t) difference;
+        borrow = (difference >> 32) & 1;
+    }
+}
+
+static void OracleMultiply(OracleInt* result, const OracleInt* a, const OracleInt* b)
+{
+    OracleInt product;
+    memset(&product, 0, sizeof(product));
+    for (int i = 0; i < ORACLE_LIMBS; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; i + j < ORACLE_LIMBS; j++) {
+            carry += (uint64_t) a->limb[i] * b->limb[j] + product.limb[i + j];
+            product.limb[i + j] = (uint32_t) carry;
+            carry >>= 32;
+        }
+    }
+    *result = product;
+}
+
+static void OracleDivide(OracleInt* quotient, OracleInt* remainder, const OracleInt* a, const OracleInt* divider)
+{
+    OracleInt q, r;
+    memset(&q, 0, sizeof(q));
+    memset(&r, 0, sizeof(r));
+    for (int bit = OracleBitLength(a) - 1; bit >= 0; bit--) {
+        for (int t = ORACLE_LIMBS - 1; t > 0; t--) {
+            r.limb[t] = (r.limb[t] << 1) | (r.limb[t - 1] >> 31);
+        }
+        r.limb[0] = (r.limb[0] << 1) | OracleBit(a, bit);
+        if (OracleCompare(&r, divider) >= 0) {
+            OracleSub(&r, &r, divider);
+            q.limb[bit / 32] |= 1u << (bit % 32);
+        }
+    }
+    if (quotient) {
+        *quotient = q;
+    }
+    if (remainder) {
+        *remainder = r;
+    }
+}
+
+static void OracleMultiplyMod(OracleInt* result, const OracleInt* a, const OracleInt* b, const OracleInt* module)
+{
+    OracleInt product;
+    OracleMultiply(&product, a, b);
+    OracleDivide(NULL, result, &product, module);
+}
+
+static void OracleModExp(OracleInt* result, const OracleInt* base, const OracleInt* exponent, const OracleInt* module)
+{
+    OracleInt power;
+    memset(&power, 0, sizeof(power));
+    power.limb[0] = 1;
+    for (int bit = OracleBitLength(exponent) - 1; bit >= 0; bit--) {
+        OracleMultiplyMod(&power, &power, &power, module);
+        if (OracleBit(exponent, bit)) {
+            OracleMultiplyMod(&power, &power, base, module);
+        }
+    }
+    *result = power;
+}
+
+/*
+ * Input generators.
+ */
+
+#define EDGE_VALUES_COUNT   (16)
+
+static uint8_t _EdgeValues[EDGE_VALUES_COUNT][P_MODULE_LENGTH];
+
+static void SetEdgeValue(int index, const OracleInt* value)
+{
+    OracleStore(value, _EdgeValues[index], P_MODULE_LENGTH);
+}
+
+/**
+ * Values around nibble, byte, word and module boundaries, those are the spots where carries and digit capacity
+ * handling of bigint.c can go wrong.
+ */
+static void InitEdgeValues(void)
+{
+    OracleInt p, value, one;
+    OracleLoad(&p, g_KeyBuffer, P_MODULE_LENGTH);
+    OracleLoad(&one, (const uint8_t[]) {1}, 1);
+    const uint32_t smallValues[] = {0, 1, 2, 15, 16, 0xFF, CRYPTO_G_MODULE};
+    int index = 0;
+
+    for (size_t t = 0; t < sizeof(smallValues) / sizeof(smallValues[0]); t++) {
+        memset(&value, 0, sizeof(value));
+        value.limb[0] = smallValues[t];
+        SetEdgeValue(index++, &value);
+    }
+    OracleSub(&value, &p, &one);
+    SetEdgeValue(index++, &value);
+    SetEdgeValue(index++, &p);
+    OracleAdd(&value, &p, &one);
+    SetEdgeValue(index++, &value);
+
+    memset(_EdgeValues[index++], 0xFF, 8);                      //2^64 - 1
+    _EdgeValues[index++][P_MODULE_LENGTH - 1] = 0x80;           //2^127
+    memset(_EdgeValues[index++], 0xFF, P_MODULE_LENGTH);        //2^128 - 1
+    memset(_EdgeValues[index++], 0x0F, P_MODULE_LENGTH);
+    memset(_EdgeValues[index++], 0xF0, P_MODULE_LENGTH);
+    _EdgeValues[index++][8] = 0x01;                             //2^64
+}
+
+static uint64_t EdgeCombinations(const EquivCase* equivCase)
+{
+    uint64_t combinations = 1;
+    for (int t = 0; t < equivCase->operandCount; t++) {
+        combinations *= EDGE_VALUES_COUNT;
+    }
+    return combinations;
+}
+
+static void GenerateRandomOperand(uint8_t* operand, int size)
+{
+    memset(operand, 0, size);
+    switch (NextRandom() % 4) {
+        case 0:
+            //short number, exercises digit capacity handling
+            FillRandom(operand, 1 + NextRandom() % size);
+            break;
+
+        case 1:
+            //sparse digits
+            FillRandom(operand, size);
+            for (int t = 0; t < size; t++) {
+                operand[t] &= (NextRandom() & 1 ? 0x0F : 0xF0);
+            }
+            break;
+
+        case 2: {
+            //slightly below or above the module
+            OracleInt p, delta;
+            OracleLoad(&p, g_KeyBuffer, P_MODULE_LENGTH);
+            memset(&delta, 0, sizeof(delta));
+            delta.limb[0] = NextRandom() & 0xFFFF;
+            if (NextRandom() & 1) {
+                OracleAdd(&p, &p, &delta);
+            } else {
+                OracleSub(&p, &p, &delta);
+            }
+            OracleStore(&p, operand, size < P_MODULE_LENGTH ? size : P_MODULE_LENGTH);
+            break;
+        }
+
+        default:
+            FillRandom(operand, size);
+            break;
+    }
+}
+
+static void GenerateOperands(const EquivCase* equivCase, uint8_t* input, uint64_t index)
+{
+    uint64_t combinations = EdgeCombinations(equivCase);
+    for (int t = 0; t < equivCase->operandCount; t++) {
+        uint8_t* operand = input + t * equivCase->operandSize;
+        if (index < combinations) {
+            memset(operand, 0, equivCase->operandSize);
+            memcpy(operand, _EdgeValues[index % EDGE_VALUES_COUNT], P_MODULE_LENGTH);
+            index /= EDGE_VALUES_COUNT;
+        } else {
+            GenerateRandomOperand(operand, equivCase->operandSize);
+        }
+    }
+}
+
+/**
+ * Same as GenerateOperands but divider (the last operand) is never zero.
+ */
+static void GenerateDivision(const EquivCase* equivCase, uint8_t* input, uint64_t index)
+{
+    GenerateOperands(equivCase, input, index);
+    uint8_t* divider = input + (equivCase->operandCount - 1) * equivCase->operandSize;
+    for (int t = 0; t < equivCase->operandSize; t++) {
+        if (divider[t]) {
+            return;
+        }
+    }
+    divider[0] = 1;
+}
+
+static void GenerateRandomBytes(const EquivCase* equivCase, uint8_t* input, uint64_t index)
+{
+    (void)index;
+    FillRandom(input, equivCase->operandCount * equivCase->operandSize);
+}
+
+/*
+ * bigint.c against the oracle. Operands are P_MODULE_LENGTH bytes unless stated otherwise, results are truncated
+ * to the operand size like bigint.c does.
+ */
+
+static void BigIntBinary(const uint8_t* input, uint8_t* output, int length, void (*operation)(BigInt*, BigInt*))
+{
+    BigInt* a = bi_Create((uint8_t*) input, length);
+    BigInt* b = bi_Create((uint8_t*) input + length, length);
+    operation(a, b);
+    memcpy(output, a->buffer, length);
+    bi_Release(&b);
+    bi_Release(&a);
+}
+
+static void OracleBinary(const uint8_t* input, uint8_t* output, int length,
+        void (*operation)(OracleInt*, const OracleInt*, const OracleInt*))
+{
+    OracleInt a, b;
+    OracleLoad(&a, input, length);
+    OracleLoad(&b, input + length, length);
+    operation(&a, &a, &b);
+    OracleStore(&a, output, length);
+}
+
+static void ReferenceAdd(const uint8_t* input, uint8_t* output)
+{
+    BigIntBinary(input, output, P_MODULE_LENGTH, bi_Add);
+}
+
+static void OracleAddCase(const uint8_t* input, uint8_t* output)
+{
+    OracleBinary(input, output, P_MODULE_LENGTH, OracleAdd);
+}
+
+static void ReferenceSub(const uint8_t* input, uint8_t* output)
+{
+    BigIntBinary(input, output, P_MODULE_LENGTH, bi_Sub);
+}
+
+static void OracleSubCase(const uint8_t* input, uint8_t* output)
+{
+    OracleBinary(input, output, P_MODULE_LENGTH, OracleSub);
+}
+
+static void ReferenceMultiply(const uint8_t* input, uint8_t* output)
+{
+    BigIntBinary(input, output, P_MODULE_LENGTH, bi_Multiply);
+}
+
+static void OracleMultiplyCase(const uint8_t* input, uint8_t* output)
+{
+    OracleBinary(input, output, P_MODULE_LENGTH, OracleMultiply);
+}
+
+/**
+ * Double width dividend and divider, as used by bi_MultiplyAmodB.
+ */
+static void ReferenceDivide(const uint8_t* input, uint8_t* output)
+{
+    BigIntBinary(input, output, 2 * P_MODULE_LENGTH, bi_Divide);
+}
+
+static void OracleDivideCase(const uint8_t* input, uint8_t* output)
+{
+    OracleInt a, divider, quotient;
+    OracleLoad(&a, input, 2 * P_MODULE_LENGTH);
+    OracleLoad(&divider, input + 2 * P_MODULE_LENGTH, 2 * P_MODULE_LENGTH);
+    OracleDivide(&quotient, NULL, &a, &divider);
+    OracleStore(&quotient, output, 2 * P_MODULE_LENGTH);
+}
+
+/**
+ * Double width value reduced by the DH module.
+ */
+static void ReferenceModulo(const uint8_t* input, uint8_t* output)
+{
+    BigInt* a = bi_Create((uint8_t*) input, 2 * P_MODULE_LENGTH);
+    BigInt* p = bi_Create(NULL, 2 * P_MODULE_LENGTH);
+    memcpy(p->buffer, g_KeyBuffer, P_MODULE_LENGTH);
+    bi_Modulo(a, p);
+    memcpy(output, a->buffer, 2 * P_MODULE_LENGTH);
+    bi_Release(&p);
+    bi_Release(&a);
+}
+
+static void OracleModuloCase(const uint8_t* input, uint8_t* output)
+{
+    OracleInt a, p, remainder;
+    OracleLoad(&a, input, 2 * P_MODULE_LENGTH);
+    OracleLoad(&p, g_KeyBuffer, P_MODULE_LENGTH);
+    OracleDivide(NULL, &remainder, &a, &p);
+    OracleStore(&remainder, output, 2 * P_MODULE_LENGTH);
+}
+
+static void ReferenceMultiplyAmodB(const uint8_t* input, uint8_t* output)
+{
+    BigInt* a = bi_Create((uint8_t*) input, P_MODULE_LENGTH);
+    BigInt* b = bi_Create((uint8_t*) input + P_MODULE_LENGTH, P_MODULE_LENGTH);
+    BigInt* p = bi_Create(g_KeyBuffer, P_MODULE_LENGTH);
+    bi_MultiplyAmodB(a, b, p);
+    memcpy(output, a->buffer, P_MODULE_LENGTH);
+    bi_Release(&p);
+    bi_Release(&b);
+    bi_Release(&a);
+}
+
+static void OracleMultiplyAmodBCase(const uint8_t* input, uint8_t* output)
+{
+    OracleInt a, b, p;
+    OracleLoad(&a, input, P_MODULE_LENGTH);
+    OracleLoad(&b, input + P_MODULE_LENGTH, P_MODULE_LENGTH);
+    OracleLoad(&p, g_KeyBuffer, P_MODULE_LENGTH);
+    OracleMultiplyMod(&a, &a, &b, &p);
+    OracleStore(&a, output, P_MODULE_LENGTH);
+}
+
+/*
+ * diffie_hellman_keys_exchanger.c, input starts with private exponent x (little endian), followed by other party
+ * exchange key for completion cases.
+ */
+
+static const uint8_t* _NextExponent;
+
+static bool ExponentRandomizer(unsigned char* array, int length)
+{
+    //exchanger reverses randomizer output, reverse it here so x equals the input
+    for (int t = 0; t < length; t++) {
+        array[t] = _NextExponent[length - 1 - t];
+    }
+    return true;
+}
+
+static DiffieHellmanKeysExchanger* NewExchanger(const uint8_t* exponent)
+{
+    _NextExponent = exponent;
+    return dh_NewKeyExchanger((char*) g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, ExponentRandomizer);
+}
+
+static void TakeResult(DiffieHellmanKeysExchanger* exchanger, unsigned char* key, uint8_t* output)
+{
+    if (key) {
+        memcpy(output, key, P_MODULE_LENGTH);
+        free(key);
+    } else {
+        //NULL can't match any oracle result, make it visible in the report
+        memset(output, 0xEE, P_MODULE_LENGTH);
+    }
+    dh_Release(&exchanger);
+}
+
+static void ReferenceGenerate(const uint8_t* input, uint8_t* output)
+{
+    DiffieHellmanKeysExchanger* exchanger = NewExchanger(input);
+    TakeResult(exchanger, dh_GenerateExchangeData(exchanger), output);
+}
+
+static void SteppedGenerate(const uint8_t* input, uint8_t* output)
+{
+    DiffieHellmanKeysExchanger* exchanger = NewExchanger(input);
+    unsigned char* key = NULL;
+    if (dh_BeginGenerateExchangeData(exchanger)) {
+        //zero budget, so every square or multiply is a separate step
+        while (dh_StepExchange(exchanger, 0) == DhStepResult_IN_PROGRESS)
+            ;
+        key = dh_TakeExchangeResult(exchanger);
+    }
+    TakeResult(exchanger, key, output);
+}
+
+static DhTable* _FixedBaseTables[DH_TABLE_MAX_WINDOW_BITS + 1];
+
+/**
+ * Table goes through dh_SaveTable and dh_LoadTable, so the mapped file is what gets checked.
+ */
+static const DhTable* GetFixedBaseTable(int windowBits)
+{
+    if (_FixedBaseTables[windowBits] == NULL) {
+        char path[] = "/tmp/crypto_equiv_dh_table.XXXXXX";
+        int fd = mkstemp(path);
+        if (fd >= 0) {
+            close(fd);
+            DhTable* built = dh_BuildTable(g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, windowBits);
+            if (dh_SaveTable(built, path)) {
+                _FixedBaseTables[windowBits] = dh_LoadTable(path, g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE,
+                        windowBits);
+            }
+            dh_ReleaseTable(&built);
+            unlink(path);
+        }
+    }
+    return _FixedBaseTables[windowBits];
+}
+
+static void FixedBaseGenerate(const uint8_t* input, uint8_t* output, int windowBits)
+{
+    //without table reference would be compared with itself, NULL result makes it fail instead
+    const DhTable* table = GetFixedBaseTable(windowBits);
+    if (table == NULL) {
+        memset(output, 0xEE, P_MODULE_LENGTH);
+        return;
+    }
+    dh_SetFixedBaseTable(table);
+    SteppedGenerate(input, output);
+    dh_SetFixedBaseTable(NULL);
+}
+
+static void FixedBaseGenerate4(const uint8_t* input, uint8_t* output)
+{
+    FixedBaseGenerate(input, output, DH_TABLE_DEFAULT_WINDOW_BITS);
+}
+
+//digits span byte boundaries
+static void FixedBaseGenerate3(const uint8_t* input, uint8_t* output)
+{
+    FixedBaseGenerate(input, output, 3);
+}
+
+//last digit is shorter than the window
+static void FixedBaseGenerate6(const uint8_t* input, uint8_t* output)
+{
+    FixedBaseGenerate(input, output, 6);
+}
+
+static void OracleGenerate(const uint8_t* input, uint8_t* output)
+{
+    OracleInt g, x, p, y;
+    memset(&g, 0, sizeof(g));
+    g.limb[0] = CRYPTO_G_MODULE;
+    OracleLoad(&x, input, P_MODULE_LENGTH);
+    OracleLoad(&p, g_KeyBuffer, P_MODULE_LENGTH);
+    OracleModExp(&y, &g, &x, &p);
+    OracleStore(&y, output, P_MODULE_LENGTH);
+}
+
+static void ReferenceComplete(const uint8_t* input, uint8_t* output)
+{
+    DiffieHellmanKeysExchanger* exchanger = NewExchanger(input);
+    unsigned char* key = NULL;
+    //only x is needed, so drop generation before any step is done
+    if (dh_BeginGenerateExchangeData(exchanger)) {
+        dh_CancelExchange(exchanger);
+        key = dh_CompleteExchangeData(exchanger, (unsigned char*) input + P_MODULE_LENGTH, P_MODULE_LENGTH);
+    }
+    TakeResult(exchanger, key, output);
+}
+
+static void OracleComplete(const uint8_t* input, uint8_t* output)
+{
+    OracleInt y, x, p, key;
+    OracleLoad(&x, input, P_MODULE_LENGTH);
+    OracleLoad(&y, input + P_MODULE_LENGTH, P_MODULE_LENGTH);
+    OracleLoad(&p, g_KeyBuffer, P_MODULE_LENGTH);
+    OracleModExp(&key, &y, &x, &p);
+    OracleStore(&key, output, P_MODULE_LENGTH);
+}
+
+/*
+ * rijndael.c, input is 16 bytes key followed by 16 bytes block.
+ */
+
+static void ReferenceEncrypt(const uint8_t* input, uint8_t* output)
+{
+    rijndael_ctx ctx;
+    rijndael_set_key(&ctx, input, 128);
+    rijndael_encrypt(&ctx, input + 16, output);
+}
+
+static void EncOnlyEncrypt(const uint8_t* input, uint8_t* output)
+{
+    rijndael_ctx ctx;
+    rijndael_set_key_enc_only(&ctx, input, 128);
+    rijndael_encrypt(&ctx, input + 16, output);
+}
+
+static void Identity(const uint8_t* input, uint8_t* output)
+{
+    memcpy(output, input + 16, 16);
+}
+
+static void DecryptEncrypted(const uint8_t* input, uint8_t* output)
+{
+    rijndael_ctx ctx;
+    uint8_t encrypted[16];
+    rijndael_set_key(&ctx, input, 128);
+    rijndael_encrypt(&ctx, input + 16, encrypted);
+    rijndael_decrypt(&ctx, encrypted, output);
+}
+
+/*
+ * aes_backend.c, input is 16 bytes key, number of blocks (1-16) and the blocks. Candidates encrypt in place to
+ * check that src and dst may overlap.
+ */
+
+#define MAX_AES_BLOCKS  (16)
+
+static void GenerateAesBlocks(const EquivCase* equivCase, uint8_t* input, uint64_t index)
+{
+    (void)index;
+    FillRandom(input, equivCase->operandCount * equivCase->operandSize);
+    input[16] = 1 + NextRandom() % MAX_AES_BLOCKS;
+}
+
+static void ReferenceAesBlocks(const uint8_t* input, uint8_t* output)
+{
+    rijndael_ctx ctx;
+    rijndael_set_key_enc_only(&ctx, input, 128);
+    memset(output, 0, MAX_AES_BLOCKS * AES_BLOCK_SIZE);
+    for (int t = 0; t < input[16]; t++) {
+        rijndael_encrypt(&ctx, input + 17 + t * AES_BLOCK_SIZE, output + t * AES_BLOCK_SIZE);
+    }
+}
+
+static void EncryptWithBackend(const char* name, const uint8_t* input, uint8_t* output)
+{
+    AesKey key;
+    aes_SetKey(&key, aes_FindBackend(name), input);
+    memset(output, 0, MAX_AES_BLOCKS * AES_BLOCK_SIZE);
+    memcpy(output, input + 17, input[16] * AES_BLOCK_SIZE);
+    aes_Encrypt(&key, output, output, input[16]);
+    aes_WipeKey(&key);
+}
+
+static void TTableAesBlocks(const uint8_t* input, uint8_t* output)
+{
+    EncryptWithBackend("ttable", input, output);
+}
+
+static void BitslicedAesBlocks(const uint8_t* input, uint8_t* output)
+{
+    EncryptWithBackend("bitsliced", input, output);
+}
+
+static void AesNiAesBlocks(const uint8_t* input, uint8_t* output)
+{
+    EncryptWithBackend("aesni", input, output);
+}
+
+static bool HasAesNi(void)
+{
+    return aes_FindBackend("aesni") != NULL;
+}
+
+static void Armv8AesBlocks(const uint8_t* input, uint8_t* output)
+{
+    EncryptWithBackend("armv8", input, output);
+}
+
+static bool HasArmv8(void)
+{
+    return aes_FindBackend("armv8") != NULL;
+}
+
+/*
+ * encoder.c, input is 16 bytes key, payload length byte and payload. Decoding is inverse of encoding only when IV
+ * part of key_n_iv is the reversed key, which is how daemon and clicker derive it.
+ */
+
+static void GeneratePayload(const EquivCase* equivCase, uint8_t* input, uint64_t index)
+{
+    (void)index;
+    FillRandom(input, equivCase->operandCount * equivCase->operandSize);
+    input[16] = 1 + NextRandom() % MAX_PAYLOAD_SIZE;
+}
+
+static void IdentityPayload(const uint8_t* input, uint8_t* output)
+{
+    memset(output, 0, MAX_OUTPUT_SIZE);
+    memcpy(output, input + 17, input[16]);
+}
+
+static void DecodeEncodedPayload(const uint8_t* input, uint8_t* output)
+{
+    uint8_t keyAndIv[32];
+    uint8_t payload[MAX_OUTPUT_SIZE];
+    uint8_t outputSize;
+    uint8_t length = input[16];
+
+    memcpy(keyAndIv, input, 16);
+    for (int t = 0; t < 16; t++) {
+        keyAndIv[16 + t] = input[15 - t];
+    }
+    memset(payload, 0, sizeof(payload));
+    memcpy(payload, input + 17, length);
+
+    uint8_t* encoded = softap_EncodeBytes(payload, length, keyAndIv, &outputSize);
+    softap_DecodeBytes(encoded, outputSize, keyAndIv);
+    memset(output, 0, MAX_OUTPUT_SIZE);
+    memcpy(output, encoded, length);
+    free(encoded);
+}
+
+/**
+ * Encoding as it was done before softap_EncodeInto, block by block with the rijndael.c interface and payload padded
+ * with zeros.
+ */
+static void EncodePayload(const uint8_t* input, uint8_t* output)
+{
+    rijndael_ctx ctx;
+    uint8_t block[AES_BLOCK_SIZE];
+    uint8_t length = input[16];
+
+    rijndael_set_key_enc_only(&ctx, input, 128);
+    memset(output, 0, MAX_OUTPUT_SIZE);
+    for (int t = 0; t < length; t += AES_BLOCK_SIZE) {
+        for (int y = 0; y < AES_BLOCK_SIZE; y++) {
+            block[y] = t + y < length ? input[17 + t + y] : 0;
+            block[y] ^= y < AES_BLOCK_SIZE - 1 ? input[15 - y] : t / AES_BLOCK_SIZE;
+        }
+        rijndael_encrypt(&ctx, block, output + t);
+    }
+}
+
+static void EncodePayloadInPlace(const uint8_t* input, uint8_t* output)
+{
+    SoftapKey key;
+
+    softap_SetKey(&key, input);
+    memset(output, 0, MAX_OUTPUT_SIZE);
+    memcpy(output, input + 17, input[16]);
+    softap_EncodeInto(output, input[16], output, &key);
+    softap_WipeKey(&key);
+}
+
+/**
+ * Payload is decoded as whole blocks of ciphertext, with rijndael_decrypt block by block as the reference.
+ */
+static void DecodePayload(const uint8_t* input, uint8_t* output)
+{
+    rijndael_ctx ctx;
+    int length = input[16] / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+
+    rijndael_set_key(&ctx, input, 128);
+    memset(output, 0, MAX_OUTPUT_SIZE);
+    for (int t = 0; t < length; t += AES_BLOCK_SIZE) {
+        rijndael_decrypt(&ctx, input + 17 + t, output + t);
+        for (int y = 0; y < AES_BLOCK_SIZE; y++) {
+            output[t + y] ^= y < AES_BLOCK_SIZE - 1 ? input[15 - y] : t / AES_BLOCK_SIZE;
+        }
+    }
+}
+
+static void DecodePayloadInPlace(const uint8_t* input, uint8_t* output)
+{
+    uint8_t keyAndIv[32];
+    int length = input[16] / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+
+    memcpy(keyAndIv, input, 16);
+    for (int t = 0; t < 16; t++) {
+        keyAndIv[16 + t] = input[15 - t];
+    }
+    memset(output, 0, MAX_OUTPUT_SIZE);
+    memcpy(output, input + 17, length);
+    softap_DecodeInto(output, length, output, keyAndIv);
+}
+
+/**
+ * Key is prepared once and used for two payloads, like during provisioning, the second result is compared.
+ */
+static void EncodePayloadWithSessionKey(const uint8_t* input, uint8_t* output)
+{
+    SoftapKey key;
+    uint8_t payload[MAX_OUTPUT_SIZE];
+    uint8_t outputSize;
+
+    softap_SetKey(&key, input);
+    memset(payload, 0, sizeof(payload));
+    free(softap_EncodeBytesWithKey(payload, MAX_PAYLOAD_SIZE, &key, &outputSize));
+
+    memcpy(payload, input + 17, input[16]);
+    memset(payload + input[16], 0, sizeof(payload) - input[16]);
+    uint8_t* encoded = softap_EncodeBytesWithKey(payload, input[16], &key, &outputSize);
+    memset(output, 0, MAX_OUTPUT_SIZE);
+    memcpy(output, encoded, outputSize);
+    free(encoded);
+    softap_WipeKey(&key);
+}
+
+/*
+ * x25519.c, input is 32 bytes scalar and 32 bytes u-coordinate. The oracle runs the RFC 7748 ladder on OracleInt
+ * with plain reductions modulo p, no limb tricks shared with the radix 2^25.5 implementation.
+ */
+
+#define X25519_EDGE_POINTS  (6)
+
+static void GenerateX25519(const EquivCase* equivCase, uint8_t* input, uint64_t index)
+{
+    FillRandom(input, equivCase->operandCount * equivCase->operandSize);
+    if (index < X25519_EDGE_POINTS) {
+        uint8_t* point = input + X25519_KEY_SIZE;
+        //0, 1, p - 1, p, p + 1 and 2^256 - 1, the last four are only valid after reduction or masking top bit
+        static const uint8_t lowByte[X25519_EDGE_POINTS] = {0x00, 0x01, 0xec, 0xed, 0xee, 0xff};
+        bool isSmall = index < 2;
+        memset(point, isSmall ? 0x00 : 0xff, X25519_KEY_SIZE);
+        point[0] = lowByte[index];
+        if (!isSmall && index < X25519_EDGE_POINTS - 1) {
+            point[X25519_KEY_SIZE - 1] = 0x7f;
+        }
+    }
+}
+
+static void ReferenceX25519(const uint8_t* input, uint8_t* output)
+{
+    x25519_ScalarMult(output, input, input + X25519_KEY_SIZE);
+}
+
+static void OracleAddMod(OracleInt* result, const OracleInt* a, const OracleInt* b, const OracleInt* p)
+{
+    OracleInt sum;
+    OracleAdd(&sum, a, b);
+    OracleDivide(NULL, result, &sum, p);
+}
+
+static void OracleSubMod(OracleInt* result, const OracleInt* a, const OracleInt* b, const OracleInt* p)
+{
+    OracleInt sum;
+    OracleAdd(&sum, a, p);
+    OracleSub(&sum, &sum, b);
+    OracleDivide(NULL, result, &sum, p);
+}
+
+static void OracleX25519(const uint8_t* input, uint8_t* output)
+{
+    OracleInt p, exponent, a24, x1, x2, z2, x3, z3, a, aa, b, bb, e, c, d, da, cb, swap;
+    uint8_t scalar[X25519_KEY_SIZE];
+    uint8_t point[X25519_KEY_SIZE];
+
+    memset(&p, 0xff, sizeof(p));
+    memset(p.limb + 8, 0, sizeof(p.limb) - 8 * sizeof(p.limb[0]));
+    p.limb[0] = 0xffffffed;
+    p.limb[7] = 0x7fffffff;
+    exponent = p;
+    exponent.limb[0] -= 2;
+    memset(&a24, 0, sizeof(a24));
+    a24.limb[0] = 121665;
+
+    memcpy(scalar, input, sizeof(scalar));
+    scalar[0] &= 248;
+    scalar[31] = (scalar[31] & 127) | 64;
+    memcpy(point, input + X25519_KEY_SIZE, sizeof(point));
+    point[31] &= 127;
+
+    OracleLoad(&x1, point, X25519_KEY_SIZE);
+    OracleDivide(NULL, &x1, &x1, &p);
+    memset(&x2, 0, sizeof(x2));
+    x2.limb[0] = 1;
+    memset(&z2, 0, sizeof(z2));
+    x3 = x1;
+    z3 = x2;
+
+    for (int bit = 254; bit >= 0; bit--) {
+        bool set = (scalar[bit / 8] >> (bit % 8)) & 1;
+        if (set) {
+            swap = x2; x2 = x3; x3 = swap;
+            swap = z2; z2 = z3; z3 = swap;
+        }
+        OracleAddMod(&a, &x2, &z2, &p);
+        OracleMultiplyMod(&aa, &a, &a, &p);
+        OracleSubMod(&b, &x2, &z2, &p);
+        OracleMultiplyMod(&bb, &b, &b, &p);
+        OracleSubMod(&e, &aa, &bb, &p);
+        OracleAddMod(&c, &x3, &z3, &p);
+        OracleSubMod(&d, &x3, &z3, &p);
+        OracleMultiplyMod(&da, &d, &a, &p);
+        OracleMultiplyMod(&cb, &c, &b, &p);
+        OracleAddMod(&x3, &da, &cb, &p);
+        OracleMultiplyMod(&x3, &x3, &x3, &p);
+        OracleSubMod(&z3, &da, &cb, &p);
+        OracleMultiplyMod(&z3, &z3, &z3, &p);
+        OracleMultiplyMod(&z3, &z3, &x1, &p);
+        OracleMultiplyMod(&x2, &aa, &bb, &p);
+        OracleMultiplyMod(&z2, &a24, &e, &p);
+        OracleAddMod(&z2, &z2, &aa, &p);
+        OracleMultiplyMod(&z2, &z2, &e, &p);
+        if (set) {
+            swap = x2; x2 = x3; x3 = swap;
+            swap = z2; z2 = z3; z3 = swap;
+        }
+    }
+
+    OracleModExp(&z2, &z2, &exponent, &p);
+    OracleMultiplyMod(&x2, &x2, &z2, &p);
+    OracleStore(&x2, output, X25519_KEY_SIZE);
+}
+
+/**
+ * Both sides of the exchange derive the same key, input is private key of each side.
+ */
+static void DeriveKeyAsResponder(const uint8_t* input, uint8_t* output)
+{
+    uint8_t initiatorPublic[X25519_KEY_SIZE];
+    uint8_t responderPublic[X25519_KEY_SIZE];
+    x25519_PublicKey(initiatorPublic, input);
+    x25519_PublicKey(responderPublic, input + X25519_KEY_SIZE);
+    memset(output, 0, AES_KEY_SIZE);
+    x25519_DeriveKey(output, AES_KEY_SIZE, input + X25519_KEY_SIZE, initiatorPublic, responderPublic, false);
+}
+
+static void DeriveKeyAsInitiator(const uint8_t* input, uint8_t* output)
+{
+    uint8_t initiatorPublic[X25519_KEY_SIZE];
+    uint8_t responderPublic[X25519_KEY_SIZE];
+    x25519_PublicKey(initiatorPublic, input);
+    x25519_PublicKey(responderPublic, input + X25519_KEY_SIZE);
+    memset(output, 0, AES_KEY_SIZE);
+    x25519_DeriveKey(output, AES_KEY_SIZE, input, initiatorPublic, responderPublic, true);
+}
+
+static const EquivCase _Cases[] = {
+    {"bi_Add/oracle", 2, P_MODULE_LENGTH, P_MODULE_LENGTH, 1000000, GenerateOperands, ReferenceAdd,
+            OracleAddCase, NULL},
+    {"bi_Sub/oracle", 2, P_MODULE_LENGTH, P_MODULE_LENGTH, 1000000, GenerateOperands, ReferenceSub,
+            OracleSubCase, NULL},
+    {"bi_Multiply/oracle", 2, P_MODULE_LENGTH, P_MODULE_LENGTH, 100000, GenerateOperands, ReferenceMultiply,
+            OracleMultiplyCase, NULL},
+    {"bi_Divide/oracle", 2, 2 * P_MODULE_LENGTH, 2 * P_MODULE_LENGTH, 100000, GenerateDivision, ReferenceDivide,
+            OracleDivideCase, NULL},
+    {"bi_Modulo/oracle", 1, 2 * P_MODULE_LENGTH, 2 * P_MODULE_LENGTH, 100000, GenerateOperands, ReferenceModulo,
+            OracleModuloCase, NULL},
+    {"bi_MultiplyAmodB/oracle", 2, P_MODULE_LENGTH, P_MODULE_LENGTH, 10000, GenerateOperands,
+            ReferenceMultiplyAmodB, OracleMultiplyAmodBCase, NULL},
+    {"dh_GenerateExchangeData/oracle", 1, P_MODULE_LENGTH, P_MODULE_LENGTH, 100, GenerateOperands,
+            ReferenceGenerate, OracleGenerate, NULL},
+    {"dh_CompleteExchangeData/oracle", 2, P_MODULE_LENGTH, P_MODULE_LENGTH, 300, GenerateOperands,
+            ReferenceComplete, OracleComplete, NULL},
+    {"dh_StepExchange/blocking", 1, P_MODULE_LENGTH, P_MODULE_LENGTH, 50, GenerateOperands, ReferenceGenerate,
+            SteppedGenerate, NULL},
+    {"dh_GenerateExchangeData/fixed_base", 1, P_MODULE_LENGTH, P_MODULE_LENGTH, 100, GenerateOperands,
+            ReferenceGenerate, FixedBaseGenerate4, NULL},
+    {"dh_GenerateExchangeData/fixed_base_3", 1, P_MODULE_LENGTH, P_MODULE_LENGTH, 100, GenerateOperands,
+            ReferenceGenerate, FixedBaseGenerate3, NULL},
+    {"dh_GenerateExchangeData/fixed_base_6", 1, P_MODULE_LENGTH, P_MODULE_LENGTH, 100, GenerateOperands,
+            ReferenceGenerate, FixedBaseGenerate6, NULL},
+    {"rijndael_encrypt/enc_only", 2, 16, 16, 1000000, GenerateRandomBytes, ReferenceEncrypt, EncOnlyEncrypt, NULL},
+    {"rijndael_decrypt/roundtrip", 2, 16, 16, 1000000, GenerateRandomBytes, Identity, DecryptEncrypted, NULL},
+    {"aes_Encrypt/ttable", 1, 17 + MAX_AES_BLOCKS * AES_BLOCK_SIZE, MAX_AES_BLOCKS * AES_BLOCK_SIZE, 1000000,
+            GenerateAesBlocks, ReferenceAesBlocks, TTableAesBlocks, NULL},
+    {"aes_Encrypt/bitsliced", 1, 17 + MAX_AES_BLOCKS * AES_BLOCK_SIZE, MAX_AES_BLOCKS * AES_BLOCK_SIZE, 100000,
+            GenerateAesBlocks, ReferenceAesBlocks, BitslicedAesBlocks, NULL},
+    {"aes_Encrypt/aesni", 1, 17 + MAX_AES_BLOCKS * AES_BLOCK_SIZE, MAX_AES_BLOCKS * AES_BLOCK_SIZE, 1000000,
+            GenerateAesBlocks, ReferenceAesBlocks, AesNiAesBlocks, HasAesNi},
+    {"aes_Encrypt/armv8", 1, 17 + MAX_AES_BLOCKS * AES_BLOCK_SIZE, MAX_AES_BLOCKS * AES_BLOCK_SIZE, 1000000,
+            GenerateAesBlocks, ReferenceAesBlocks, Armv8AesBlocks, HasArmv8},
+    {"softap_EncodeBytes/session_key", 1, 17 + MAX_PAYLOAD_SIZE, MAX_OUTPUT_SIZE, 100000, GeneratePayload,
+            EncodePayload, EncodePayloadWithSessionKey, NULL},
+    {"softap_EncodeInto/in_place", 1, 17 + MAX_PAYLOAD_SIZE, MAX_OUTPUT_SIZE, 100000, GeneratePayload,
+            EncodePayload, EncodePayloadInPlace, NULL},
+    {"softap_DecodeBytes/roundtrip", 1, 17 + MAX_PAYLOAD_SIZE, MAX_OUTPUT_SIZE, 100000, GeneratePayload,
+            IdentityPayload, DecodeEncodedPayload, NULL},
+    {"softap_DecodeInto/in_place", 1, 17 + MAX_PAYLOAD_SIZE, MAX_OUTPUT_SIZE, 100000, GeneratePayload,
+            DecodePayload, DecodePayloadInPlace, NULL},
+    {"x25519_ScalarMult/oracle", 2, X25519_KEY_SIZE, X25519_KEY_SIZE, 50, GenerateX25519, ReferenceX25519,
+            OracleX25519, NULL},
+    {"x25519_DeriveKey/initiator", 2, X25519_KEY_SIZE, AES_KEY_SIZE, 200, GenerateRandomBytes,
+            DeriveKeyAsResponder, DeriveKeyAsInitiator, NULL},
+};
+
+/**
+ * FIPS-197 appendix C.1 and RFC 7748 vectors, make sure the references themselves are AES and X25519 before
+ * anything is compared to them.
+ */
+static bool CheckKnownAnswer(void)
+{
+    const uint8_t input[32] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+    const uint8_t expected[16] = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+    uint8_t output[16];
+
+    ReferenceEncrypt(input, output);
+    if (memcmp(output, expected, sizeof(expected)) != 0) {
+        fprintf(stderr, "rijndael_encrypt doesn't match FIPS-197 known answer\n");
+        PrintHex("expected", expected, sizeof(expected));
+        PrintHex("got", output, sizeof(output));
+        return false;
+    }
+
+    //RFC 7748 section 6.1, public key of Alice
+    const uint8_t privateKey[X25519_KEY_SIZE] = {
+        0x77, 0x07, 0x6d, 0x0a, 0x73, 0x18, 0xa5, 0x7d, 0x3c, 0x16, 0xc1, 0x72, 0x51, 0xb2, 0x66, 0x45,
+        0xdf, 0x4c, 0x2f, 0x87, 0xeb, 0xc0, 0x99, 0x2a, 0xb1, 0x77, 0xfb, 0xa5, 0x1d, 0xb9, 0x2c, 0x2a};
+    const uint8_t publicKey[X25519_KEY_SIZE] = {
+        0x85, 0x20, 0xf0, 0x09, 0x89, 0x30, 0xa7, 0x54, 0x74, 0x8b, 0x7d, 0xdc, 0xb4, 0x3e, 0xf7, 0x5a,
+        0x0d, 0xbf, 0x3a, 0x0d, 0x26, 0x38, 0x1a, 0xf4, 0xeb, 0xa4, 0xa9, 0x8e, 0xaa, 0x9b, 0x4e, 0x6a};
+    uint8_t publicOutput[X25519_KEY_SIZE];
+
+    x25519_PublicKey(publicOutput, privateKey);
+    if (memcmp(publicOutput, publicKey, sizeof(publicKey)) != 0) {
+        fprintf(stderr, "x25519_PublicKey doesn't match RFC 7748 known answer\n");
+        PrintHex("expected", publicKey, sizeof(publicKey));
+        PrintHex("got", publicOutput, sizeof(publicOutput));
+        return false;
+    }
+    return true;
+}
+
+static bool CheckCase(const EquivCase* equivCase, uint64_t inputs)
+{
+    uint8_t input[MAX_INPUT_SIZE];
+    uint8_t referenceOutput[MAX_OUTPUT_SIZE];
+    uint8_t candidateOutput[MAX_OUTPUT_SIZE];
+    int inputSize = equivCase->operandCount * equivCase->operandSize;
+
+    for (uint64_t index = 0; index < inputs; index++) {
+        equivCase->generate(equivCase, input, index);
+        equivCase->reference(input, referenceOutput);
+        equivCase->candidate(input, candidateOutput);
+        if (memcmp(referenceOutput, candidateOutput, equivCase->outputSize) != 0) {
+            fprintf(stderr, "%s: divergence at input %llu\n", equivCase->name, (unsigned long long) index);
+            PrintHex("input", input, inputSize);
+            PrintHex("reference", referenceOutput, equivCase->outputSize);
+            PrintHex("candidate", candidateOutput, equivCase->outputSize);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void RunThroughput(void* context, uint64_t iterations)
+{
+    ThroughputContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        ctx->function(ctx->inputs[t % THROUGHPUT_INPUTS], ctx->output);
+    }
+    BENCH_USE(ctx->output[0]);
+}
+
+static void MeasureCase(const EquivCase* equivCase, const BenchConfig* config)
+{
+    ThroughputContext* ctx = malloc(sizeof(ThroughputContext));
+    char name[128];
+    BenchResult reference, candidate;
+
+    //edge cases are mostly trivial, measure random inputs only
+    ctx->equivCase = equivCase;
+    for (int t = 0; t < THROUGHPUT_INPUTS; t++) {
+        equivCase->generate(equivCase, ctx->inputs[t], UINT64_MAX);
+    }
+
+    ctx->function = equivCase->reference;
+    snprintf(name, sizeof(name), "%s:reference", equivCase->name);
+    bench_Run(name, RunThroughput, ctx, config, &reference);
+
+    ctx->function = equivCase->candidate;
+    snprintf(name, sizeof(name), "%s:candidate", equivCase->name);
+    bench_Run(name, RunThroughput, ctx, config, &candidate);
+
+    snprintf(name, sizeof(name), "%s:speedup", equivCase->name);
+    bench_ReportValue(name, candidate.nsPerOp.median > 0 ? reference.nsPerOp.median / candidate.nsPerOp.median : 0);
+    free(ctx);
+}
+
+static void PrintUsage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-n inputs per case] [-s seed] [-f case filter] [-b] [-r repetitions] "
+            "[-t min repetition time ms]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    uint64_t inputs = 0;
+    uint64_t seed = DEFAULT_SEED;
+    const char* filter = NULL;
+    bool measure = false;
+
+    bench_ParseArgs(&config, 1, argv);
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:f:br:t:")) != -1) {
+        switch (opt) {
+            case 'n':
+                inputs = strtoull(optarg, NULL, 10);
+                break;
+
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case 'f':
+                filter = optarg;
+                break;
+
+            case 'b':
+                measure = true;
+                break;
+
+            case 'r':
+                config.repetitions = atoi(optarg);
+                break;
+
+            case 't':
+                config.minTimeNs = strtoull(optarg, NULL, 10) * 1000000ULL;
+                break;
+
+            default:
+                PrintUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (config.repetitions < 1 || config.repetitions > BENCH_MAX_REPETITIONS) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    bi_GenerateConst();
+    InitEdgeValues();
+    _RandomState = seed ? seed : DEFAULT_SEED;
+
+    bench_Begin("crypto_equiv", &config);
+    bench_ReportValue("seed", (double) seed);
+    bool passed = CheckKnownAnswer();
+
+    for (size_t t = 0; passed && t < sizeof(_Cases) / sizeof(_Cases[0]); t++) {
+        const EquivCase* equivCase = &_Cases[t];
+        if (filter != NULL && strstr(equivCase->name, filter) == NULL) {
+            continue;
+        }
+        if (equivCase->isAvailable != NULL && !equivCase->isAvailable()) {
+            fprintf(stderr, "%-32s skipped, not supported by this CPU\n", equivCase->name);
+            continue;
+        }
+
+        uint64_t caseInputs = inputs ? inputs : equivCase->defaultInputs;
+        uint64_t start = bench_GetTimeNs();
+        passed = CheckCase(equivCase, caseInputs);
+        fprintf(stderr, "%-32s %10llu inputs %s in %.1f s\n", equivCase->name, (unsigned long long) caseInputs,
+                passed ? "equal" : "DIVERGED", (bench_GetTimeNs() - start) / 1e9);
+
+        char name[128];
+        snprintf(name, sizeof(name), "%s:inputs", equivCase->name);
+        bench_ReportValue(name, passed ? (double) caseInputs : -1);
+        if (passed && measure) {
+            MeasureCase(equivCase, &config);
+        }
+    }
+
+    bench_End();
+    for (int t = 0; t <= DH_TABLE_MAX_WINDOW_BITS; t++) {
+        dh_ReleaseTable(&_FixedBaseTables[t]);
+    }
+    bi_ReleaseConst();
+    return passed ? 0 : 1;
+}
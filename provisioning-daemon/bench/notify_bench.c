@@ -0,0 +1,217 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  notify_bench.c
+ * @brief Cost of ubus notifications with several subscribers, one notification per clicker event compared with one
+ * batch carrying the events of 1000 clickers (as notifier.c sends them). Needs running ubusd, subscribers are forked
+ * processes. Prints JSON report on stdout.
+ */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#include <glib.h>
+#include <libubus.h>
+#include <libubox/blobmsg.h>
+
+#define OBJECT_NAME         "provisioning-daemon-notify-bench"
+#define CLICKER_COUNT       (1000)
+#define MAX_SUBSCRIBERS     (10)
+#define NOTIFY_TIMEOUT_MS   (1000)
+
+static const int _SubscriberCounts[] = {1, MAX_SUBSCRIBERS};
+static const int _BatchSizes[] = {1, 100, CLICKER_COUNT};
+
+static struct ubus_context* _Context;
+static struct ubus_object_type _ObjectType = { .name = OBJECT_NAME };
+static struct ubus_object _Object = { .name = OBJECT_NAME, .type = &_ObjectType };
+static pid_t _Subscribers[MAX_SUBSCRIBERS];
+static int _SubscriberCount = 0;
+
+typedef struct {
+    struct blob_buf message;
+} NotifyContext;
+
+static int OnNotification(struct ubus_context* ctx, struct ubus_object* obj, struct ubus_request_data* req,
+        const char* method, struct blob_attr* msg)
+{
+    BENCH_USE(msg);
+    return UBUS_STATUS_OK;
+}
+
+/**
+ * Subscriber process, tells parent through readyFd when it's subscribed and then handles notifications until killed.
+ */
+static void RunSubscriber(int readyFd)
+{
+    uloop_init();
+    struct ubus_context* ctx = ubus_connect(NULL);
+    if (ctx == NULL) {
+        _exit(1);
+    }
+    ubus_add_uloop(ctx);
+
+    struct ubus_subscriber subscriber;
+    memset(&subscriber, 0, sizeof(subscriber));
+    subscriber.cb = OnNotification;
+    uint32_t id;
+    if (ubus_register_subscriber(ctx, &subscriber) != 0 || ubus_lookup_id(ctx, OBJECT_NAME, &id) != 0 ||
+            ubus_subscribe(ctx, &subscriber, id) != 0) {
+        _exit(1);
+    }
+    if (write(readyFd, "r", 1) != 1) {
+        _exit(1);
+    }
+    close(readyFd);
+    uloop_run();
+    _exit(0);
+}
+
+static bool AddSubscribers(int count)
+{
+    int ready[2];
+    if (pipe(ready) != 0) {
+        return false;
+    }
+    for (int t = 0; t < count; t++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(ready[0]);
+            RunSubscriber(ready[1]);
+        }
+        if (pid < 0) {
+            break;
+        }
+        _Subscribers[_SubscriberCount++] = pid;
+    }
+    close(ready[1]);
+
+    int subscribed = 0;
+    char byte;
+    while (subscribed < count && read(ready[0], &byte, 1) == 1) {
+        subscribed++;
+    }
+    close(ready[0]);
+    return subscribed == count;
+}
+
+static void StopSubscribers(void)
+{
+    for (int t = 0; t < _SubscriberCount; t++) {
+        kill(_Subscribers[t], SIGTERM);
+        waitpid(_Subscribers[t], NULL, 0);
+    }
+    _SubscriberCount = 0;
+}
+
+/**
+ * Message of notifier.c with given number of events.
+ */
+static void BuildMessage(struct blob_buf* message, int events)
+{
+    blob_buf_init(message, 0);
+    blobmsg_add_u64(message, "version", 1500000000000ull);
+    void* cookie_array = blobmsg_open_array(message, "events");
+    for (int t = 0; t < events; t++) {
+        void* cookie_item = blobmsg_open_table(message, NULL);
+        blobmsg_add_string(message, "event", "connected");
+        blobmsg_add_u32(message, "clickerID", t);
+        blobmsg_add_u32(message, "error", 0);
+        blobmsg_close_table(message, cookie_item);
+    }
+    blobmsg_close_array(message, cookie_array);
+}
+
+/**
+ * One operation is a notification delivered to all subscribers, ubus_notify waits for all of them.
+ */
+static void BenchNotify(void* context, uint64_t iterations)
+{
+    NotifyContext* ctx = context;
+    for (uint64_t t = 0; t < iterations; t++) {
+        ubus_notify(_Context, &_Object, "state", ctx->message.head, NOTIFY_TIMEOUT_MS);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    if (!bench_ParseArgs(&config, argc, argv)) {
+        return 1;
+    }
+
+    _Context = ubus_connect(NULL);
+    if (_Context == NULL || ubus_add_object(_Context, &_Object) != 0) {
+        fprintf(stderr, "notify_bench needs running ubusd\n");
+        return 1;
+    }
+
+    bench_Begin("notify", &config);
+    for (size_t s = 0; s < G_N_ELEMENTS(_SubscriberCounts); s++) {
+        if (!AddSubscribers(_SubscriberCounts[s] - _SubscriberCount)) {
+            fprintf(stderr, "Can't start %d subscribers\n", _SubscriberCounts[s]);
+            break;
+        }
+
+        BenchResult results[G_N_ELEMENTS(_BatchSizes)];
+        bool measured[G_N_ELEMENTS(_BatchSizes)];
+        char name[64];
+        for (size_t b = 0; b < G_N_ELEMENTS(_BatchSizes); b++) {
+            NotifyContext ctx;
+            memset(&ctx, 0, sizeof(ctx));
+            BuildMessage(&ctx.message, _BatchSizes[b]);
+            snprintf(name, sizeof(name), "notify:events_%d:subscribers_%d", _BatchSizes[b], _SubscriberCount);
+            measured[b] = bench_Run(name, BenchNotify, &ctx, &config, &results[b]);
+            blob_buf_free(&ctx.message);
+        }
+
+        //events of all clickers sent one by one versus in one batch
+        size_t last = G_N_ELEMENTS(_BatchSizes) - 1;
+        if (measured[0] && measured[last]) {
+            snprintf(name, sizeof(name), "notify:clickers_%d:subscribers_%d:unbatched_us", CLICKER_COUNT,
+                    _SubscriberCount);
+            bench_ReportValue(name, results[0].nsPerOp.median * CLICKER_COUNT / 1000.0);
+            snprintf(name, sizeof(name), "notify:clickers_%d:subscribers_%d:batched_us", CLICKER_COUNT,
+                    _SubscriberCount);
+            bench_ReportValue(name, results[last].nsPerOp.median / 1000.0);
+        }
+    }
+    bench_End();
+
+    StopSubscribers();
+    ubus_free(_Context);
+    return 0;
+}
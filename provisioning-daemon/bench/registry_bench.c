@@ -0,0 +1,334 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  registry_bench.c
+ * @brief Throughput of exclusive (clicker_AcquireOwnership) and shared (clicker_AcquireReadOnly) clicker access
+ * from several threads, compared with the former list under one mutex, and memory taken by one clicker. Prints
+ * JSON report on stdout.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "clicker.h"
+#include "event.h"
+
+#include <glib.h>
+
+#define MAX_THREADS     (8)
+
+static const int _ThreadCounts[] = {1, 2, 4, 8};
+static const int _ClickerCounts[] = {10, 100, 1000, 10000};
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+/*
+ * Heap allocations made by the measuring thread are counted by wrapping glibc allocator, glib allocates through it
+ * too. Other C libraries (and sanitizers) don't offer __libc_* entry points, footprint is then reported without
+ * allocation counts.
+ */
+#define COUNT_ALLOCATIONS
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static __thread bool _Counting = false;
+static __thread uint64_t _Allocations = 0;
+static __thread uint64_t _AllocatedBytes = 0;
+
+static void CountAllocation(size_t size)
+{
+    if (_Counting) {
+        _Allocations++;
+        _AllocatedBytes += size;
+    }
+}
+
+void* malloc(size_t size)
+{
+    CountAllocation(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    CountAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if (ptr == NULL) {
+        CountAllocation(size);
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+#endif
+
+/*
+ * Former implementation: GQueue searched by g_queue_find_custom under one mutex, kept here as the baseline.
+ */
+
+typedef struct {
+    int clickerID;
+    gint ownershipsCount;
+    GMutex ownershipLock;
+} LegacyClicker;
+
+static GQueue* _LegacyQueue;
+static GMutex _LegacyMutex;
+
+static gint CompareLegacyById(gconstpointer a, gconstpointer b)
+{
+    return ((const LegacyClicker*) a)->clickerID - ((const LegacyClicker*) b)->clickerID;
+}
+
+static LegacyClicker* LegacyAcquire(int clickerID)
+{
+    LegacyClicker tmp;
+    tmp.clickerID = clickerID;
+    g_mutex_lock(&_LegacyMutex);
+    GList* found = g_queue_find_custom(_LegacyQueue, &tmp, CompareLegacyById);
+    LegacyClicker* clicker = found != NULL ? found->data : NULL;
+    if (clicker != NULL) {
+        clicker->ownershipsCount++;
+    }
+    g_mutex_unlock(&_LegacyMutex);
+
+    if (clicker != NULL) {
+        g_mutex_lock(&clicker->ownershipLock);
+    }
+    return clicker;
+}
+
+static void LegacyRelease(LegacyClicker* clicker)
+{
+    g_mutex_unlock(&clicker->ownershipLock);
+    g_mutex_lock(&_LegacyMutex);
+    clicker->ownershipsCount--;
+    g_mutex_unlock(&_LegacyMutex);
+}
+
+static void LegacyCreate(int count)
+{
+    _LegacyQueue = g_queue_new();
+    g_mutex_init(&_LegacyMutex);
+    for (int t = 0; t < count; t++) {
+        LegacyClicker* clicker = g_new0(LegacyClicker, 1);
+        clicker->clickerID = t;
+        clicker->ownershipsCount = 1;
+        g_mutex_init(&clicker->ownershipLock);
+        g_queue_push_tail(_LegacyQueue, clicker);
+    }
+}
+
+static void LegacyDestroy(void)
+{
+    LegacyClicker* clicker;
+    while ((clicker = g_queue_pop_head(_LegacyQueue)) != NULL) {
+        g_mutex_clear(&clicker->ownershipLock);
+        g_free(clicker);
+    }
+    g_queue_free(_LegacyQueue);
+    g_mutex_clear(&_LegacyMutex);
+}
+
+/*
+ * Registry of clicker.c, filled through the same events as in the daemon.
+ */
+
+static void SendClickerEvent(EventType type, int clickerID)
+{
+    Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.intData = clickerID;
+    clicker_ConsumeEvent(&event);
+}
+
+static void RegistryCreate(int count)
+{
+    clicker_Init();
+    for (int t = 0; t < count; t++) {
+        SendClickerEvent(EventType_CLICKER_CREATE, t);
+    }
+}
+
+static void RegistryDestroy(int count)
+{
+    for (int t = 0; t < count; t++) {
+        SendClickerEvent(EventType_CLICKER_DESTROY, t);
+    }
+    clicker_Shutdown();
+}
+
+typedef enum {
+    AccessMode_LIST,            /**< former implementation */
+    AccessMode_EXCLUSIVE,       /**< clicker_AcquireOwnership */
+    AccessMode_SHARED           /**< clicker_AcquireReadOnly */
+} AccessMode;
+
+static const char* const _AccessModeNames[] = {"list", "hash", "hash_shared"};
+
+typedef struct {
+    AccessMode mode;
+    int clickers;
+    uint64_t iterations;
+    uint32_t seed;
+} WorkerContext;
+
+typedef struct {
+    AccessMode mode;
+    int threads;
+    int clickers;
+} RegistryContext;
+
+static void* Worker(void* data)
+{
+    WorkerContext* ctx = data;
+    uint32_t state = ctx->seed;
+    for (uint64_t t = 0; t < ctx->iterations; t++) {
+        //xorshift32, ids are spread over the whole registry like concurrent sessions
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        int id = state % ctx->clickers;
+        if (ctx->mode == AccessMode_LIST) {
+            LegacyClicker* clicker = LegacyAcquire(id);
+            BENCH_USE(clicker);
+            LegacyRelease(clicker);
+        } else if (ctx->mode == AccessMode_EXCLUSIVE) {
+            Clicker* clicker = clicker_AcquireOwnership(id);
+            BENCH_USE(clicker);
+            clicker_ReleaseOwnership(clicker);
+        } else {
+            const Clicker* clicker = clicker_AcquireReadOnly(id);
+            BENCH_USE(clicker);
+            clicker_ReleaseReadOnly(clicker);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * One operation is a single acquire + release, split among the threads.
+ */
+static void BenchAcquireRelease(void* context, uint64_t iterations)
+{
+    RegistryContext* ctx = context;
+    pthread_t threads[MAX_THREADS];
+    WorkerContext workers[MAX_THREADS];
+
+    for (int t = 0; t < ctx->threads; t++) {
+        workers[t].mode = ctx->mode;
+        workers[t].clickers = ctx->clickers;
+        workers[t].iterations = iterations / ctx->threads + (t < iterations % ctx->threads ? 1 : 0);
+        workers[t].seed = 0x9E3779B9u * (t + 1);
+        pthread_create(&threads[t], NULL, Worker, &workers[t]);
+    }
+    for (int t = 0; t < ctx->threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+static void BenchRegistry(const BenchConfig* config)
+{
+    RegistryContext ctx;
+    for (size_t c = 0; c < G_N_ELEMENTS(_ClickerCounts); c++) {
+        ctx.clickers = _ClickerCounts[c];
+        LegacyCreate(ctx.clickers);
+        RegistryCreate(ctx.clickers);
+        for (size_t t = 0; t < G_N_ELEMENTS(_ThreadCounts); t++) {
+            BenchResult results[G_N_ELEMENTS(_AccessModeNames)];
+            bool measured[G_N_ELEMENTS(_AccessModeNames)];
+            char name[64];
+            ctx.threads = _ThreadCounts[t];
+
+            for (int mode = AccessMode_LIST; mode <= AccessMode_SHARED; mode++) {
+                ctx.mode = mode;
+                snprintf(name, sizeof(name), "acquire:%s:clickers_%d:threads_%d", _AccessModeNames[mode],
+                        ctx.clickers, ctx.threads);
+                measured[mode] = bench_Run(name, BenchAcquireRelease, &ctx, config, &results[mode]);
+                if (mode != AccessMode_LIST && measured[mode] && measured[AccessMode_LIST]) {
+                    snprintf(name, sizeof(name), "acquire:%s:clickers_%d:threads_%d:speedup", _AccessModeNames[mode],
+                            ctx.clickers, ctx.threads);
+                    bench_ReportValue(name, results[AccessMode_LIST].nsPerOp.median / results[mode].nsPerOp.median);
+                }
+            }
+        }
+        RegistryDestroy(ctx.clickers);
+        LegacyDestroy();
+    }
+}
+
+/**
+ * Memory taken by clickers alone, few enough of them are created to fit into initial registry table.
+ */
+static void BenchFootprint(void)
+{
+    const int count = 8;
+    bench_ReportValue("footprint:sizeof_clicker", sizeof(Clicker));
+#ifdef COUNT_ALLOCATIONS
+    clicker_Init();
+    _Allocations = 0;
+    _AllocatedBytes = 0;
+    _Counting = true;
+    for (int t = 0; t < count; t++) {
+        SendClickerEvent(EventType_CLICKER_CREATE, t);
+    }
+    _Counting = false;
+    bench_ReportValue("footprint:allocations_per_clicker", (double) _Allocations / count);
+    bench_ReportValue("footprint:heap_bytes_per_clicker", (double) _AllocatedBytes / count);
+    RegistryDestroy(count);
+#endif
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    if (!bench_ParseArgs(&config, argc, argv)) {
+        return 1;
+    }
+
+    bench_Begin("registry", &config);
+    BenchFootprint();
+    BenchRegistry(&config);
+    bench_End();
+    return 0;
+}
@@ -0,0 +1,252 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  state_bench.c
+ * @brief Latency of ubus getState reply with 1000 connected clickers, built on every call like the former handler
+ * and served from state_snapshot.c (full reply and delta since version a few main loop iterations old), while main loop
+ * thread keeps changing clickers. Prints JSON report with percentiles of single request latency on stdout.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "clicker.h"
+#include "event.h"
+#include "provision_history.h"
+#include "state_snapshot.h"
+
+#include <glib.h>
+#include <libubox/blobmsg.h>
+
+#define CLICKER_COUNT           (1000)
+#define PROVISIONED_COUNT       (100)
+#define REQUEST_COUNT           (2000)
+#define LOOP_CHANGES            (20)        /**< clickers changed by one main loop iteration */
+#define LOOP_SLEEP_US           (1000)
+#define DELTA_LAG               (2)         /**< delta is requested since version that many changes old */
+
+static volatile bool _Running;
+static uint8_t _SendBuffer[256 * 1024];
+
+/*
+ * Stand-in for controls.c, which needs board hardware.
+ */
+int controls_GetSelectedClickerId(void)
+{
+    return 0;
+}
+
+static void SendEvent(EventType type, int clickerID)
+{
+    Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.intData = clickerID;
+    clicker_ConsumeEvent(&event);
+    history_ConsumeEvent(&event);
+    snapshot_ConsumeEvent(&event);
+}
+
+/**
+ * What ubus_send_reply does with the reply, copy it into socket buffer.
+ */
+static void Send(struct blob_attr* reply)
+{
+    size_t length = MIN(blob_raw_len(reply), sizeof(_SendBuffer));
+    memcpy(_SendBuffer, reply, length);
+    BENCH_USE(_SendBuffer);
+}
+
+/**
+ * Former GetStateMethodHandler: reply built from registry and history on every request.
+ */
+static void LegacyGetState(void)
+{
+    int selClickerId = controls_GetSelectedClickerId();
+    GArray* historyItems = history_GetProvisioned();
+    struct blob_buf replyBloob = {0, NULL, 0, NULL};
+    blob_buf_init(&replyBloob, 0);
+    void* cookie_array = blobmsg_open_array(&replyBloob, "clickers");
+    for (guint t = 0; t < historyItems->len; t++) {
+        void* cookie_item = blobmsg_open_table(&replyBloob, "clicker");
+        HistoryItem* history = &g_array_index(historyItems, HistoryItem, t);
+        blobmsg_add_u32(&replyBloob, "id", history->id);
+        blobmsg_add_string(&replyBloob, "name", history->name);
+        blobmsg_add_u8(&replyBloob, "selected", false);
+        blobmsg_add_u8(&replyBloob, "inProvisionState", false);
+        blobmsg_add_u8(&replyBloob, "isProvisioned", true);
+        blobmsg_add_u8(&replyBloob, "isError", history->isErrored);
+        blobmsg_close_table(&replyBloob, cookie_item);
+    }
+    for (int id = 0; id < CLICKER_COUNT; id++) {
+        if (history_FindById(id, NULL)) {
+            continue;
+        }
+        const Clicker* clk = clicker_AcquireReadOnly(id);
+        if (clk == NULL) {
+            continue;
+        }
+        void* cookie_item = blobmsg_open_table(&replyBloob, "clicker");
+        blobmsg_add_u32(&replyBloob, "id", clk->clickerID);
+        blobmsg_add_string(&replyBloob, "name", clk->name);
+        blobmsg_add_u8(&replyBloob, "selected", clk->clickerID == selClickerId);
+        blobmsg_add_u8(&replyBloob, "inProvisionState", clk->provisioningInProgress);
+        blobmsg_add_u8(&replyBloob, "isProvisioned", false);
+        blobmsg_add_u8(&replyBloob, "isError", clk->error > 0);
+        blobmsg_close_table(&replyBloob, cookie_item);
+        clicker_ReleaseReadOnly(clk);
+    }
+    g_array_free(historyItems, TRUE);
+    blobmsg_close_array(&replyBloob, cookie_array);
+    Send(replyBloob.head);
+    blob_buf_free(&replyBloob);
+}
+
+static void SnapshotGetState(void)
+{
+    StateSnapshot* snapshot = snapshot_Acquire();
+    Send(snapshot->reply.head);
+    snapshot_Release(snapshot);
+}
+
+static void DeltaGetState(void)
+{
+    StateSnapshot* snapshot = snapshot_Acquire();
+    uint64_t sinceVersion = snapshot->version - DELTA_LAG;
+    snapshot_Release(snapshot);
+
+    struct blob_buf reply = {0, NULL, 0, NULL};
+    blob_buf_init(&reply, 0);
+    if (snapshot_BuildDelta(sinceVersion, &reply)) {
+        Send(reply.head);
+    }
+    blob_buf_free(&reply);
+}
+
+/**
+ * Main loop: changes state of some clickers while holding their ownership, then refreshes the snapshot.
+ */
+static void* MainLoop(void* data)
+{
+    uint32_t state = 0x9E3779B9u;
+    while (_Running) {
+        for (int t = 0; t < LOOP_CHANGES; t++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            int id = PROVISIONED_COUNT + state % (CLICKER_COUNT - PROVISIONED_COUNT);
+            Clicker* clicker = clicker_AcquireOwnership(id);
+            clicker->provisioningInProgress = !clicker->provisioningInProgress;
+            clicker_ReleaseOwnership(clicker);
+            SendEvent(EventType_CLICKER_START_PROVISION, id);
+        }
+        snapshot_Update();
+        usleep(LOOP_SLEEP_US);
+    }
+    return NULL;
+}
+
+static int CompareLatencies(const void* a, const void* b)
+{
+    uint64_t first = *(const uint64_t*) a;
+    uint64_t second = *(const uint64_t*) b;
+    return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+static void BenchGetState(const char* name, void (*getState)(void), const BenchConfig* config)
+{
+    if (config->filter != NULL && strstr(name, config->filter) == NULL) {
+        return;
+    }
+    static uint64_t latencies[REQUEST_COUNT];
+    pthread_t mainLoop;
+    _Running = true;
+    pthread_create(&mainLoop, NULL, MainLoop, NULL);
+    for (int t = 0; t < config->warmups * 10; t++) {
+        getState();
+    }
+    for (int t = 0; t < REQUEST_COUNT; t++) {
+        uint64_t start = bench_GetTimeNs();
+        getState();
+        latencies[t] = bench_GetTimeNs() - start;
+    }
+    _Running = false;
+    pthread_join(mainLoop, NULL);
+
+    qsort(latencies, REQUEST_COUNT, sizeof(latencies[0]), CompareLatencies);
+    char key[64];
+    snprintf(key, sizeof(key), "%s:p50_us", name);
+    bench_ReportValue(key, latencies[REQUEST_COUNT / 2] / 1000.0);
+    snprintf(key, sizeof(key), "%s:p99_us", name);
+    bench_ReportValue(key, latencies[REQUEST_COUNT * 99 / 100] / 1000.0);
+    snprintf(key, sizeof(key), "%s:max_us", name);
+    bench_ReportValue(key, latencies[REQUEST_COUNT - 1] / 1000.0);
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    if (!bench_ParseArgs(&config, argc, argv)) {
+        return 1;
+    }
+
+    clicker_Init();
+    history_Init(NULL, 600, CLICKER_COUNT);
+    snapshot_Init();
+    for (int id = 0; id < CLICKER_COUNT; id++) {
+        SendEvent(EventType_CLICKER_CREATE, id);
+        Clicker* clicker = clicker_AcquireOwnership(id);
+        snprintf(clicker->name, sizeof(clicker->name), "Clicker_%04d", id);
+        clicker_ReleaseOwnership(clicker);
+    }
+    for (int id = 0; id < PROVISIONED_COUNT; id++) {
+        SendEvent(EventType_HISTORY_ADD, id);
+    }
+    snapshot_Update();
+
+    bench_Begin("state", &config);
+    bench_ReportValue("clickers", CLICKER_COUNT);
+    BenchGetState("get_state:rebuild", LegacyGetState, &config);
+    BenchGetState("get_state:snapshot", SnapshotGetState, &config);
+    BenchGetState("get_state:delta", DeltaGetState, &config);
+    bench_End();
+
+    for (int id = 0; id < CLICKER_COUNT; id++) {
+        SendEvent(EventType_CLICKER_DESTROY, id);
+    }
+    snapshot_Shutdown();
+    history_Destroy();
+    clicker_Shutdown();
+    return 0;
+}
@@ -0,0 +1,287 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <libconfig.h>
+#include <glib.h>
+
+#include "autotune.h"
+#include "crypto/aes_backend.h"
+#include "crypto/crypto_config.h"
+#include "crypto/dh_table.h"
+#include "crypto/diffie_hellman_keys_exchanger.h"
+#include "crypto/random.h"
+
+/** Minimal duration of one timed batch, batch size is doubled until it's reached */
+#define MIN_BATCH_TIME_US   (10000)
+/** Fastest of this many batches is taken, so preemption during one of them doesn't matter */
+#define BATCHES             (3)
+/** Blocks encrypted per AES operation, softap payloads are about this long */
+#define AES_BLOCKS          (16)
+/** Wider window is chosen only when it's at least this much faster, it costs memory and startup time */
+#define MIN_GAIN            (0.05)
+
+/**
+ * Windows tried for Diffie-Hellman table, wider ones need over 40 KB table and seconds to compute it on the Ci40.
+ */
+static const int _DhWindows[] = {3, 4, 5, 6};
+
+static AutotuneResult _Result;
+static bool _HasResult = false;
+
+typedef void (*TunedOperation)(void *context);
+
+static double MeasureNsPerOp(TunedOperation operation, void *context)
+{
+    double best = -1;
+    for (int batch = 0; batch < BATCHES; batch++)
+    {
+        guint64 iterations = 1;
+        gint64 elapsed;
+        while (true)
+        {
+            gint64 start = g_get_monotonic_time();
+            for (guint64 t = 0; t < iterations; t++)
+                operation(context);
+
+            elapsed = g_get_monotonic_time() - start;
+            if (elapsed >= MIN_BATCH_TIME_US)
+                break;
+
+            iterations *= 2;
+        }
+        double nsPerOp = elapsed * 1000.0 / iterations;
+        if (best < 0 || nsPerOp < best)
+            best = nsPerOp;
+    }
+    return best;
+}
+
+static void AddMeasurement(const char *name, double nsPerOp)
+{
+    if (_Result.measurementCount >= AUTOTUNE_MAX_MEASUREMENTS)
+        return;
+
+    AutotuneMeasurement *measurement = &_Result.measurements[_Result.measurementCount++];
+    g_strlcpy(measurement->name, name, sizeof(measurement->name));
+    measurement->nsPerOp = nsPerOp;
+    g_debug("Autotune: %s %.0f ns/op", name, nsPerOp);
+}
+
+typedef struct {
+    const AesBackend *backend;
+    AesKey key;
+    uint8_t userKey[AES_KEY_SIZE];
+    uint8_t data[AES_BLOCKS * AES_BLOCK_SIZE];
+} AesContext;
+
+/**
+ * Key is expanded every time, as every clicker session has its own.
+ */
+static void AesOperation(void *context)
+{
+    AesContext *ctx = context;
+    aes_SetKey(&ctx->key, ctx->backend, ctx->userKey);
+    aes_Encrypt(&ctx->key, ctx->data, ctx->data, AES_BLOCKS);
+}
+
+static void TuneAes(void)
+{
+    AesContext ctx;
+    double best = -1;
+    const AesBackend *backend;
+
+    rng_GetBytes(ctx.userKey, sizeof(ctx.userKey));
+    rng_GetBytes(ctx.data, sizeof(ctx.data));
+    for (int t = 0; (backend = aes_GetBackendAt(t)) != NULL; t++)
+    {
+        //same candidates as "auto", so tuning never gives up constant time
+        if (!backend->constantTime || aes_FindBackend(backend->name) == NULL)
+            continue;
+
+        char name[AUTOTUNE_NAME_SIZE];
+        ctx.backend = backend;
+        double nsPerOp = MeasureNsPerOp(AesOperation, &ctx);
+        snprintf(name, sizeof(name), "aes:%s", backend->name);
+        AddMeasurement(name, nsPerOp);
+        if (best < 0 || nsPerOp < best)
+        {
+            best = nsPerOp;
+            g_strlcpy(_Result.aesBackend, backend->name, sizeof(_Result.aesBackend));
+        }
+    }
+    aes_WipeKey(&ctx.key);
+}
+
+static void DhOperation(void *context)
+{
+    unsigned char *key = dh_GenerateExchangeData(context);
+    free(key);
+}
+
+static void TuneDh(void)
+{
+    double best = -1;
+    const DhTable *installed = dh_GetFixedBaseTable();
+    DiffieHellmanKeysExchanger *exchanger = dh_NewKeyExchanger((char*)g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE,
+            rng_GetBytes);
+
+    _Result.dhWindowBits = DH_TABLE_DEFAULT_WINDOW_BITS;
+    for (int t = 0; t < G_N_ELEMENTS(_DhWindows); t++)
+    {
+        char name[AUTOTUNE_NAME_SIZE];
+        DhTable *table = dh_BuildTable(g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, _DhWindows[t]);
+        dh_SetFixedBaseTable(table);
+        double nsPerOp = MeasureNsPerOp(DhOperation, exchanger);
+        dh_SetFixedBaseTable(installed);
+        dh_ReleaseTable(&table);
+
+        snprintf(name, sizeof(name), "dh_window:%d", _DhWindows[t]);
+        AddMeasurement(name, nsPerOp);
+        if (best < 0 || nsPerOp < best * (1 - MIN_GAIN))
+        {
+            best = nsPerOp;
+            _Result.dhWindowBits = _DhWindows[t];
+        }
+    }
+    dh_Release(&exchanger);
+}
+
+/**
+ * Model name from /proc/cpuinfo ("model name" on x86, "cpu model" on MIPS), machine name if there is none.
+ */
+static void ReadCpuName(char *cpu, size_t size)
+{
+    char line[256];
+    struct utsname system;
+
+    cpu[0] = '\0';
+    FILE *cpuInfo = fopen("/proc/cpuinfo", "r");
+    if (cpuInfo != NULL)
+    {
+        while (cpu[0] == '\0' && fgets(line, sizeof(line), cpuInfo) != NULL)
+        {
+            char *separator = strchr(line, ':');
+            if (separator == NULL)
+                continue;
+
+            *separator = '\0';
+            g_strstrip(line);
+            if (strcmp(line, "model name") == 0 || strcmp(line, "cpu model") == 0)
+                g_strlcpy(cpu, g_strstrip(separator + 1), size);
+        }
+        fclose(cpuInfo);
+    }
+    if (cpu[0] == '\0' && uname(&system) == 0)
+        g_strlcpy(cpu, system.machine, size);
+
+    //value is written to cache file as libconfig string
+    g_strdelimit(cpu, "\"\\", '_');
+}
+
+static bool LoadCache(const char *cachePath)
+{
+    config_t cache;
+    const char *cpu = NULL;
+    const char *aesBackend = NULL;
+    int version = 0;
+    int dhWindowBits = 0;
+    bool result = false;
+
+    config_init(&cache);
+    if (config_read_file(&cache, cachePath) &&
+        config_lookup_int(&cache, "AUTOTUNE_VERSION", &version) && version == AUTOTUNE_VERSION &&
+        config_lookup_string(&cache, "CPU", &cpu) && strcmp(cpu, _Result.cpu) == 0 &&
+        config_lookup_string(&cache, "AES_BACKEND", &aesBackend) && aes_FindBackend(aesBackend) != NULL &&
+        config_lookup_int(&cache, "DH_TABLE_WINDOW_BITS", &dhWindowBits) &&
+        dhWindowBits >= DH_TABLE_MIN_WINDOW_BITS && dhWindowBits <= DH_TABLE_MAX_WINDOW_BITS)
+    {
+        g_strlcpy(_Result.aesBackend, aesBackend, sizeof(_Result.aesBackend));
+        _Result.dhWindowBits = dhWindowBits;
+        result = true;
+    }
+    config_destroy(&cache);
+    return result;
+}
+
+static void SaveCache(const char *cachePath)
+{
+    GError *error = NULL;
+    gchar *contents = g_strdup_printf(
+            "#Generated by provisioning daemon autotuner, delete this file to tune again\n"
+            "AUTOTUNE_VERSION=%d\n"
+            "CPU=\"%s\"\n"
+            "AES_BACKEND=\"%s\"\n"
+            "DH_TABLE_WINDOW_BITS=%d\n",
+            AUTOTUNE_VERSION, _Result.cpu, _Result.aesBackend, _Result.dhWindowBits);
+
+    if (!g_file_set_contents(cachePath, contents, -1, &error))
+    {
+        g_warning("Autotune: unable to save %s, tuning will be repeated on next start: %s", cachePath, error->message);
+        g_error_free(error);
+    }
+    g_free(contents);
+}
+
+const AutotuneResult* autotune_Init(const char *cachePath)
+{
+    gint64 start = g_get_monotonic_time();
+
+    memset(&_Result, 0, sizeof(_Result));
+    ReadCpuName(_Result.cpu, sizeof(_Result.cpu));
+    if (cachePath != NULL && LoadCache(cachePath))
+    {
+        _Result.source = AutotuneSource_CACHE;
+    }
+    else
+    {
+        g_message("Autotune: measuring crypto variants on %s", _Result.cpu);
+        _Result.source = AutotuneSource_MEASURED;
+        TuneAes();
+        TuneDh();
+        if (cachePath != NULL)
+            SaveCache(cachePath);
+    }
+    _Result.durationUs = g_get_monotonic_time() - start;
+    _HasResult = true;
+
+    g_message("Autotune: %s AES backend, %d bit Diffie-Hellman window (%s in %" G_GINT64_FORMAT " ms)",
+            _Result.aesBackend, _Result.dhWindowBits,
+            _Result.source == AutotuneSource_CACHE ? "cached" : "measured", _Result.durationUs / 1000);
+    return &_Result;
+}
+
+const AutotuneResult* autotune_GetResult(void)
+{
+    return _HasResult ? &_Result : NULL;
+}
@@ -0,0 +1,78 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __AUTOTUNE_H__
+#define __AUTOTUNE_H__
+
+#include <stdbool.h>
+#include <glib.h>
+
+#define AUTOTUNE_VERSION            (1)
+#define AUTOTUNE_NAME_SIZE          (32)
+#define AUTOTUNE_CPU_SIZE           (128)
+#define AUTOTUNE_MAX_MEASUREMENTS   (16)
+
+typedef enum {
+    AutotuneSource_CACHE,       /**< choice was made on earlier start on this CPU */
+    AutotuneSource_MEASURED     /**< microbenchmarks were run on this start */
+} AutotuneSource;
+
+typedef struct {
+    char name[AUTOTUNE_NAME_SIZE];
+    double nsPerOp;
+} AutotuneMeasurement;
+
+/**
+ * @brief Crypto configuration picked for this CPU.
+ */
+typedef struct {
+    AutotuneSource source;
+    char cpu[AUTOTUNE_CPU_SIZE];            /**< CPU the choice was made on, cache is dropped when it changes */
+    char aesBackend[AUTOTUNE_NAME_SIZE];    /**< fastest constant time AES backend */
+    int dhWindowBits;                       /**< window of Diffie-Hellman fixed-base table */
+    gint64 durationUs;                      /**< time spent by autotune_Init */
+    int measurementCount;                   /**< 0 when loaded from cache */
+    AutotuneMeasurement measurements[AUTOTUNE_MAX_MEASUREMENTS];
+} AutotuneResult;
+
+/**
+ * @brief Load choice cached in cachePath if it was made by this version on this CPU, otherwise time available
+ * variants with short microbenchmarks and save the choice to cachePath. Takes about a second on x86, more on the Ci40,
+ * so it's done once per board.
+ * @return result which stays valid until exit
+ */
+const AutotuneResult* autotune_Init(const char *cachePath);
+
+/**
+ * @brief Result of autotune_Init, NULL if it wasn't called.
+ */
+const AutotuneResult* autotune_GetResult(void);
+
+#endif /* __AUTOTUNE_H__ */
@@ -32,151 +32,296 @@
 #include "utils.h"
 #include "commands.h"
 #include "crypto/crypto_config.h"
+#include "crypto/random.h"
+#include "crypto/wipe.h"
+#include "epoch.h"
 #include <stdlib.h>
 #include <time.h>
 #include <stdbool.h>
 #include <glib.h>
 
+#define MIN_TABLE_CAPACITY  (16)
+
 /**
- * Keeps a HEAD for the list of connected clickers
+ * Open addressing hash table of connected clickers keyed by clickerID. Readers walk it without any lock inside
+ * epoch_Enter / epoch_Leave, writers replace slots under _Mutex and retire unlinked clickers and tables.
  */
-static GQueue* _ClickersQueue = NULL;
+typedef struct {
+    guint capacity;         /**< power of 2 */
+    guint shift;            /**< 32 - log2(capacity), hash is taken from the top bits */
+    guint used;             /**< clickers and tombstones, used to decide about rebuilding */
+    Clicker *slots[];       /**< NULL - empty, _Tombstone - removed clicker */
+} ClickerTable;
+
+static ClickerTable *_Table = NULL;
+
+/** Marks slot of removed clicker, probing continues past it */
+static Clicker _TombstoneClicker;
+#define TOMBSTONE (&_TombstoneClicker)
 
-/** All operations are sync on this mutex */
+static gint _ClickersCount = 0;
+
+/** Writers (create, remove, destroy) are sync on this mutex, lookups don't take it */
 static GMutex _Mutex;
 
 static void Destroy(Clicker *clicker) {
-    dh_Release(&clicker->keysExchanger);
-    G_FREE_AND_NULL(clicker->localKey);
-    G_FREE_AND_NULL(clicker->remoteKey);
-    G_FREE_AND_NULL(clicker->sharedKey);
-    G_FREE_AND_NULL(clicker->psk);
-    G_FREE_AND_NULL(clicker->identity);
-    G_FREE_AND_NULL(clicker->name);
-    g_mutex_clear(&clicker->ownershipLock);
+    dh_ClearKeyExchanger(&clicker->keysExchanger);
+    if (clicker->sharedKeyLength > 0) {
+        softap_WipeKey(&clicker->sharedKeySchedule);
+    }
+    crypto_Wipe(clicker->sharedKey, sizeof(clicker->sharedKey));
+    crypto_Wipe(clicker->psk, sizeof(clicker->psk));
+    crypto_Wipe(clicker->identity, sizeof(clicker->identity));
+    g_rw_lock_clear(&clicker->ownershipLock);
     G_FREE_AND_NULL(clicker);
 }
 
-static void ReleaseClickerIfNotOwned(Clicker* clicker) {
+static void DestroyClicker(void *object) {
+    Destroy(object);
+}
+
+static guint HashClickerId(const ClickerTable *table, int id) {
+    //Fibonacci hashing, consecutive ids land in distant slots
+    return ((guint32)id * 2654435769u) >> table->shift;
+}
+
+static ClickerTable *CreateTable(guint capacity) {
+    ClickerTable *table = g_malloc0(sizeof(ClickerTable) + capacity * sizeof(Clicker *));
+    table->capacity = capacity;
+    table->shift = 32;
+    for (guint t = capacity; t > 1; t >>= 1)
+        table->shift--;
+
+    return table;
+}
+
+static guint FindSlot(const ClickerTable *table, int id) {
+    //caller holds _Mutex or is inside epoch section, returns index of clicker or of empty slot ending its chain
+    guint mask = table->capacity - 1;
+    guint index = HashClickerId(table, id);
+    while (true) {
+        Clicker *clicker = g_atomic_pointer_get(&table->slots[index]);
+        if (clicker == NULL || (clicker != TOMBSTONE && clicker->clickerID == id)) {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+static void InsertIntoTable(ClickerTable *table, Clicker *clicker) {
+    //NOTE: Should be called in critical section only!
+    guint mask = table->capacity - 1;
+    guint index = HashClickerId(table, clicker->clickerID);
+    while (true) {
+        Clicker *slot = table->slots[index];
+        if (slot == NULL) {
+            table->used++;
+            break;
+        }
+        if (slot == TOMBSTONE) {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+    g_atomic_pointer_set(&table->slots[index], clicker);
+}
+
+/**
+ * Make room for one more clicker, table is rebuilt without tombstones (and grown if needed) when it's 3/4 used.
+ */
+static void ReserveTableSlot(void) {
     //NOTE: Should be called in critical section only!
-    if (clicker->ownershipsCount > 0) {
+    if ((_Table->used + 1) * 4 <= _Table->capacity * 3) {
         return;
     }
-    //check for logic error, if ownershipCount == 0, this clicker can't be in clickersQueue
-    if (g_queue_remove(_ClickersQueue, clicker) == TRUE) {
-        g_critical("Internal error: Clicker with id:%d has ownershipCount = 0, but it's still in queue! Forced remove",
-                clicker->clickerID);
+    guint capacity = _Table->capacity;
+    while ((g_atomic_int_get(&_ClickersCount) + 1) * 2 > capacity) {
+        capacity *= 2;
     }
-    Destroy(clicker);
+    ClickerTable *table = CreateTable(capacity);
+    for (guint t = 0; t < _Table->capacity; t++) {
+        Clicker *clicker = _Table->slots[t];
+        if (clicker != NULL && clicker != TOMBSTONE) {
+            InsertIntoTable(table, clicker);
+        }
+    }
+    ClickerTable *old = _Table;
+    g_atomic_pointer_set(&_Table, table);
+    epoch_Retire(old, g_free);
 }
 
-gint CompareClickerById(gpointer a, gpointer b) {
-    Clicker* clicker1 = (Clicker*)a;
-    Clicker* clicker2 = (Clicker*)b;
-    return clicker1->clickerID - clicker2->clickerID;
+static bool RemoveFromTable(Clicker *clicker) {
+    //NOTE: Should be called in critical section only!
+    guint mask = _Table->capacity - 1;
+    guint index = HashClickerId(_Table, clicker->clickerID);
+    for (Clicker *slot; (slot = _Table->slots[index]) != NULL; index = (index + 1) & mask) {
+        if (slot == clicker) {
+            g_atomic_pointer_set(&_Table->slots[index], TOMBSTONE);
+            g_atomic_int_add(&_ClickersCount, -1);
+            return true;
+        }
+    }
+    return false;
 }
 
-static Clicker *InnerGetClickerByID(int id, bool doLock)
-{
-    if (doLock)
-        g_mutex_lock(&_Mutex);
+static void ReleaseClickerIfNotOwned(Clicker* clicker) {
+    //NOTE: Should be called in critical section only!
+    if (g_atomic_int_get(&clicker->ownershipsCount) > 0) {
+        return;
+    }
+    //check for logic error, if ownershipCount == 0, this clicker can't be in clickers table
+    if (RemoveFromTable(clicker) == TRUE) {
+        g_critical("Internal error: Clicker with id:%d has ownershipCount = 0, but it's still in table! Forced remove",
+                clicker->clickerID);
+    }
+    //lock-free readers may still look at it, so it's destroyed after they are done
+    epoch_Retire(clicker, DestroyClicker);
+}
 
-    Clicker tmp;
-    tmp.clickerID = id;
-    GList* found = g_queue_find_custom(_ClickersQueue, &tmp, (GCompareFunc)CompareClickerById);
-    Clicker* result = found != NULL ? found->data : NULL;
+static Clicker *LookupClicker(int id) {
+    //caller holds _Mutex or is inside epoch section
+    ClickerTable *table = g_atomic_pointer_get(&_Table);
+    return g_atomic_pointer_get(&table->slots[FindSlot(table, id)]);
+}
 
-    if (doLock)
-        g_mutex_unlock(&_Mutex);
-    return result;
+/**
+ * Take ownership unless the last one has just been released, clicker is being destroyed then.
+ */
+static bool TryIncrementOwnership(Clicker *clicker) {
+    gint count;
+    do {
+        count = g_atomic_int_get(&clicker->ownershipsCount);
+        if (count == 0) {
+            return false;
+        }
+    } while (!g_atomic_int_compare_and_exchange(&clicker->ownershipsCount, count, count + 1));
+    return true;
 }
 
 void CreateNewClicker(int id)
 {
+    //single zeroed allocation, key and credential buffers are inline and empty until their lengths are set
     Clicker *newClicker = g_new0(Clicker, 1);
 
     newClicker->clickerID = id;
     newClicker->taskInProgress = false;
-    newClicker->keysExchanger = dh_NewKeyExchanger((char*)g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, GenerateRandomX);
-    newClicker->localKey = NULL;
-    newClicker->remoteKey = NULL;
-    newClicker->sharedKey = NULL;
-    newClicker->psk = NULL;
-    newClicker->pskLen = 0;
-    newClicker->identity = NULL;
-    newClicker->ownershipsCount = 0;
+    dh_InitKeyExchanger(&newClicker->keysExchanger, (char*)g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, rng_GetBytes);
+    newClicker->keyExchange = KeyExchange_DH;
+    //owned by the table until RemoveFromCollection
+    newClicker->ownershipsCount = 1;
     newClicker->provisionTime = 0;
     newClicker->error = 0;
     newClicker->provisioningInProgress = false;
-    newClicker->name = g_malloc0(COMMAND_ENDPOINT_NAME_LENGTH);
-    g_mutex_init(&newClicker->ownershipLock);
+    g_rw_lock_init(&newClicker->ownershipLock);
 
     g_mutex_lock(&_Mutex);
-    g_queue_push_tail(_ClickersQueue, newClicker);
-    newClicker->ownershipsCount ++;
+    Clicker *old = LookupClicker(id);
+    if (old != NULL) {
+        g_critical("Internal error: Clicker with id:%d already exists, replacing it", id);
+        RemoveFromTable(old);
+        if (g_atomic_int_dec_and_test(&old->ownershipsCount)) {
+            ReleaseClickerIfNotOwned(old);
+        }
+    }
+    ReserveTableSlot();
+    InsertIntoTable(_Table, newClicker);
+    g_atomic_int_inc(&_ClickersCount);
     g_mutex_unlock(&_Mutex);
 }
 
 void RemoveFromCollection(int clickerID)
 {
-    Clicker* clicker = InnerGetClickerByID(clickerID, true);
+    g_debug("clicker_Release start");
+    g_mutex_lock(&_Mutex);
+    Clicker* clicker = LookupClicker(clickerID);
     if (clicker == NULL) {
+        g_mutex_unlock(&_Mutex);
         return;
     }
-    g_debug("clicker_Release start");
-    g_mutex_lock(&_Mutex);
 
-    if (g_queue_remove(_ClickersQueue, clicker) == TRUE) {
-        clicker->ownershipsCount --;
+    if (RemoveFromTable(clicker) == TRUE) {
+        if (g_atomic_int_dec_and_test(&clicker->ownershipsCount)) {
+            ReleaseClickerIfNotOwned(clicker);
+        }
     } else {
         g_critical("Internal error: Tried to remove clicker which is not a part of collection!");
     }
-
-    ReleaseClickerIfNotOwned(clicker);
     g_mutex_unlock(&_Mutex);
 }
 
 void clicker_Init(void)
 {
-    _ClickersQueue = g_queue_new();
     g_mutex_init(&_Mutex);
+    _Table = CreateTable(MIN_TABLE_CAPACITY);
+    _ClickersCount = 0;
 }
 
 void clicker_Shutdown(void) {
-    g_queue_free(_ClickersQueue);
+    g_mutex_lock(&_Mutex);
+    epoch_Retire(_Table, g_free);
+    _Table = NULL;
+    epoch_ReclaimAll();
+    g_mutex_unlock(&_Mutex);
     g_mutex_clear(&_Mutex);
-    _ClickersQueue = NULL;
 }
 
 unsigned int clicker_GetClickersCount(void)
 {
-    g_mutex_lock(&_Mutex);
-    int result = g_queue_get_length(_ClickersQueue);
-    g_mutex_unlock(&_Mutex);
-    return result;
+    return g_atomic_int_get(&_ClickersCount);
+}
+
+/**
+ * Find clicker and keep it from being destroyed, without locking it.
+ */
+static Clicker *Reference(int clickerID)
+{
+    EpochReader *reader = epoch_Enter();
+    Clicker *clicker = LookupClicker(clickerID);
+    if (clicker != NULL && !TryIncrementOwnership(clicker))
+        clicker = NULL;
+    epoch_Leave(reader);
+    return clicker;
+}
+
+static void Unreference(Clicker *clicker)
+{
+    if (g_atomic_int_dec_and_test(&clicker->ownershipsCount)) {
+        g_mutex_lock(&_Mutex);
+        ReleaseClickerIfNotOwned(clicker);
+        g_mutex_unlock(&_Mutex);
+    }
 }
 
 Clicker *clicker_AcquireOwnership(int clickerID)
 {
-    g_mutex_lock(&_Mutex);
-    Clicker *clicker = InnerGetClickerByID(clickerID, false);
+    Clicker *clicker = Reference(clickerID);
     if (clicker != NULL)
-        clicker->ownershipsCount++;
-    g_mutex_unlock(&_Mutex);
+        g_rw_lock_writer_lock(&clicker->ownershipLock);
 
+    return clicker;
+}
+
+void clicker_ReleaseOwnership(Clicker *clicker)
+{
+    g_rw_lock_writer_unlock(&clicker->ownershipLock);
+    Unreference(clicker);
+}
+
+const Clicker *clicker_AcquireReadOnly(int clickerID)
+{
+    Clicker *clicker = Reference(clickerID);
     if (clicker != NULL)
-        g_mutex_lock(&clicker->ownershipLock);
+        g_rw_lock_reader_lock(&clicker->ownershipLock);
 
     return clicker;
 }
 
-void clicker_ReleaseOwnership(Clicker *clicker)
+void clicker_ReleaseReadOnly(const Clicker *clicker)
 {
-    g_mutex_unlock(&clicker->ownershipLock);
-    g_mutex_lock(&_Mutex);
-    clicker->ownershipsCount--;
-    ReleaseClickerIfNotOwned(clicker);
-    g_mutex_unlock(&_Mutex);
+    //lock and reference count are the only parts changed on behalf of a reader
+    Clicker *owned = (Clicker *)clicker;
+    g_rw_lock_reader_unlock(&owned->ownershipLock);
+    Unreference(owned);
 }
 
 bool clicker_ConsumeEvent(Event* event) {
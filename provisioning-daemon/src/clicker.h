@@ -37,6 +37,9 @@
 #define __CLICKER_H__
 
 #include "crypto/diffie_hellman_keys_exchanger.h"
+#include "crypto/encoder.h"
+#include "crypto/crypto_config.h"
+#include "commands.h"
 #include <unistd.h>
 #include <semaphore.h>
 #include <stdbool.h>
@@ -44,33 +47,46 @@
 #include "event.h"
 
 /**
- * @brief Represents a single clicker
+ * @brief Key exchange used with a clicker.
  */
-typedef struct Clicker
+typedef enum
 {
-    struct Clicker *next;               /**< pointer to next element of list */
-    char* name;                         /**< Name which will be given to clicker after provision is done */
-    int clickerID;                      /**< id of clicker, must be unique. */
-
-    uint8_t *localKey;                  /**< Exchange key sent to remote clicker */
-    int localKeyLength;                 /**< Length of local key */
-    uint8_t *remoteKey;                 /**< Exchange key received from remote clicker */
-    int remoteKeyLength;                /**< Length of remote key */
-    uint8_t *sharedKey;                 /**< shared key used to encrypt communication with remote clicker */
-    int sharedKeyLength;                /**< Length of shared key */
-    uint8_t *psk;                       /**< psk received from device server */
-    uint8_t pskLen;                     /**< Length of psk key */
-    uint8_t *identity;                  /**< identity received from device server */
-    size_t identityLen;                /**< Length of identity field */
-    DiffieHellmanKeysExchanger *keysExchanger; /**< struct used to exchange crypto keys between provisioning daemon and remote clicker */
+    KeyExchange_DH = 0,                 /**< legacy Diffie-Hellman, used by old clicker firmware */
+    KeyExchange_X25519                  /**< offered by clicker with KEY_CAPABILITY_X25519 */
+} KeyExchange;
 
-    uint8_t ownershipsCount;
-    GMutex ownershipLock;
+/** Longest KEY command payload, X25519 offer is longer than Diffie-Hellman key */
+#define CLICKER_MAX_KEY_LENGTH \
+    (KEY_X25519_PAYLOAD_SIZE > P_MODULE_LENGTH ? KEY_X25519_PAYLOAD_SIZE : P_MODULE_LENGTH)
 
+/**
+ * @brief Represents a single clicker. Keys, name and credentials are kept inline, so a clicker is a single
+ * allocation. Fields read for every clicker by getState and controls come first.
+ */
+typedef struct Clicker
+{
+    int clickerID;                      /**< id of clicker, must be unique. */
+    gint ownershipsCount;               /**< atomic, 1 is held by clickers table until clicker is removed */
     bool taskInProgress;
     bool provisioningInProgress;        /**< true - if provisioning is taking place on this clicker, otherwise false */
-    gint64 provisionTime;        /**< unix timestamp telling when provisioning process of this clicker has finished. 0 of provisioning is not finished yet. */
+    KeyExchange keyExchange;            /**< negotiated key exchange, DH until clicker offers something better */
     int error;
+    gint64 provisionTime;        /**< unix timestamp telling when provisioning process of this clicker has finished. 0 of provisioning is not finished yet. */
+    GRWLock ownershipLock;              /**< held exclusively by clicker_AcquireOwnership, shared by clicker_AcquireReadOnly */
+    char name[COMMAND_ENDPOINT_NAME_LENGTH]; /**< Name which will be given to clicker after provision is done */
+
+    uint8_t localKeyLength;             /**< Length of local key, 0 until it's generated */
+    uint8_t remoteKeyLength;            /**< Length of remote key, 0 until it's received */
+    uint8_t sharedKeyLength;            /**< Length of shared key, 0 until it's generated */
+    uint8_t pskLen;                     /**< Length of psk key, 0 until it's received */
+    uint8_t identityLen;                /**< Length of identity field */
+    uint8_t localKey[CLICKER_MAX_KEY_LENGTH];  /**< Exchange key sent to remote clicker */
+    uint8_t remoteKey[CLICKER_MAX_KEY_LENGTH]; /**< Exchange key received from remote clicker */
+    uint8_t sharedKey[AES_KEY_SIZE];    /**< shared key used to encrypt communication with remote clicker */
+    uint8_t psk[COMMAND_PSK_LENGTH];    /**< psk received from device server */
+    uint8_t identity[COMMAND_IDENTITY_LENGTH + 1]; /**< identity received from device server, null terminated */
+    SoftapKey sharedKeySchedule;        /**< shared key expanded for encryption once per session, valid if sharedKeyLength > 0 */
+    DiffieHellmanKeysExchanger keysExchanger; /**< struct used to exchange crypto keys between provisioning daemon and remote clicker */
 } Clicker;
 
 /**
@@ -81,7 +97,8 @@ void clicker_Init(void);
 void clicker_Shutdown(void);
 
 /**
- * @brief Mark clicker with specified ID as being used so it won't get purged until ownership is released.
+ * @brief Mark clicker with specified ID as being used so it won't get purged until ownership is released. Access
+ * is exclusive, other owners and readers wait until it's released.
  * @param[in] clickerID id of clicker
  * @return clicker or NULL if no clicker with specified ID exists in the list of connected clickers
  */
@@ -93,6 +110,20 @@ Clicker *clicker_AcquireOwnership(int clickerID);
  */
 void clicker_ReleaseOwnership(Clicker *clicker);
 
+/**
+ * @brief Like clicker_AcquireOwnership, but for inspecting clicker only. Any number of readers can hold the same
+ * clicker at once, they only wait for exclusive owner.
+ * @param[in] clickerID id of clicker
+ * @return clicker or NULL if no clicker with specified ID exists in the list of connected clickers
+ */
+const Clicker *clicker_AcquireReadOnly(int clickerID);
+
+/**
+ * @brief Release clicker acquired with clicker_AcquireReadOnly.
+ * @param[in] clicker clicker
+ */
+void clicker_ReleaseReadOnly(const Clicker *clicker);
+
 /**
  * @brief check if given event is clicker module relevant. If yes then proper handling is executed.
  * @param[in] event Event to be consumed.
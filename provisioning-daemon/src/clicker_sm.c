@@ -30,9 +30,13 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 #include "clicker_sm.h"
 #include "crypto/crypto_config.h"
 #include "crypto/encoder.h"
+#include "crypto/random.h"
+#include "crypto/wipe.h"
+#include "crypto/x25519.h"
 #include "ubus_agent.h"
 #include "connection_manager.h"
 #include "utils.h"
@@ -48,14 +52,159 @@ static void HandleRemoteKeyNetworkCommand(int clickerId, uint8_t *data)
         return;
     }
     uint8_t dataLength = data[0];
-    G_FREE_AND_NULL(clicker->remoteKey);
-    clicker->remoteKey = g_malloc(dataLength);
-    clicker->remoteKeyLength = dataLength;
+    if (dataLength > sizeof(clicker->remoteKey)) {
+        g_warning("Exchange key of clicker %d is too long (%d bytes), ignoring it", clickerId, dataLength);
+        clicker_ReleaseOwnership(clicker);
+        return;
+    }
     memcpy(clicker->remoteKey, &data[1], dataLength);
-    clicker_ReleaseOwnership(clicker);
+    clicker->remoteKeyLength = dataLength;
 
     g_message("Received exchange key from clicker : %d", clicker->clickerID);
     PRINT_BYTES(clicker->remoteKey, clicker->remoteKeyLength);
+    clicker_ReleaseOwnership(clicker);
+}
+
+/**
+ * Ids of clickers which key exchange is computed step by step in clicker_sm_Update.
+ */
+static GQueue _PendingExchanges = G_QUEUE_INIT;
+
+static void StartKeyExchange(Clicker* clicker);
+
+static void FinishLocalClickerKey(Clicker* clicker)
+{
+    DiffieHellmanKeysExchanger *keysExchanger = &clicker->keysExchanger;
+    dh_TakeExchangeResultInto(keysExchanger, clicker->localKey);
+    clicker->localKeyLength = keysExchanger->pModuleLength;
+
+    g_message("Generated local Key");
+    PRINT_BYTES(clicker->localKey, clicker->localKeyLength);
+    g_message("Sending local Key to clicker with id : %d", clicker->clickerID);
+
+    NetworkDataPack* netData = con_BuildNetworkDataPack(clicker->clickerID, NetworkCommand_KEY, clicker->localKey,
+            clicker->localKeyLength, true);
+    event_PushEventWithPtr(EventType_CONNECTION_SEND_COMMAND, netData, true);
+
+    if (clicker->remoteKeyLength > 0 && clicker->keyExchange == KeyExchange_DH) {
+        //remote key came before local one was ready, continue with shared key
+        if (dh_BeginCompleteExchangeData(keysExchanger, clicker->remoteKey, clicker->remoteKeyLength)) {
+            StartKeyExchange(clicker);
+        }
+    }
+}
+
+/**
+ * Called once clicker->sharedKey (AES_KEY_SIZE bytes) is filled in.
+ */
+static void SetSharedClickerKey(Clicker* clicker)
+{
+    //expand key once, every payload sent in this session is encrypted with it
+    if (clicker->sharedKeyLength > 0) {
+        softap_WipeKey(&clicker->sharedKeySchedule);
+    }
+    clicker->sharedKeyLength = AES_KEY_SIZE;
+    softap_SetKey(&clicker->sharedKeySchedule, clicker->sharedKey);
+
+    g_message("Generated Shared Key");
+    PRINT_BYTES(clicker->sharedKey, clicker->sharedKeyLength);
+
+    event_PushEventWithInt(EventType_TRY_TO_SEND_PSK_TO_CLICKER, clicker->clickerID);
+}
+
+static void FinishSharedClickerKey(Clicker* clicker)
+{
+    //Diffie-Hellman result is as long as module, which is the AES key size
+    G_STATIC_ASSERT(P_MODULE_LENGTH == AES_KEY_SIZE);
+    if (dh_TakeExchangeResultInto(&clicker->keysExchanger, clicker->sharedKey)) {
+        SetSharedClickerKey(clicker);
+    }
+}
+
+static void FinishKeyExchange(Clicker* clicker)
+{
+    g_debug("Key exchange of clicker %d finished, worst step took %u us", clicker->clickerID, dh_GetWorstStepTime());
+    switch (clicker->keysExchanger.pending) {
+        case DhExchange_GENERATE:
+            FinishLocalClickerKey(clicker);
+            break;
+
+        case DhExchange_COMPLETE:
+            FinishSharedClickerKey(clicker);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void StartKeyExchange(Clicker* clicker)
+{
+    if (_PDConfig.dhStepBudget == 0) {
+        while (dh_StepExchange(&clicker->keysExchanger, UINT_MAX) == DhStepResult_IN_PROGRESS)
+            ;
+        FinishKeyExchange(clicker);
+    } else {
+        g_queue_push_tail(&_PendingExchanges, GINT_TO_POINTER(clicker->clickerID));
+    }
+}
+
+static bool IsX25519Offer(int clickerId)
+{
+    const Clicker *clicker = clicker_AcquireReadOnly(clickerId);
+    if (clicker == NULL) {
+        return false;
+    }
+    bool result = clicker->remoteKeyLength == KEY_X25519_PAYLOAD_SIZE &&
+            (clicker->remoteKey[0] & KEY_CAPABILITY_X25519) != 0;
+    clicker_ReleaseReadOnly(clicker);
+    return result;
+}
+
+/**
+ * Answer X25519 offer with own public key and derive shared key right away, a single scalar multiplication is cheap
+ * enough to not need time slicing like Diffie-Hellman does.
+ */
+static void X25519KeyExchange(int clickerId)
+{
+    Clicker *clicker = clicker_AcquireOwnership(clickerId);
+    if (clicker == NULL) {
+        g_critical("X25519KeyExchange: Can't acquire clicker with id:%d, this is probably internal error", clickerId);
+        return;
+    }
+
+    //Diffie-Hellman key might have been sent already, clicker which offered X25519 ignores it
+    dh_CancelExchange(&clicker->keysExchanger);
+    clicker->keyExchange = KeyExchange_X25519;
+
+    uint8_t privateKey[X25519_KEY_SIZE];
+    uint8_t localKey[KEY_X25519_PAYLOAD_SIZE];
+    uint8_t sharedKey[AES_KEY_SIZE];
+    bool valid = rng_GetBytes(privateKey, sizeof(privateKey));
+    if (valid) {
+        localKey[0] = KEY_CAPABILITY_X25519;
+        x25519_PublicKey(localKey + 1, privateKey);
+        valid = x25519_DeriveKey(sharedKey, AES_KEY_SIZE, privateKey, clicker->remoteKey + 1, localKey + 1, false);
+    }
+    crypto_Wipe(privateKey, sizeof(privateKey));
+    if (!valid) {
+        g_critical("X25519KeyExchange: Can't generate shared key for clicker with id:%d", clickerId);
+        crypto_Wipe(sharedKey, sizeof(sharedKey));
+        clicker_ReleaseOwnership(clicker);
+        return;
+    }
+
+    memcpy(clicker->localKey, localKey, sizeof(localKey));
+    clicker->localKeyLength = sizeof(localKey);
+    g_message("Sending X25519 key to clicker with id : %d", clicker->clickerID);
+    NetworkDataPack* netData = con_BuildNetworkDataPack(clicker->clickerID, NetworkCommand_KEY, clicker->localKey,
+            clicker->localKeyLength, true);
+    event_PushEventWithPtr(EventType_CONNECTION_SEND_COMMAND, netData, true);
+
+    memcpy(clicker->sharedKey, sharedKey, sizeof(sharedKey));
+    crypto_Wipe(sharedKey, sizeof(sharedKey));
+    SetSharedClickerKey(clicker);
+    clicker_ReleaseOwnership(clicker);
 }
 
 static void GenerateSharedClickerKey(int clickerId)
@@ -67,15 +216,18 @@ static void GenerateSharedClickerKey(int clickerId)
         return;
     }
 
-    clicker->sharedKey = dh_CompleteExchangeData(clicker->keysExchanger, clicker->remoteKey, clicker->remoteKeyLength);
-    clicker->sharedKeyLength = clicker->keysExchanger->pModuleLength;
-
-    g_message("Generated Shared Key");
-    PRINT_BYTES(clicker->sharedKey, clicker->sharedKeyLength);
+    if (clicker->keysExchanger.pending == DhExchange_GENERATE) {
+        g_message("Local key of clicker %d is not ready yet, shared key will be generated after it", clickerId);
+    } else if (clicker->keysExchanger.pending == DhExchange_COMPLETE) {
+        //clicker id is in _PendingExchanges already, restarting would queue it second time
+        g_message("Shared key of clicker %d is being generated already, repeated key ignored", clickerId);
+    } else if (dh_BeginCompleteExchangeData(&clicker->keysExchanger, clicker->remoteKey, clicker->remoteKeyLength)) {
+        StartKeyExchange(clicker);
+    } else {
+        g_critical("GenerateSharedClickerKey: Can't start key exchange for clicker with id:%d", clickerId);
+    }
 
     clicker_ReleaseOwnership(clicker);
-
-    event_PushEventWithInt(EventType_TRY_TO_SEND_PSK_TO_CLICKER, clickerId);
 }
 
 void TryToSendPsk(int clickerId)
@@ -86,7 +238,7 @@ void TryToSendPsk(int clickerId)
         return;
     }
 
-    if (clicker->sharedKey != NULL && clicker->psk != NULL)
+    if (clicker->sharedKeyLength > 0 && clicker->pskLen > 0)
     {
         pd_DeviceServerConfig _DeviceServerConfig;
         pd_NetworkConfig _NetworkConfig;
@@ -102,11 +254,14 @@ void TryToSendPsk(int clickerId)
 
         memcpy(_DeviceServerConfig.bootstrapUri, _PDConfig.bootstrapUri, strnlen(_PDConfig.bootstrapUri, 200));
 
-        uint8_t dataLen = 0;
-        uint8_t *encodedData = softap_EncodeBytes((uint8_t *)&_DeviceServerConfig, sizeof(_DeviceServerConfig) ,
-                clicker->sharedKey, &dataLen);
+        //encoded straight into buffer owned by data pack, connection manager frees it after sending
+        uint16_t dataLen = softap_GetEncodedSize(sizeof(_DeviceServerConfig));
+        uint8_t *encodedData = g_malloc(dataLen);
+        softap_EncodeInto((uint8_t *)&_DeviceServerConfig, sizeof(_DeviceServerConfig), encodedData,
+                &clicker->sharedKeySchedule);
+        crypto_Wipe(&_DeviceServerConfig, sizeof(_DeviceServerConfig));
         NetworkDataPack* netData = con_BuildNetworkDataPack(clicker->clickerID, NetworkCommand_DEVICE_SERVER_CONFIG,
-                encodedData, dataLen, true);
+                encodedData, dataLen, false);
         event_PushEventWithPtr(EventType_CONNECTION_SEND_COMMAND, netData, true);
         g_message("Sending Device Server Config to clicker with id : %d", clicker->clickerID);
 
@@ -115,16 +270,17 @@ void TryToSendPsk(int clickerId)
         strlcpy((char*)&_NetworkConfig.dnsServer, _PDConfig.dnsServer, sizeof(_NetworkConfig.dnsServer));
         strlcpy((char*)&_NetworkConfig.endpointName, clicker->name, sizeof(_NetworkConfig.endpointName));
 
-        dataLen = 0;
-        encodedData = softap_EncodeBytes((uint8_t *)&_NetworkConfig, sizeof(_NetworkConfig) , clicker->sharedKey, &dataLen);
-        netData = con_BuildNetworkDataPack(clicker->clickerID, NetworkCommand_NETWORK_CONFIG, encodedData, dataLen, true);
+        dataLen = softap_GetEncodedSize(sizeof(_NetworkConfig));
+        encodedData = g_malloc(dataLen);
+        softap_EncodeInto((uint8_t *)&_NetworkConfig, sizeof(_NetworkConfig), encodedData, &clicker->sharedKeySchedule);
+        netData = con_BuildNetworkDataPack(clicker->clickerID, NetworkCommand_NETWORK_CONFIG, encodedData, dataLen, false);
         event_PushEventWithPtr(EventType_CONNECTION_SEND_COMMAND, netData, true);
-        G_FREE_AND_NULL(encodedData);
 
         g_message("Sent Network Config to clicker with id : %d", clicker->clickerID);
         g_message("Provisioning of clicker with id : %d finished, going back to LISTENING mode", clicker->clickerID);
         clicker->provisionTime = g_get_monotonic_time() / 1000;
         clicker->provisioningInProgress = false;
+        event_PushEventWithInt(EventType_CLICKER_PROVISIONED, clicker->clickerID);
     } else {
         g_message("TryToSendPsk: Can't send not all data avail, this is not error.");
     }
@@ -138,7 +294,11 @@ static bool NetworkCommandHandler(NetworkDataPack* netData)
         case NetworkCommand_KEY:
             g_debug("Received KEY command");
             HandleRemoteKeyNetworkCommand(netData->clickerID, netData->data);
-            GenerateSharedClickerKey(netData->clickerID);
+            if (IsX25519Offer(netData->clickerID)) {
+                X25519KeyExchange(netData->clickerID);
+            } else {
+                GenerateSharedClickerKey(netData->clickerID);
+            }
             break;
 
         default:
@@ -154,17 +314,12 @@ void GenerateLocalClickerKey(int clickerId) {
                 clickerId);
         return;
     }
-    DiffieHellmanKeysExchanger *keysExchanger = clicker->keysExchanger;
-    clicker->localKey = (void*) dh_GenerateExchangeData(keysExchanger);
-    clicker->localKeyLength = keysExchanger->pModuleLength;
-
-    g_message("Generated local Key");
-    PRINT_BYTES(clicker->localKey, clicker->localKeyLength);
-    g_message("Sending local Key to clicker with id : %d", clickerId);
 
-    NetworkDataPack* netData = con_BuildNetworkDataPack(clickerId, NetworkCommand_KEY, clicker->localKey,
-            clicker->localKeyLength, true);
-    event_PushEventWithPtr(EventType_CONNECTION_SEND_COMMAND, netData, true);
+    if (dh_BeginGenerateExchangeData(&clicker->keysExchanger)) {
+        StartKeyExchange(clicker);
+    } else {
+        g_critical("GenerateLocalClickerKey: Can't start key exchange for clicker with id:%d", clickerId);
+    }
 
     clicker_ReleaseOwnership(clicker);
 }
@@ -178,7 +333,7 @@ static void ObtainedPSK(PreSharedKey* pskData) {
         return;
     }
 
-    if (pskData->psk == NULL) {
+    if (pskData->pskLen == 0) {
         g_warning("Couldn't get PSK from Device Server");
         clicker->error = pd_Error_GENERATE_PSK;
         clicker->provisioningInProgress = false;
@@ -186,13 +341,17 @@ static void ObtainedPSK(PreSharedKey* pskData) {
         return;
     }
 
-    clicker->pskLen = pskData->pskLen / 2;
-    clicker->psk = g_malloc(clicker->pskLen);
+    //longer credentials wouldn't fit into DEVICE_SERVER_CONFIG command anyway
+    size_t pskLen = MIN((size_t)pskData->pskLen / 2, sizeof(clicker->psk));
+    size_t identityLen = MIN((size_t)pskData->identityLen, sizeof(clicker->identity) - 1);
+    if (pskLen < (size_t)pskData->pskLen / 2 || identityLen < (size_t)pskData->identityLen) {
+        g_warning("PSK or identity of clicker %d is too long, truncating it", pskData->clickerId);
+    }
+    clicker->pskLen = pskLen;
     HexStringToByteArray(pskData->psk, clicker->psk, clicker->pskLen);
 
-    clicker->identityLen = pskData->identityLen;
-    clicker->identity = g_malloc(pskData->identityLen + 1);
-    strlcpy((char*)clicker->identity, pskData->identity, pskData->identityLen + 1);
+    clicker->identityLen = identityLen;
+    strlcpy((char*)clicker->identity, pskData->identity, identityLen + 1);
 
     clicker_ReleaseOwnership(clicker);
 
@@ -229,7 +388,41 @@ static void HandleStartProvision(int clickerId) {
     clicker->provisioningInProgress = true;
     clicker_ReleaseOwnership(clicker);
     event_PushEventWithInt(EventType_HISTORY_REMOVE, clickerId);
-    ubusagent_SendGeneratePskMessage(clickerId);
+    if (!ubusagent_SendGeneratePskMessage(clickerId)) {
+        clicker = clicker_AcquireOwnership(clickerId);
+        if (clicker != NULL) {
+            clicker->error = pd_Error_GENERATE_PSK;
+            clicker->provisioningInProgress = false;
+            clicker_ReleaseOwnership(clicker);
+        }
+    }
+}
+
+void clicker_sm_Update(void)
+{
+    gint64 start = g_get_monotonic_time();
+    while (g_queue_is_empty(&_PendingExchanges) == FALSE) {
+        gint64 used = g_get_monotonic_time() - start;
+        if (used >= _PDConfig.dhStepBudget) {
+            break;
+        }
+
+        int clickerId = GPOINTER_TO_INT(g_queue_pop_head(&_PendingExchanges));
+        Clicker *clicker = clicker_AcquireOwnership(clickerId);
+        if (clicker == NULL) {
+            //clicker disconnected in the middle of key exchange
+            continue;
+        }
+
+        DhStepResult result = dh_StepExchange(&clicker->keysExchanger, _PDConfig.dhStepBudget - used);
+        if (result == DhStepResult_IN_PROGRESS) {
+            g_queue_push_tail(&_PendingExchanges, GINT_TO_POINTER(clickerId));
+        } else if (result == DhStepResult_DONE) {
+            FinishKeyExchange(clicker);
+        }
+
+        clicker_ReleaseOwnership(clicker);
+    }
 }
 
 bool clicker_sm_ConsumeEvent(Event* event) {
@@ -37,4 +37,10 @@
 
 bool clicker_sm_ConsumeEvent(Event* event);
 
+/**
+ * @brief Continue key exchanges which are computed in slices. Should be called once per main loop iteration, uses at
+ * most DH_STEP_BUDGET_US microseconds (plus worst single step, see dh_GetWorstStepTime).
+ */
+void clicker_sm_Update(void);
+
 #endif
@@ -34,6 +34,8 @@
 #include <stdint.h>
 
 #define COMMAND_ENDPOINT_NAME_LENGTH 24
+#define COMMAND_PSK_LENGTH 32
+#define COMMAND_IDENTITY_LENGTH 24
 
 typedef enum {
     NetworkCommand_NONE = 0,
@@ -45,13 +47,20 @@ typedef enum {
     NetworkCommand_NETWORK_CONFIG
 } NetworkCommand;
 
+/**
+ * KEY command payload of old firmware is a bare Diffie-Hellman key. Clickers supporting X25519 send capability byte
+ * followed by their 32 byte public key instead, daemon answers in the same format.
+ */
+#define KEY_CAPABILITY_X25519       (0x01)
+#define KEY_X25519_PAYLOAD_SIZE     (1 + 32)
+
 typedef struct __attribute__((__packed__))
 {
     uint8_t securityMode;
     uint8_t pskKeySize;
-    uint8_t psk[32];
+    uint8_t psk[COMMAND_PSK_LENGTH];
     uint8_t identitySize;
-    uint8_t identity[24];
+    uint8_t identity[COMMAND_IDENTITY_LENGTH];
     uint8_t bootstrapUri[175];
 } pd_DeviceServerConfig;
 
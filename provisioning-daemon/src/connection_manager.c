@@ -278,6 +278,10 @@ ConnectionData* ConnectionForClickerId(int clickerID) {
     return found != NULL ? found->data : NULL;
 }
 
+void con_SkipClickerIds(int lastUsedId) {
+    _IDCounter = MAX(_IDCounter, lastUsedId);
+}
+
 void con_Disconnect(int clickerID) {
     ConnectionData* found = ConnectionForClickerId(clickerID);
     if (found != NULL) {
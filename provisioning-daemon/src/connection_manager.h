@@ -58,6 +58,11 @@ typedef struct {
  */
 int con_BindAndListen(int tcpPort);
 
+/**
+ * @brief Make ids given to new clickers higher than lastUsedId, so they don't clash with ids kept from previous runs.
+ */
+void con_SkipClickerIds(int lastUsedId);
+
 /**
  *  @brief Accepts incoming connections and handles read from socket. Should be called periodically.
  */
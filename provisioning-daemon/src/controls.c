@@ -37,61 +37,166 @@
 #define LED_SLOW_BLINK_INTERVAL_MS              (500)
 #define LED_FAST_BLINK_INTERVAL_MS              (100)
 #define TIME_TO_DISCONNECT_AFTER_PROVISION      3000
+#define LED_COUNT                               (8)
+#define PAGE_INDICATOR_TIME_MS                  (1000)
 
 /**
  * Time in millis of last led state has been changed.
  */
 static unsigned long _LastBlinkTime = 0;
 static bool _ActiveLedOn = true;
-static GArray* _ConnectedClickersId;
-static int _SelectedClickerIndex = -1;
+
+/*
+ * Selection set, clickers are kept in order of connection and found by id through hash table of their iterators,
+ * all guarded by _Mutex.
+ */
+static GSequence* _ConnectedClickers;           /**< data is clicker id */
+static GHashTable* _ConnectedClickerIters;      /**< clicker id -> GSequenceIter of _ConnectedClickers */
+static GSequenceIter* _SelectedClicker = NULL;  /**< NULL if no clicker is selected */
 static GMutex _Mutex;
 
-// Send ENABLE_HIGHLIGHT command to active clicker and DISABLE_HIGHLIGHT to inactive clickers
-static void UpdateHighlights(void) {
-    g_mutex_lock(&_Mutex);
-    for (guint t = 0; t < _ConnectedClickersId->len; t++) {
-        NetworkCommand cmdToSend = (t == _SelectedClickerIndex) ?
-                NetworkCommand_ENABLE_HIGHLIGHT : NetworkCommand_DISABLE_HIGHLIGHT;
-        int clickerId = g_array_index(_ConnectedClickersId, int, t);
-        NetworkDataPack* netData = con_BuildNetworkDataPack(clickerId, cmdToSend, NULL, 0, false);
-        event_PushEventWithPtr(EventType_CONNECTION_SEND_COMMAND, netData, true);
+/**
+ * LEDs show one page of LED_COUNT clickers, the one with selected clicker. When it changes, page number (counted
+ * from 1) is shown in binary for PAGE_INDICATOR_TIME_MS first.
+ */
+static int _ShownPage = 0;
+static gint64 _PageIndicatorEnd = 0;
+
+/**
+ * Clicker which has got its configuration and will be disconnected at deadline (monotonic time in millis).
+ */
+typedef struct {
+    int clickerId;
+    gint64 deadline;
+} ScheduledDisconnect;
+
+/**
+ * Pending disconnects ordered by deadline. All of them are scheduled TIME_TO_DISCONNECT_AFTER_PROVISION after
+ * provisioning, so appending keeps the order. Links are found by clicker id to cancel them. Used from main loop only.
+ */
+static GQueue _ScheduledDisconnects = G_QUEUE_INIT;
+static GHashTable* _ScheduledDisconnectLinks;
+
+/*
+ * Output stage, LEDs and clicker highlights are written only when they change. LED device is opened on first write
+ * and stays open until controls_Shutdown.
+ */
+
+/** Mask last written by led_set, -1 if LEDs weren't opened yet */
+static int _AppliedLedMask = -1;
+/** Highlight command last sent to each connected clicker, keyed by clicker id, guarded by _Mutex */
+static GHashTable* _AppliedHighlights;
+static guint64 _SuppressedLedWrites = 0;
+static guint64 _SuppressedHighlights = 0;
+
+static void ApplyLeds(uint8_t mask) {
+    if (_AppliedLedMask == mask) {
+        _SuppressedLedWrites++;
+        return;
     }
-    g_mutex_unlock(&_Mutex);
+    if (_AppliedLedMask < 0) {
+        led_init();
+    }
+    led_set(ALL_LEDS, mask);
+    _AppliedLedMask = mask;
 }
 
-static void SelectNextClickerCallback(void)
-{
-    g_mutex_lock(&_Mutex);
-    _SelectedClickerIndex ++;
-    if (_SelectedClickerIndex >= _ConnectedClickersId->len) {
-        _SelectedClickerIndex = (_ConnectedClickersId->len > 0) ? 0 : -1;
+static void ApplyHighlight(int clickerId, NetworkCommand cmdToSend) {
+    //NOTE: Should be called with _Mutex held!
+    gpointer applied = g_hash_table_lookup(_AppliedHighlights, GINT_TO_POINTER(clickerId));
+    if (GPOINTER_TO_INT(applied) == cmdToSend) {
+        _SuppressedHighlights++;
+        return;
     }
-    if (_SelectedClickerIndex == -1) {
+    NetworkDataPack* netData = con_BuildNetworkDataPack(clickerId, cmdToSend, NULL, 0, false);
+    event_PushEventWithPtr(EventType_CONNECTION_SEND_COMMAND, netData, true);
+    g_hash_table_insert(_AppliedHighlights, GINT_TO_POINTER(clickerId), GINT_TO_POINTER(cmdToSend));
+}
+
+static int ClickerIdAt(GSequenceIter* iter) {
+    return GPOINTER_TO_INT(g_sequence_get(iter));
+}
+
+/**
+ * Move selection, only clickers which selection changed get highlight command.
+ */
+static void SetSelectedClicker(GSequenceIter* iter) {
+    //NOTE: Should be called with _Mutex held!
+    if (iter == _SelectedClicker) {
+        return;
+    }
+    if (_SelectedClicker != NULL) {
+        ApplyHighlight(ClickerIdAt(_SelectedClicker), NetworkCommand_DISABLE_HIGHLIGHT);
+    }
+    _SelectedClicker = iter;
+    if (iter == NULL) {
         g_message("No clicker is selected now.");
     } else {
-        g_message("Selected Clicker ID : %d", g_array_index(_ConnectedClickersId, int, _SelectedClickerIndex));
+        ApplyHighlight(ClickerIdAt(iter), NetworkCommand_ENABLE_HIGHLIGHT);
+        g_message("Selected Clicker ID : %d", ClickerIdAt(iter));
+    }
+}
+
+static bool MatchesFilter(int clickerId, SelectFilter filter) {
+    if (filter == SelectFilter_ANY) {
+        return true;
+    }
+    const Clicker* clicker = clicker_AcquireReadOnly(clickerId);
+    if (clicker == NULL) {
+        return false;
+    }
+    bool result = !clicker->provisioningInProgress && clicker->provisionTime == 0;
+    clicker_ReleaseReadOnly(clicker);
+    return result;
+}
+
+static GSequenceIter* NextWrapped(GSequenceIter* iter) {
+    iter = g_sequence_iter_next(iter);
+    return g_sequence_iter_is_end(iter) ? g_sequence_get_begin_iter(_ConnectedClickers) : iter;
+}
+
+static bool SelectNextClicker(SelectFilter filter) {
+    g_mutex_lock(&_Mutex);
+    GSequenceIter* iter = _SelectedClicker != NULL ? NextWrapped(_SelectedClicker) :
+            g_sequence_get_begin_iter(_ConnectedClickers);
+    guint count = g_hash_table_size(_ConnectedClickerIters);
+    bool found = false;
+    //selected clicker is checked last, so it stays selected if it's the only match
+    for (guint t = 0; t < count && !found; t++, iter = NextWrapped(iter)) {
+        if (MatchesFilter(ClickerIdAt(iter), filter)) {
+            SetSelectedClicker(iter);
+            found = true;
+        }
     }
     g_mutex_unlock(&_Mutex);
-    UpdateHighlights();
+    return found;
+}
+
+static void SelectNextClickerCallback(void)
+{
+    //skip clickers which don't need provisioning, unless there are no others
+    if (SelectNextClicker(SelectFilter_UNPROVISIONED) == false) {
+        SelectNextClicker(SelectFilter_ANY);
+    }
 }
 
 static void StartProvisionCallback(void)
 {
-    if (_SelectedClickerIndex < 0 || _ConnectedClickersId->len == 0) {
+    int clickerId = controls_GetSelectedClickerId();
+    if (clickerId < 0) {
         g_critical( "Can't start provision, no clicker is selected!");
         return;
     }
-    g_mutex_lock(&_Mutex);
-    int clickerId = g_array_index(_ConnectedClickersId, int, _SelectedClickerIndex);
-    g_mutex_unlock(&_Mutex);
 
     event_PushEventWithInt(EventType_CLICKER_START_PROVISION, clickerId);
 }
 
 void controls_Init(bool enableButtons) {
     g_mutex_init(&_Mutex);
-    _ConnectedClickersId = g_array_new(FALSE, FALSE, sizeof(int));
+    _ConnectedClickers = g_sequence_new(NULL);
+    _ConnectedClickerIters = g_hash_table_new(g_direct_hash, g_direct_equal);
+    _ScheduledDisconnectLinks = g_hash_table_new(g_direct_hash, g_direct_equal);
+    _AppliedHighlights = g_hash_table_new(g_direct_hash, g_direct_equal);
 
     if (enableButtons) {
         g_message( "[Setup] Enabling button controls.");
@@ -105,59 +210,74 @@ void controls_Init(bool enableButtons) {
 }
 
 void controls_Shutdown() {
-    g_array_free(_ConnectedClickersId, TRUE);
+    g_message("Controls: %" G_GUINT64_FORMAT " LED writes and %" G_GUINT64_FORMAT
+            " highlight commands skipped as unchanged", _SuppressedLedWrites, _SuppressedHighlights);
+    if (_AppliedLedMask >= 0) {
+        led_release();
+    }
+    g_hash_table_destroy(_AppliedHighlights);
+    g_hash_table_destroy(_ScheduledDisconnectLinks);
+    g_queue_foreach(&_ScheduledDisconnects, (GFunc) g_free, NULL);
+    g_queue_clear(&_ScheduledDisconnects);
+    g_hash_table_destroy(_ConnectedClickerIters);
+    g_sequence_free(_ConnectedClickers);
     switch_release();
     g_mutex_clear(&_Mutex);
 }
 
 static void SetLeds(void)
 {
-    uint8_t mask = 0;
-    int i = 0;
-
     g_mutex_lock(&_Mutex);
-    int clickersCount = _ConnectedClickersId->len;
-    int selectedIndex = _SelectedClickerIndex;
+    int clickersCount = g_hash_table_size(_ConnectedClickerIters);
+    int selectedIndex = _SelectedClicker != NULL ? g_sequence_iter_get_position(_SelectedClicker) : -1;
     g_mutex_unlock(&_Mutex);
 
-    if (clickersCount == 0)
-    {
-        led_release();
+    int page = selectedIndex >= 0 ? selectedIndex / LED_COUNT : 0;
+    gint64 now = g_get_monotonic_time() / 1000;
+    if (page != _ShownPage) {
+        _ShownPage = page;
+        _PageIndicatorEnd = now + PAGE_INDICATOR_TIME_MS;
+    }
+    if (clickersCount > LED_COUNT && now < _PageIndicatorEnd) {
+        ApplyLeds((page + 1) & ALL_LEDS);
         return;
     }
 
-    led_init();
+    int clickersOnPage = MIN(clickersCount - page * LED_COUNT, LED_COUNT);
+    uint8_t mask = (1u << clickersOnPage) - 1;
+    if (selectedIndex >= 0 && _ActiveLedOn) {
+        mask ^= 1 << (selectedIndex % LED_COUNT);
+    }
 
-    for (i = 0; i < clickersCount; i++)
-        mask |= 1 << i;
+    ApplyLeds(mask);
+}
 
-    if ((selectedIndex >= 0) && (selectedIndex < 8) && _ActiveLedOn) {
-        mask ^= 1 << selectedIndex;
+static void CancelDisconnect(int clickerId) {
+    GList* link = g_hash_table_lookup(_ScheduledDisconnectLinks, GINT_TO_POINTER(clickerId));
+    if (link != NULL) {
+        g_hash_table_remove(_ScheduledDisconnectLinks, GINT_TO_POINTER(clickerId));
+        g_free(link->data);
+        g_queue_delete_link(&_ScheduledDisconnects, link);
     }
+}
 
-    led_set(ALL_LEDS, mask);
+static void ScheduleDisconnect(int clickerId) {
+    CancelDisconnect(clickerId);
+    ScheduledDisconnect* scheduled = g_new(ScheduledDisconnect, 1);
+    scheduled->clickerId = clickerId;
+    scheduled->deadline = g_get_monotonic_time() / 1000 + TIME_TO_DISCONNECT_AFTER_PROVISION;
+    g_queue_push_tail(&_ScheduledDisconnects, scheduled);
+    g_hash_table_insert(_ScheduledDisconnectLinks, GINT_TO_POINTER(clickerId),
+            g_queue_peek_tail_link(&_ScheduledDisconnects));
 }
 
 void CheckForFinishedProvisionings(void) {
-    g_mutex_lock(&_Mutex);
-    int count = _ConnectedClickersId->len;
-    g_mutex_unlock(&_Mutex);
-
-    for (guint t = 0; t < count; t++) {
-        g_mutex_lock(&_Mutex);
-        int clickerId = g_array_index(_ConnectedClickersId, int, t);
-        g_mutex_unlock(&_Mutex);
-        Clicker* clicker = clicker_AcquireOwnership(clickerId);
-        if (clicker == NULL) {
-            g_critical( "No clicker with id:%d, this is internal error.", clickerId);
-            continue;
-        }
-        if (clicker->provisionTime > 0) {
-            if (g_get_monotonic_time() / 1000 - clicker->provisionTime > TIME_TO_DISCONNECT_AFTER_PROVISION) {
-                con_Disconnect(clicker->clickerID);
-            }
-        }
-        clicker_ReleaseOwnership(clicker);
+    gint64 now = g_get_monotonic_time() / 1000;
+    ScheduledDisconnect* scheduled;
+    while ((scheduled = g_queue_peek_head(&_ScheduledDisconnects)) != NULL && scheduled->deadline <= now) {
+        int clickerId = scheduled->clickerId;
+        CancelDisconnect(clickerId);
+        con_Disconnect(clickerId);
     }
 }
 
@@ -168,7 +288,7 @@ void controls_Update(void) {
     int clickerId = controls_GetSelectedClickerId();
     int interval = 0;
     if (clickerId >= 0) {
-        Clicker* clicker = clicker_AcquireOwnership(clickerId);
+        const Clicker* clicker = clicker_AcquireReadOnly(clickerId);
         if (clicker == NULL) {
             g_critical( "No clicker with id:%d, this is internal error.", clickerId);
             return;
@@ -176,7 +296,7 @@ void controls_Update(void) {
 
         interval = clicker->provisioningInProgress ? LED_FAST_BLINK_INTERVAL_MS : LED_SLOW_BLINK_INTERVAL_MS;
 
-        clicker_ReleaseOwnership(clicker);
+        clicker_ReleaseReadOnly(clicker);
     }
 
     unsigned long currentTime = g_get_monotonic_time() / 1000;
@@ -189,25 +309,37 @@ void controls_Update(void) {
     CheckForFinishedProvisionings();
 }
 
-static void RemoveClickerWithID(int clickerID) {
+static void AddClickerWithID(int clickerID) {
     g_mutex_lock(&_Mutex);
-    guint foundIndex = -1;
-    for(guint t = 0; t < _ConnectedClickersId->len; t++) {
-        if (g_array_index(_ConnectedClickersId, int, t) == clickerID) {
-            foundIndex = t;
-            break;
+    if (g_hash_table_contains(_ConnectedClickerIters, GINT_TO_POINTER(clickerID)) == FALSE) {
+        GSequenceIter* iter = g_sequence_append(_ConnectedClickers, GINT_TO_POINTER(clickerID));
+        g_hash_table_insert(_ConnectedClickerIters, GINT_TO_POINTER(clickerID), iter);
+        if (_SelectedClicker == NULL) {
+            SetSelectedClicker(iter);
+        } else {
+            ApplyHighlight(clickerID, NetworkCommand_DISABLE_HIGHLIGHT);
         }
     }
-    if (foundIndex >= 0) {
-        g_array_remove_index(_ConnectedClickersId, foundIndex);
-
-        if (_SelectedClickerIndex >= _ConnectedClickersId->len) {
-            _SelectedClickerIndex = _ConnectedClickersId->len - 1;
-            if (_SelectedClickerIndex == -1) {
-                g_message("No clicker is selected now.");
-            } else {
-                g_message("Selected Clicker ID : %d", g_array_index(_ConnectedClickersId, int, _SelectedClickerIndex));
+    g_mutex_unlock(&_Mutex);
+}
+
+static void RemoveClickerWithID(int clickerID) {
+    g_mutex_lock(&_Mutex);
+    GSequenceIter* iter = g_hash_table_lookup(_ConnectedClickerIters, GINT_TO_POINTER(clickerID));
+    g_hash_table_remove(_AppliedHighlights, GINT_TO_POINTER(clickerID));
+    if (iter != NULL) {
+        g_hash_table_remove(_ConnectedClickerIters, GINT_TO_POINTER(clickerID));
+        if (iter == _SelectedClicker) {
+            //selection moves to the following clicker, or to the previous one if this was the last
+            GSequenceIter* next = g_sequence_iter_next(iter);
+            if (g_sequence_iter_is_end(next)) {
+                next = g_sequence_iter_is_begin(iter) ? NULL : g_sequence_iter_prev(iter);
             }
+            _SelectedClicker = NULL;
+            g_sequence_remove(iter);
+            SetSelectedClicker(next);
+        } else {
+            g_sequence_remove(iter);
         }
     }
     g_mutex_unlock(&_Mutex);
@@ -215,28 +347,28 @@ static void RemoveClickerWithID(int clickerID) {
 
 static void SelectClickerWithId(int clickerId) {
     g_mutex_lock(&_Mutex);
-    for (guint t = 0; t < _ConnectedClickersId->len; t++) {
-        if (g_array_index(_ConnectedClickersId, int, t) == clickerId) {
-            _SelectedClickerIndex = t;
-            g_message( "Selected Clicker ID : %d", clickerId);
-            break;
-        }
+    GSequenceIter* iter = g_hash_table_lookup(_ConnectedClickerIters, GINT_TO_POINTER(clickerId));
+    if (iter != NULL) {
+        SetSelectedClicker(iter);
     }
     g_mutex_unlock(&_Mutex);
 }
 
 int controls_GetSelectedClickerId() {
     g_mutex_lock(&_Mutex);
-    int result = (_SelectedClickerIndex < 0) ? -1 : g_array_index(_ConnectedClickersId, int, _SelectedClickerIndex);
+    int result = (_SelectedClicker == NULL) ? -1 : ClickerIdAt(_SelectedClicker);
     g_mutex_unlock(&_Mutex);
     return result;
 }
 
 GArray* controls_GetAllClickersIds() {
     g_mutex_lock(&_Mutex);
-    GArray* result = g_array_new(FALSE, FALSE, sizeof(int));
-    int* pos = &g_array_index(_ConnectedClickersId, int, 0);
-    g_array_append_vals(result, pos, _ConnectedClickersId->len);
+    GArray* result = g_array_sized_new(FALSE, FALSE, sizeof(int), g_hash_table_size(_ConnectedClickerIters));
+    GSequenceIter* iter = g_sequence_get_begin_iter(_ConnectedClickers);
+    for (; !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+        int clickerId = ClickerIdAt(iter);
+        g_array_append_val(result, clickerId);
+    }
     g_mutex_unlock(&_Mutex);
     return result;
 }
@@ -244,24 +376,26 @@ GArray* controls_GetAllClickersIds() {
 bool controls_ConsumeEvent(Event* event) {
     switch(event->type) {
         case EventType_CLICKER_CREATE:
-            g_mutex_lock(&_Mutex);
-            g_array_append_val(_ConnectedClickersId, event->intData);
-            if (_SelectedClickerIndex == -1) {
-                _SelectedClickerIndex = 0;
-                g_message( "Selected Clicker ID : %d", g_array_index(_ConnectedClickersId, int, _SelectedClickerIndex));
-            }
-            g_mutex_unlock(&_Mutex);
-            UpdateHighlights();
+            AddClickerWithID(event->intData);
             return true;
 
         case EventType_CLICKER_DESTROY:
+            CancelDisconnect(event->intData);
             RemoveClickerWithID(event->intData);
-            UpdateHighlights();
             return true;
 
         case EventType_CLICKER_SELECT:
             SelectClickerWithId(event->intData);
-            UpdateHighlights();
+            return true;
+
+        case EventType_CLICKER_SELECT_NEXT:
+            if (SelectNextClicker(event->intData) == false) {
+                g_message("No clicker matches selection filter %d", event->intData);
+            }
+            return true;
+
+        case EventType_CLICKER_PROVISIONED:
+            ScheduleDisconnect(event->intData);
             return true;
 
         default:
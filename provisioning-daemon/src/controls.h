@@ -35,6 +35,14 @@
 #include <glib.h>
 #include "event.h"
 
+/**
+ * @brief Which clickers can be selected by EventType_CLICKER_SELECT_NEXT, data of the event.
+ */
+typedef enum {
+    SelectFilter_ANY = 0,               /**< every connected clicker */
+    SelectFilter_UNPROVISIONED          /**< clickers not provisioned yet and not being provisioned */
+} SelectFilter;
+
 void controls_Init(bool enableButtons);
 void controls_Shutdown();
 
@@ -0,0 +1,124 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * AES-128 with x86 AES-NI instructions. Compiled with target attribute, so the rest of the binary doesn't
+ * require AES-NI and the backend is used only if CPUID reports it.
+ */
+
+#include "aes_backend.h"
+
+#ifdef AES_HAVE_AESNI
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+
+static bool AesNiIsSupported(void) {
+    //CPUID is slow, especially under virtualisation where it traps, so ask only once
+    static int supported = -1;
+    if (supported < 0) {
+        unsigned int eax, ebx, ecx, edx;
+        supported = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES) != 0;
+    }
+    return supported;
+}
+
+static AESNI_TARGET __m128i ExpandStep(__m128i key, __m128i assist) {
+    assist = _mm_shuffle_epi32(assist, 0xFF);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+//round constant has to be an immediate
+#define EXPAND(round, rcon) \
+    roundKeys[round] = ExpandStep(roundKeys[round - 1], _mm_aeskeygenassist_si128(roundKeys[round - 1], rcon))
+
+static AESNI_TARGET void AesNiSetKey(AesKey* key, const uint8_t* userKey) {
+    __m128i* roundKeys = (__m128i*) key->schedule;
+    roundKeys[0] = _mm_loadu_si128((const __m128i*) userKey);
+    EXPAND(1, 0x01);
+    EXPAND(2, 0x02);
+    EXPAND(3, 0x04);
+    EXPAND(4, 0x08);
+    EXPAND(5, 0x10);
+    EXPAND(6, 0x20);
+    EXPAND(7, 0x40);
+    EXPAND(8, 0x80);
+    EXPAND(9, 0x1B);
+    EXPAND(10, 0x36);
+}
+
+static AESNI_TARGET void AesNiEncrypt(const AesKey* key, const uint8_t* src, uint8_t* dst, size_t blocks) {
+    const __m128i* roundKeys = (const __m128i*) key->schedule;
+    int round;
+
+    //four independent blocks keep the AES unit pipeline busy
+    for (; blocks >= 4; blocks -= 4) {
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) src), roundKeys[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (src + 16)), roundKeys[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (src + 32)), roundKeys[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (src + 48)), roundKeys[0]);
+        for (round = 1; round < AES_128_ROUNDS; round++) {
+            b0 = _mm_aesenc_si128(b0, roundKeys[round]);
+            b1 = _mm_aesenc_si128(b1, roundKeys[round]);
+            b2 = _mm_aesenc_si128(b2, roundKeys[round]);
+            b3 = _mm_aesenc_si128(b3, roundKeys[round]);
+        }
+        _mm_storeu_si128((__m128i*) dst, _mm_aesenclast_si128(b0, roundKeys[AES_128_ROUNDS]));
+        _mm_storeu_si128((__m128i*) (dst + 16), _mm_aesenclast_si128(b1, roundKeys[AES_128_ROUNDS]));
+        _mm_storeu_si128((__m128i*) (dst + 32), _mm_aesenclast_si128(b2, roundKeys[AES_128_ROUNDS]));
+        _mm_storeu_si128((__m128i*) (dst + 48), _mm_aesenclast_si128(b3, roundKeys[AES_128_ROUNDS]));
+        src += 4 * AES_BLOCK_SIZE;
+        dst += 4 * AES_BLOCK_SIZE;
+    }
+    for (; blocks > 0; blocks--) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*) src), roundKeys[0]);
+        for (round = 1; round < AES_128_ROUNDS; round++) {
+            b = _mm_aesenc_si128(b, roundKeys[round]);
+        }
+        _mm_storeu_si128((__m128i*) dst, _mm_aesenclast_si128(b, roundKeys[AES_128_ROUNDS]));
+        src += AES_BLOCK_SIZE;
+        dst += AES_BLOCK_SIZE;
+    }
+}
+
+const AesBackend g_AesNiBackend = {
+    .name = "aesni",
+    .constantTime = true,
+    .isSupported = AesNiIsSupported,
+    .setKey = AesNiSetKey,
+    .encrypt = AesNiEncrypt
+};
+
+#endif /* AES_HAVE_AESNI */
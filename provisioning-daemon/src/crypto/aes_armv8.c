@@ -0,0 +1,100 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * AES-128 with ARMv8 crypto extension. Compiled with target attribute, so the rest of the binary doesn't require
+ * the extension and the backend is used only if HWCAP reports it.
+ */
+
+#include "aes_backend.h"
+
+#ifdef AES_HAVE_ARMV8
+
+#include <arm_neon.h>
+#include <string.h>
+#include <sys/auxv.h>
+
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+
+#define ARMV8_TARGET __attribute__((target("+crypto")))
+
+static bool Armv8IsSupported(void) {
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+}
+
+/**
+ * AESE with zero round key is SubBytes(ShiftRows(x)), ShiftRows has no effect when all columns are equal.
+ */
+static ARMV8_TARGET void SubWord(uint8_t* word) {
+    uint8_t columns[AES_BLOCK_SIZE];
+    int t;
+    for (t = 0; t < AES_BLOCK_SIZE; t++) {
+        columns[t] = word[t % 4];
+    }
+    uint8x16_t substituted = vaeseq_u8(vld1q_u8(columns), vdupq_n_u8(0));
+    vst1q_u8(columns, substituted);
+    memcpy(word, columns, 4);
+}
+
+static ARMV8_TARGET void Armv8SetKey(AesKey* key, const uint8_t* userKey) {
+    aes_ExpandKey((uint8_t*) key->schedule, userKey, SubWord);
+}
+
+static ARMV8_TARGET void Armv8Encrypt(const AesKey* key, const uint8_t* src, uint8_t* dst, size_t blocks) {
+    const uint8_t* schedule = (const uint8_t*) key->schedule;
+    uint8x16_t roundKeys[AES_128_ROUNDS + 1];
+    int round;
+
+    for (round = 0; round <= AES_128_ROUNDS; round++) {
+        roundKeys[round] = vld1q_u8(schedule + round * AES_BLOCK_SIZE);
+    }
+    for (; blocks > 0; blocks--) {
+        uint8x16_t b = vld1q_u8(src);
+        for (round = 0; round < AES_128_ROUNDS - 1; round++) {
+            b = vaesmcq_u8(vaeseq_u8(b, roundKeys[round]));
+        }
+        b = vaeseq_u8(b, roundKeys[AES_128_ROUNDS - 1]);
+        vst1q_u8(dst, veorq_u8(b, roundKeys[AES_128_ROUNDS]));
+        src += AES_BLOCK_SIZE;
+        dst += AES_BLOCK_SIZE;
+    }
+}
+
+const AesBackend g_AesArmv8Backend = {
+    .name = "armv8",
+    .constantTime = true,
+    .isSupported = Armv8IsSupported,
+    .setKey = Armv8SetKey,
+    .encrypt = Armv8Encrypt
+};
+
+#endif /* AES_HAVE_ARMV8 */
@@ -0,0 +1,158 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "aes_backend.h"
+#include "rijndael.h"
+#include "wipe.h"
+
+#include <string.h>
+
+/**
+ * Preference of automatic selection, hardware first. T-table is the reference implementation and is used only
+ * when selected explicitly, its lookups depend on key and data.
+ */
+static const AesBackend* const _Backends[] = {
+#ifdef AES_HAVE_AESNI
+    &g_AesNiBackend,
+#endif
+#ifdef AES_HAVE_ARMV8
+    &g_AesArmv8Backend,
+#endif
+    &g_AesBitslicedBackend,
+    &g_AesTTableBackend,
+};
+
+#define BACKENDS_COUNT (sizeof(_Backends) / sizeof(_Backends[0]))
+
+static const AesBackend* _Selected = NULL;
+
+static bool IsSupported(const AesBackend* backend) {
+    return backend->isSupported == NULL || backend->isSupported();
+}
+
+const AesBackend* aes_GetBackendAt(int index) {
+    if (index < 0 || index >= (int) BACKENDS_COUNT) {
+        return NULL;
+    }
+    return _Backends[index];
+}
+
+const AesBackend* aes_FindBackend(const char* name) {
+    size_t t;
+    for (t = 0; t < BACKENDS_COUNT; t++) {
+        if (strcmp(_Backends[t]->name, name) == 0) {
+            return IsSupported(_Backends[t]) ? _Backends[t] : NULL;
+        }
+    }
+    return NULL;
+}
+
+const AesBackend* aes_SelectBackend(const char* name) {
+    const AesBackend* backend = NULL;
+    if (name == NULL || strcmp(name, "auto") == 0) {
+        size_t t;
+        for (t = 0; t < BACKENDS_COUNT && backend == NULL; t++) {
+            if (_Backends[t]->constantTime && IsSupported(_Backends[t])) {
+                backend = _Backends[t];
+            }
+        }
+    } else {
+        backend = aes_FindBackend(name);
+    }
+
+    if (backend) {
+        _Selected = backend;
+    }
+    return backend;
+}
+
+const AesBackend* aes_GetBackend(void) {
+    if (_Selected == NULL) {
+        aes_SelectBackend(NULL);
+    }
+    return _Selected;
+}
+
+void aes_SetKey(AesKey* key, const AesBackend* backend, const uint8_t* userKey) {
+    key->backend = backend ? backend : aes_GetBackend();
+    key->backend->setKey(key, userKey);
+}
+
+void aes_Encrypt(const AesKey* key, const uint8_t* src, uint8_t* dst, size_t blocks) {
+    key->backend->encrypt(key, src, dst, blocks);
+}
+
+void aes_WipeKey(AesKey* key) {
+    crypto_Wipe(key, sizeof(AesKey));
+}
+
+void aes_ExpandKey(uint8_t* roundKeys, const uint8_t* userKey, void (*subWord)(uint8_t* word)) {
+    uint8_t rcon = 1;
+    int t, y;
+
+    memcpy(roundKeys, userKey, AES_KEY_SIZE);
+    for (t = AES_KEY_SIZE; t < AES_BLOCK_SIZE * (AES_128_ROUNDS + 1); t += 4) {
+        uint8_t word[4];
+        memcpy(word, roundKeys + t - 4, 4);
+        if (t % AES_KEY_SIZE == 0) {
+            uint8_t first = word[0];
+            word[0] = word[1];
+            word[1] = word[2];
+            word[2] = word[3];
+            word[3] = first;
+            subWord(word);
+            word[0] ^= rcon;
+            rcon = (rcon << 1) ^ ((rcon >> 7) * 0x1B);
+        }
+        for (y = 0; y < 4; y++) {
+            roundKeys[t + y] = roundKeys[t - AES_KEY_SIZE + y] ^ word[y];
+        }
+    }
+}
+
+/*
+ * T-table backend, thin wrapper of rijndael.c.
+ */
+
+static void TTableSetKey(AesKey* key, const uint8_t* userKey) {
+    rijndaelKeySetupEnc(key->schedule, userKey, 128);
+}
+
+static void TTableEncrypt(const AesKey* key, const uint8_t* src, uint8_t* dst, size_t blocks) {
+    rijndaelEncryptBlocks(key->schedule, AES_128_ROUNDS, src, dst, blocks);
+}
+
+const AesBackend g_AesTTableBackend = {
+    .name = "ttable",
+    .constantTime = false,
+    .isSupported = NULL,
+    .setKey = TTableSetKey,
+    .encrypt = TTableEncrypt
+};
@@ -0,0 +1,131 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __AES_BACKEND_H__
+#define __AES_BACKEND_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AES_BLOCK_SIZE          (16)
+#define AES_KEY_SIZE            (16)
+#define AES_128_ROUNDS          (10)
+
+/** Big enough for the biggest (bitsliced) expanded key */
+#define AES_SCHEDULE_WORDS      (8 * (AES_128_ROUNDS + 1))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_HAVE_AESNI          1
+#endif
+
+#if defined(__aarch64__)
+#define AES_HAVE_ARMV8          1
+#endif
+
+typedef struct AesBackend AesBackend;
+
+/**
+ * @brief AES-128 key expanded for encryption by one of the backends.
+ */
+typedef struct {
+    const AesBackend* backend;
+    uint32_t schedule[AES_SCHEDULE_WORDS] __attribute__((aligned(16)));
+} AesKey;
+
+/**
+ * @brief Implementation of AES-128 encryption. Only encryption is covered, decryption of softap data stays with
+ * rijndael.c.
+ */
+struct AesBackend {
+    const char* name;
+    bool constantTime;          /**< no table lookups or branches depending on key or data */
+    bool (*isSupported)(void);  /**< CPU feature detection, NULL - always supported */
+    void (*setKey)(AesKey* key, const uint8_t* userKey);
+    void (*encrypt)(const AesKey* key, const uint8_t* src, uint8_t* dst, size_t blocks);
+};
+
+/**
+ * @brief Select backend used by aes_SetKey when no backend is given.
+ * @param[in] name backend name, NULL or "auto" picks the fastest constant time backend supported by this CPU
+ * @return selected backend or NULL if name is unknown or not supported, previous selection is kept then
+ */
+const AesBackend* aes_SelectBackend(const char* name);
+
+/**
+ * @brief Currently selected backend, selects automatically if aes_SelectBackend wasn't called yet.
+ */
+const AesBackend* aes_GetBackend(void);
+
+/**
+ * @brief Find backend by name.
+ * @return backend or NULL if name is unknown or backend is not supported by this CPU
+ */
+const AesBackend* aes_FindBackend(const char* name);
+
+/**
+ * @brief Iterate over backends built into this binary, including those not supported by this CPU.
+ * @return backend or NULL if index is out of range
+ */
+const AesBackend* aes_GetBackendAt(int index);
+
+/**
+ * @brief Expand 16 bytes key for encryption.
+ * @param[in] backend backend to use, NULL - selected one
+ */
+void aes_SetKey(AesKey* key, const AesBackend* backend, const uint8_t* userKey);
+
+/**
+ * @brief Encrypt consecutive blocks (ECB), src and dst may be the same buffer.
+ */
+void aes_Encrypt(const AesKey* key, const uint8_t* src, uint8_t* dst, size_t blocks);
+
+/**
+ * @brief Erase expanded key.
+ */
+void aes_WipeKey(AesKey* key);
+
+/**
+ * @brief Standard byte oriented AES-128 key expansion used by backends without own key schedule instruction.
+ * @param[out] roundKeys (AES_128_ROUNDS + 1) round keys, AES_BLOCK_SIZE bytes each
+ * @param[in] subWord applies S-box to 4 bytes in place
+ */
+void aes_ExpandKey(uint8_t* roundKeys, const uint8_t* userKey, void (*subWord)(uint8_t* word));
+
+extern const AesBackend g_AesTTableBackend;
+extern const AesBackend g_AesBitslicedBackend;
+#ifdef AES_HAVE_AESNI
+extern const AesBackend g_AesNiBackend;
+#endif
+#ifdef AES_HAVE_ARMV8
+extern const AesBackend g_AesArmv8Backend;
+#endif
+
+#endif /* __AES_BACKEND_H__ */
@@ -0,0 +1,351 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Constant time AES-128 for cores without AES instructions. Two blocks are processed at once, bit j of byte i of
+ * the first block is bit i of plane j, second block uses bits 16-31. Byte i is row (i % 4) and column (i / 4) of
+ * the AES state. S-box is a boolean circuit, so there are no memory lookups and no branches depending on key or
+ * data.
+ */
+
+#include "aes_backend.h"
+
+#include <string.h>
+
+#define PLANES  (8)
+
+static uint32_t LoadWord(const uint8_t* bytes) {
+    return bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+static void StoreWord(uint8_t* bytes, uint32_t word) {
+    bytes[0] = (uint8_t) word;
+    bytes[1] = (uint8_t) (word >> 8);
+    bytes[2] = (uint8_t) (word >> 16);
+    bytes[3] = (uint8_t) (word >> 24);
+}
+
+static void Pack(uint32_t* q, const uint8_t* first, const uint8_t* second) {
+    uint32_t words[8];
+    int i, j;
+    for (i = 0; i < 4; i++) {
+        words[i] = LoadWord(first + 4 * i);
+        words[4 + i] = LoadWord(second + 4 * i);
+    }
+    for (j = 0; j < PLANES; j++) {
+        q[j] = 0;
+        for (i = 0; i < 8; i++) {
+            //gather bit j of 4 bytes into 4 consecutive bits
+            uint32_t m = (words[i] >> j) & 0x01010101u;
+            m = (m | (m >> 7)) & 0x00030003u;
+            m = (m | (m >> 14)) & 0xFu;
+            q[j] |= m << (4 * i);
+        }
+    }
+}
+
+static void Unpack(const uint32_t* q, uint8_t* first, uint8_t* second) {
+    int i, j;
+    for (i = 0; i < 8; i++) {
+        uint32_t word = 0;
+        for (j = 0; j < PLANES; j++) {
+            //spread 4 bits to bit j of 4 bytes
+            uint32_t s = (q[j] >> (4 * i)) & 0xFu;
+            s = (s | (s << 14)) & 0x00030003u;
+            s = (s | (s << 7)) & 0x01010101u;
+            word |= s << j;
+        }
+        StoreWord(i < 4 ? first + 4 * i : second + 4 * (i - 4), word);
+    }
+}
+
+/**
+ * S-box circuit of Boyar and Peralta (113 gates), planes are in bit order, q[0] is the least significant bit.
+ */
+static void SubBytes(uint32_t* q) {
+    uint32_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint32_t y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+    uint32_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15, z16, z17;
+    uint32_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19, t20, t21,
+            t22, t23, t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34, t35, t36, t37, t38, t39, t40, t41, t42,
+            t43, t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57, t58, t59, t60, t61, t62, t63,
+            t64, t65, t66, t67;
+    uint32_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    //top linear transformation
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    //non-linear section
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    //bottom linear transformation
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+/**
+ * Rotate both 16 bit halves right by n bits.
+ */
+static uint32_t RotateHalves(uint32_t x, int n) {
+    uint32_t low = (0xFFFFu >> n) * 0x00010001u;
+    return ((x >> n) & low) | ((x << (16 - n)) & ~low);
+}
+
+static void ShiftRows(uint32_t* q) {
+    int i;
+    for (i = 0; i < PLANES; i++) {
+        uint32_t x = q[i];
+        q[i] = (x & 0x11111111u) | (RotateHalves(x, 4) & 0x22222222u) | (RotateHalves(x, 8) & 0x44444444u) |
+                (RotateHalves(x, 12) & 0x88888888u);
+    }
+}
+
+/**
+ * Rotate rows of every column by n, each column is a group of 4 bits.
+ */
+static uint32_t RotateColumns(uint32_t x, int n) {
+    uint32_t low = (0xFu >> n) * 0x11111111u;
+    return ((x >> n) & low) | ((x << (4 - n)) & ~low);
+}
+
+static void MixColumns(uint32_t* q) {
+    uint32_t r1[PLANES], t[PLANES];
+    int i;
+
+    //out = 2 * (a ^ rot1(a)) ^ rot1(a) ^ rot2(a) ^ rot3(a)
+    for (i = 0; i < PLANES; i++) {
+        r1[i] = RotateColumns(q[i], 1);
+        t[i] = q[i] ^ r1[i];
+    }
+    for (i = 0; i < PLANES; i++) {
+        uint32_t doubled = i == 0 ? t[7] : t[i - 1];
+        if (i == 1 || i == 3 || i == 4) {
+            doubled ^= t[7];
+        }
+        q[i] = doubled ^ r1[i] ^ RotateColumns(q[i], 2) ^ RotateColumns(q[i], 3);
+    }
+}
+
+static void AddRoundKey(uint32_t* q, const uint32_t* roundKey) {
+    int i;
+    for (i = 0; i < PLANES; i++) {
+        q[i] ^= roundKey[i];
+    }
+}
+
+static void SubWord(uint8_t* word) {
+    uint8_t block[AES_BLOCK_SIZE];
+    uint32_t q[PLANES];
+    memset(block, 0, sizeof(block));
+    memcpy(block, word, 4);
+    Pack(q, block, block);
+    SubBytes(q);
+    Unpack(q, block, block);
+    memcpy(word, block, 4);
+}
+
+static void BitslicedSetKey(AesKey* key, const uint8_t* userKey) {
+    uint8_t roundKeys[AES_BLOCK_SIZE * (AES_128_ROUNDS + 1)];
+    int t;
+    aes_ExpandKey(roundKeys, userKey, SubWord);
+    for (t = 0; t <= AES_128_ROUNDS; t++) {
+        Pack(key->schedule + t * PLANES, roundKeys + t * AES_BLOCK_SIZE, roundKeys + t * AES_BLOCK_SIZE);
+    }
+    memset(roundKeys, 0, sizeof(roundKeys));
+}
+
+static void EncryptPair(const AesKey* key, const uint8_t* src1, const uint8_t* src2, uint8_t* dst1, uint8_t* dst2) {
+    uint32_t q[PLANES];
+    int round;
+
+    Pack(q, src1, src2);
+    AddRoundKey(q, key->schedule);
+    for (round = 1; round < AES_128_ROUNDS; round++) {
+        SubBytes(q);
+        ShiftRows(q);
+        MixColumns(q);
+        AddRoundKey(q, key->schedule + round * PLANES);
+    }
+    SubBytes(q);
+    ShiftRows(q);
+    AddRoundKey(q, key->schedule + AES_128_ROUNDS * PLANES);
+    Unpack(q, dst1, dst2);
+}
+
+static void BitslicedEncrypt(const AesKey* key, const uint8_t* src, uint8_t* dst, size_t blocks) {
+    for (; blocks >= 2; blocks -= 2) {
+        EncryptPair(key, src, src + AES_BLOCK_SIZE, dst, dst + AES_BLOCK_SIZE);
+        src += 2 * AES_BLOCK_SIZE;
+        dst += 2 * AES_BLOCK_SIZE;
+    }
+    if (blocks) {
+        uint8_t unused[AES_BLOCK_SIZE];
+        EncryptPair(key, src, src, dst, unused);
+    }
+}
+
+const AesBackend g_AesBitslicedBackend = {
+    .name = "bitsliced",
+    .constantTime = true,
+    .isSupported = NULL,
+    .setKey = BitslicedSetKey,
+    .encrypt = BitslicedEncrypt
+};
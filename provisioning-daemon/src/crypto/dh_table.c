@@ -0,0 +1,214 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dh_table.h"
+#include "bigint.h"
+#include "sha256.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static int WindowCount(int moduleLength, int windowBits) {
+    return (moduleLength * 8 + windowBits - 1) / windowBits;
+}
+
+static size_t ImageSize(int moduleLength, int windowBits) {
+    return sizeof(DhTableImage) + moduleLength +
+            ((size_t) WindowCount(moduleLength, windowBits) << windowBits) * moduleLength;
+}
+
+static void Checksum(const DhTableImage* image, size_t size, uint8_t* checksum) {
+    Sha256Context sha;
+    sha256_Init(&sha);
+    sha256_Update(&sha, image->data, size - sizeof(DhTableImage));
+    sha256_Final(&sha, checksum);
+}
+
+DhTable* dh_BuildTable(const uint8_t* module, int moduleLength, int g, int windowBits) {
+    if (windowBits < DH_TABLE_MIN_WINDOW_BITS || windowBits > DH_TABLE_MAX_WINDOW_BITS) {
+        return NULL;
+    }
+    size_t size = ImageSize(moduleLength, windowBits);
+    DhTableImage* image = calloc(1, size);
+    int windows = WindowCount(moduleLength, windowBits);
+    int digits = 1 << windowBits;
+    int window, digit;
+
+    image->magic = DH_TABLE_MAGIC;
+    image->version = DH_TABLE_VERSION;
+    image->moduleLength = moduleLength;
+    image->g = g;
+    image->windowBits = windowBits;
+    memcpy(image->data, module, moduleLength);
+
+    BigInt* p = bi_Create((uint8_t*) module, moduleLength);
+    BigInt* power = bi_CreateFromLong(g, moduleLength);     //g^(2^(windowBits * window))
+    BigInt* entry = bi_CreateFromLong(1, moduleLength);
+    bi_Modulo(power, p);
+    for (window = 0; window < windows; window++) {
+        uint8_t* row = image->data + moduleLength + (size_t) window * digits * moduleLength;
+        BigInt* one = bi_CreateFromLong(1, moduleLength);
+        bi_Assign(entry, one);
+        bi_Release(&one);
+        for (digit = 0; digit < digits; digit++) {
+            memcpy(row + digit * moduleLength, entry->buffer, moduleLength);
+            bi_MultiplyAmodB(entry, power, p);
+        }
+        bi_Assign(power, entry);    //power^(2^windowBits)
+    }
+    bi_Release(&entry);
+    bi_Release(&power);
+    bi_Release(&p);
+
+    Checksum(image, size, image->checksum);
+
+    DhTable* table = malloc(sizeof(DhTable));
+    table->image = image;
+    table->size = size;
+    table->mapped = false;
+    return table;
+}
+
+bool dh_TableMatches(const DhTable* table, const uint8_t* module, int moduleLength, int g) {
+    const DhTableImage* image = table->image;
+    return image->moduleLength == (uint32_t) moduleLength && image->g == (uint32_t) g &&
+            memcmp(image->data, module, moduleLength) == 0;
+}
+
+DhTable* dh_LoadTable(const char* path, const uint8_t* module, int moduleLength, int g, int windowBits) {
+    struct stat info;
+    uint8_t checksum[SHA256_DIGEST_SIZE];
+
+    if (windowBits < DH_TABLE_MIN_WINDOW_BITS || windowBits > DH_TABLE_MAX_WINDOW_BITS) {
+        return NULL;
+    }
+    size_t size = ImageSize(moduleLength, windowBits);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size != size) {
+        close(fd);
+        return NULL;
+    }
+    void* image = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+
+    DhTable* table = malloc(sizeof(DhTable));
+    table->image = image;
+    table->size = size;
+    table->mapped = true;
+    if (table->image->magic != DH_TABLE_MAGIC || table->image->version != DH_TABLE_VERSION ||
+            table->image->windowBits != (uint32_t) windowBits || !dh_TableMatches(table, module, moduleLength, g)) {
+        dh_ReleaseTable(&table);
+        return NULL;
+    }
+    Checksum(table->image, size, checksum);
+    if (memcmp(checksum, table->image->checksum, sizeof(checksum)) != 0) {
+        dh_ReleaseTable(&table);
+        return NULL;
+    }
+    return table;
+}
+
+bool dh_SaveTable(const DhTable* table, const char* path) {
+    size_t length = strlen(path) + sizeof(".XXXXXX");
+    char* temporary = malloc(length);
+    snprintf(temporary, length, "%s.XXXXXX", path);
+
+    int fd = mkstemp(temporary);
+    if (fd < 0) {
+        free(temporary);
+        return false;
+    }
+    const uint8_t* bytes = (const uint8_t*) table->image;
+    size_t written = 0;
+    while (written < table->size) {
+        ssize_t count = write(fd, bytes + written, table->size - written);
+        if (count <= 0) {
+            break;
+        }
+        written += count;
+    }
+    bool result = written == table->size && fchmod(fd, 0644) == 0 && fsync(fd) == 0;
+    result = close(fd) == 0 && result;
+    if (result) {
+        result = rename(temporary, path) == 0;
+    }
+    if (!result) {
+        unlink(temporary);
+    }
+    free(temporary);
+    return result;
+}
+
+void dh_ReleaseTable(DhTable** table) {
+    if (table == NULL || *table == NULL) {
+        return;
+    }
+    if ((*table)->mapped) {
+        munmap((void*) (*table)->image, (*table)->size);
+    } else {
+        free((void*) (*table)->image);
+    }
+    free(*table);
+    *table = NULL;
+}
+
+int dh_GetTableWindows(const DhTable* table) {
+    return WindowCount(table->image->moduleLength, table->image->windowBits);
+}
+
+int dh_GetExponentDigit(const DhTable* table, const uint8_t* exponent, int window) {
+    int windowBits = table->image->windowBits;
+    int bit = window * windowBits;
+    int byte = bit / 8;
+    //digit may span two bytes when windowBits doesn't divide 8
+    unsigned int bits = exponent[byte];
+    if (byte + 1 < (int) table->image->moduleLength) {
+        bits |= (unsigned int) exponent[byte + 1] << 8;
+    }
+    return (bits >> (bit % 8)) & ((1u << windowBits) - 1);
+}
+
+const uint8_t* dh_GetTableEntry(const DhTable* table, int window, int digit) {
+    int moduleLength = table->image->moduleLength;
+    return table->image->data + moduleLength +
+            (((size_t) window << table->image->windowBits) + digit) * moduleLength;
+}
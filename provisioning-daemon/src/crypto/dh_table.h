@@ -0,0 +1,112 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __DH_TABLE_H__
+#define __DH_TABLE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DH_TABLE_MAGIC          (0x50444454)    /* "PDDT", also rejects files written with other byte order */
+#define DH_TABLE_VERSION        (2)
+
+/** Exponent is consumed one windowBits wide digit per table lookup */
+#define DH_TABLE_MIN_WINDOW_BITS        (1)
+#define DH_TABLE_MAX_WINDOW_BITS        (8)
+#define DH_TABLE_DEFAULT_WINDOW_BITS    (4)
+
+/**
+ * @brief Layout of the table, both in memory and in the file.
+ *
+ * data holds module (moduleLength bytes) followed by entries, entry [window][digit] is
+ * g^(digit * 2^(windowBits * window)) mod module, moduleLength bytes in bigint.c byte order.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t moduleLength;
+    uint32_t g;
+    uint32_t windowBits;
+    uint8_t checksum[32];       /**< SHA-256 of data */
+    uint8_t data[];
+} DhTableImage;
+
+/**
+ * @brief Fixed-base table of generator g, either computed or mapped read-only from a file.
+ */
+typedef struct {
+    const DhTableImage* image;
+    size_t size;
+    bool mapped;                /**< image is mmap()ed, otherwise allocated */
+} DhTable;
+
+/**
+ * @brief Compute table for given module and generator, 2^windowBits - 1 modular multiplications per exponent digit.
+ * Wider window means fewer multiplications per exponentiation, but table grows exponentially.
+ * @return table or NULL if windowBits is out of range
+ */
+DhTable* dh_BuildTable(const uint8_t* module, int moduleLength, int g, int windowBits);
+
+/**
+ * @brief Map table saved by dh_SaveTable. Pages are shared by every process mapping the same file.
+ * @return table or NULL if file is missing, corrupted or was computed for other version, module, generator or
+ * window
+ */
+DhTable* dh_LoadTable(const char* path, const uint8_t* module, int moduleLength, int g, int windowBits);
+
+/**
+ * @brief Write table to temporary file and rename it over path, so readers never see partial file.
+ */
+bool dh_SaveTable(const DhTable* table, const char* path);
+
+void dh_ReleaseTable(DhTable** table);
+
+/**
+ * @brief Check that table was computed for given module and generator.
+ */
+bool dh_TableMatches(const DhTable* table, const uint8_t* module, int moduleLength, int g);
+
+/**
+ * @brief Number of exponent digits, i.e. table rows.
+ */
+int dh_GetTableWindows(const DhTable* table);
+
+/**
+ * @brief Digit of exponent (moduleLength bytes in bigint.c byte order) looked up in given table row.
+ */
+int dh_GetExponentDigit(const DhTable* table, const uint8_t* exponent, int window);
+
+/**
+ * @brief g^(digit * 2^(windowBits * window)) mod module.
+ */
+const uint8_t* dh_GetTableEntry(const DhTable* table, int window, int digit);
+
+#endif
@@ -29,39 +29,64 @@
  */
 
 #include "diffie_hellman_keys_exchanger.h"
+#include "wipe.h"
+#include <limits.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
 
+static unsigned int _WorstStepTime = 0;
+static const DhTable* _FixedBaseTable = NULL;
+
+static unsigned long long GetTimeUs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+bool dh_InitKeyExchanger(DiffieHellmanKeysExchanger* exchanger, const char* buffer, int PModuleLength,
+        int pCryptoGModule, Randomizer rand) {
+    if (PModuleLength > DH_MAX_MODULE_LENGTH) {
+        return false;
+    }
+    memset(exchanger, 0, sizeof(*exchanger));
+    exchanger->pModuleLength = PModuleLength;
+    if (buffer) {
+        memcpy(exchanger->pCryptoPModule, buffer, PModuleLength);
+    }
+    exchanger->pCryptoGModule = pCryptoGModule;
+    exchanger->randomizer = rand;
+    exchanger->pending = DhExchange_NONE;
+    return true;
+}
+
+void dh_ClearKeyExchanger(DiffieHellmanKeysExchanger* exchanger) {
+    dh_CancelExchange(exchanger);
+    crypto_Wipe(exchanger->x, sizeof(exchanger->x));
+    exchanger->hasX = false;
+    exchanger->randomizer = NULL;
+}
+
 DiffieHellmanKeysExchanger* dh_NewKeyExchanger(char* buffer, int PModuleLength, int pCryptoGModule, Randomizer rand) {
 
     DiffieHellmanKeysExchanger* result = malloc(sizeof(DiffieHellmanKeysExchanger));
-    result->pModuleLength = PModuleLength;
-    result->pCryptoPModule = malloc(PModuleLength);
-    if (buffer) {
-        memcpy(result->pCryptoPModule, buffer, PModuleLength);
+    if (!dh_InitKeyExchanger(result, buffer, PModuleLength, pCryptoGModule, rand)) {
+        free(result);
+        return NULL;
     }
-    result->pCryptoGModule = pCryptoGModule;
-    result->x = NULL;
-    result->randomizer = rand;
     return result;
 }
 
 void dh_Release(DiffieHellmanKeysExchanger** exchanger) {
-    if (exchanger) {
-        free((*exchanger)->pCryptoPModule);
-        (*exchanger)->pCryptoPModule = NULL;
-        if ((*exchanger)->x) {
-            bi_Release(&(*exchanger)->x);
-        }
-        (*exchanger)->randomizer = NULL;
+    if (exchanger && *exchanger) {
+        dh_ClearKeyExchanger(*exchanger);
         free(*exchanger);
         *exchanger = NULL;
     }
 }
 
 void dh_InvertBinary(unsigned char* binary, int length) {
-    size_t i;
+    int i;
     for (i = 0; i < length / 2; ++i) {
         char tmp = binary[i];
         binary[i] = binary[length - i - 1];
@@ -69,73 +94,210 @@ void dh_InvertBinary(unsigned char* binary, int length) {
     }
 }
 
-BigInt* dh_ApowBmodN(BigInt* a, BigInt* b, BigInt* n, int len) {
-    BigInt* result = bi_CreateFromLong(1, len);
-    BigInt* counter = bi_Clone(b);
-    BigInt* base = bi_Clone(a);
-    BigInt* ZERO = bi_Create(NULL, len);
-    BigInt* ONE = bi_CreateFromLong(1, len);
-    BigInt* TWO = bi_CreateFromLong(2, len);
-    while (!bi_Equal(counter, ZERO)) {
-        if (bi_IsEvenNumber(counter)) {
-            bi_Divide(counter, TWO);
-            bi_MultiplyAmodB(base, base, n);
-        } else {
-            bi_Sub(counter, ONE);
-            bi_MultiplyAmodB(result, base, n);
-        }
+static DhModExp* ModExpBegin(BigInt* a, BigInt* b, BigInt* n, int len) {
+    DhModExp* modExp = malloc(sizeof(DhModExp));
+    modExp->result = bi_CreateFromLong(1, len);
+    modExp->counter = bi_Clone(b);
+    modExp->base = bi_Clone(a);
+    modExp->modulus = bi_Clone(n);
+    modExp->zero = bi_Create(NULL, len);
+    modExp->one = bi_CreateFromLong(1, len);
+    modExp->two = bi_CreateFromLong(2, len);
+    modExp->table = NULL;
+    modExp->window = 0;
+    return modExp;
+}
+
+/**
+ * Multiply result by table entry of next exponent digit, counter is zeroed after the last digit.
+ */
+static bool ModExpTableStep(DhModExp* modExp) {
+    int length = modExp->counter->length;
+    int windows = dh_GetTableWindows(modExp->table);
+    if (modExp->window >= windows) {
+        return false;
+    }
+    int window = modExp->window++;
+    int digit = dh_GetExponentDigit(modExp->table, modExp->counter->buffer, window);
+    if (digit != 0) {
+        memcpy(modExp->base->buffer, dh_GetTableEntry(modExp->table, window, digit), length);
+        bi_MultiplyAmodB(modExp->result, modExp->base, modExp->modulus);
     }
-    bi_Release(&counter);
-    bi_Release(&base);
-    bi_Release(&TWO);
-    bi_Release(&ONE);
-    bi_Release(&ZERO);
+    if (modExp->window == windows) {
+        bi_Assign(modExp->counter, modExp->zero);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Single square-or-multiply step, returns false when exponentiation is finished.
+ */
+static bool ModExpStep(DhModExp* modExp) {
+    if (modExp->table) {
+        return ModExpTableStep(modExp);
+    }
+    if (bi_Equal(modExp->counter, modExp->zero)) {
+        return false;
+    }
+    if (bi_IsEvenNumber(modExp->counter)) {
+        bi_Divide(modExp->counter, modExp->two);
+        bi_MultiplyAmodB(modExp->base, modExp->base, modExp->modulus);
+    } else {
+        bi_Sub(modExp->counter, modExp->one);
+        bi_MultiplyAmodB(modExp->result, modExp->base, modExp->modulus);
+    }
+    return !bi_Equal(modExp->counter, modExp->zero);
+}
+
+static void ModExpRelease(DhModExp** modExp) {
+    //counter is what is left of private exponent and result of COMPLETE is shared secret, free() doesn't clear them
+    crypto_Wipe((*modExp)->counter->buffer, (*modExp)->counter->length);
+    bi_Release(&(*modExp)->counter);
+    bi_Release(&(*modExp)->base);
+    bi_Release(&(*modExp)->modulus);
+    bi_Release(&(*modExp)->two);
+    bi_Release(&(*modExp)->one);
+    bi_Release(&(*modExp)->zero);
+    if ((*modExp)->result) {
+        crypto_Wipe((*modExp)->result->buffer, (*modExp)->result->length);
+        bi_Release(&(*modExp)->result);
+    }
+    free(*modExp);
+    *modExp = NULL;
+}
+
+BigInt* dh_ApowBmodN(BigInt* a, BigInt* b, BigInt* n, int len) {
+    DhModExp* modExp = ModExpBegin(a, b, n, len);
+    while (ModExpStep(modExp))
+        ;
+    BigInt* result = modExp->result;
+    modExp->result = NULL;
+    ModExpRelease(&modExp);
     return result;
 }
 
-unsigned char* dh_GenerateExchangeData(DiffieHellmanKeysExchanger* exchanger) {
-    BigInt* g = bi_CreateFromLong(exchanger->pCryptoGModule, exchanger->pModuleLength);
-    BigInt* p = bi_Create(exchanger->pCryptoPModule, exchanger->pModuleLength);
+void dh_CancelExchange(DiffieHellmanKeysExchanger* exchanger) {
+    if (exchanger->modExp) {
+        ModExpRelease(&exchanger->modExp);
+    }
+    exchanger->pending = DhExchange_NONE;
+}
+
+bool dh_BeginGenerateExchangeData(DiffieHellmanKeysExchanger* exchanger) {
+    dh_CancelExchange(exchanger);
     int length = exchanger->pModuleLength;
-    unsigned char xBuff[length];
-    if (!exchanger->randomizer(xBuff, length)) {
-        return NULL;
+    exchanger->hasX = false;
+    if (!exchanger->randomizer(exchanger->x, length)) {
+        return false;
     }
-    dh_InvertBinary(xBuff, length);
-    exchanger->x = bi_Create(xBuff, length);
-    BigInt* y = bi_CreateFromLong(0, length);
-    BigInt* i69h = dh_ApowBmodN(g, exchanger->x, p, length);
-    bi_Assign(y, i69h);
-    bi_Release(&i69h);
-    unsigned char* result = malloc(length);
-    memcpy(result, y->buffer, length);
-    bi_Release(&y);
+    dh_InvertBinary(exchanger->x, length);
+    exchanger->hasX = true;
+
+    BigInt x = { length, exchanger->x };
+    BigInt* g = bi_CreateFromLong(exchanger->pCryptoGModule, length);
+    BigInt* p = bi_Create(exchanger->pCryptoPModule, length);
+    exchanger->modExp = ModExpBegin(g, &x, p, length);
+    if (_FixedBaseTable && dh_TableMatches(_FixedBaseTable, exchanger->pCryptoPModule, length, exchanger->pCryptoGModule)) {
+        exchanger->modExp->table = _FixedBaseTable;
+    }
+    exchanger->pending = DhExchange_GENERATE;
     bi_Release(&p);
     bi_Release(&g);
+    return true;
+}
+
+bool dh_BeginCompleteExchangeData(DiffieHellmanKeysExchanger* exchanger, unsigned char* externalData,
+        int dataLength) {
+    if (!exchanger->hasX || exchanger->pending == DhExchange_GENERATE || dataLength < 0 ||
+            exchanger->pModuleLength > (unsigned int) dataLength) {
+        return false;
+    }
+    dh_CancelExchange(exchanger);
+
+    int length = exchanger->pModuleLength;
+    BigInt x = { length, exchanger->x };
+    BigInt* p = bi_Create(exchanger->pCryptoPModule, length);
+    BigInt* extData = bi_Create(externalData, dataLength);
+    exchanger->modExp = ModExpBegin(extData, &x, p, length);
+    exchanger->pending = DhExchange_COMPLETE;
+    bi_Release(&extData);
+    bi_Release(&p);
+    return true;
+}
+
+DhStepResult dh_StepExchange(DiffieHellmanKeysExchanger* exchanger, unsigned int budgetUs) {
+    if (exchanger->modExp == NULL) {
+        return DhStepResult_ERROR;
+    }
+
+    unsigned long long start = GetTimeUs();
+    unsigned long long stepStart = start;
+    bool stepsLeft = true;
+    while (stepsLeft) {
+        stepsLeft = ModExpStep(exchanger->modExp);
+
+        unsigned long long now = GetTimeUs();
+        if (now - stepStart > _WorstStepTime) {
+            _WorstStepTime = now - stepStart;
+        }
+        if (now - start >= budgetUs) {
+            break;
+        }
+        stepStart = now;
+    }
+    return stepsLeft ? DhStepResult_IN_PROGRESS : DhStepResult_DONE;
+}
+
+bool dh_TakeExchangeResultInto(DiffieHellmanKeysExchanger* exchanger, unsigned char* result) {
+    DhModExp* modExp = exchanger->modExp;
+    if (modExp == NULL || !bi_Equal(modExp->counter, modExp->zero)) {
+        return false;
+    }
 
+    memcpy(result, modExp->result->buffer, exchanger->pModuleLength);
+    dh_CancelExchange(exchanger);
+    return true;
+}
+
+unsigned char* dh_TakeExchangeResult(DiffieHellmanKeysExchanger* exchanger) {
+    unsigned char* result = malloc(exchanger->pModuleLength);
+    if (!dh_TakeExchangeResultInto(exchanger, result)) {
+        free(result);
+        return NULL;
+    }
     return result;
 }
 
-unsigned char* dh_CompleteExchangeData(DiffieHellmanKeysExchanger* exchanger, unsigned char* externalData,
-        int dataLength) {
-    if (exchanger->pModuleLength <= dataLength) {
+void dh_SetFixedBaseTable(const DhTable* table) {
+    _FixedBaseTable = table;
+}
+
+const DhTable* dh_GetFixedBaseTable(void) {
+    return _FixedBaseTable;
+}
 
-        int length = exchanger->pModuleLength;
-        BigInt* p = bi_Create(exchanger->pCryptoPModule, exchanger->pModuleLength);
-        BigInt* extData = bi_Create(externalData, dataLength);
-        BigInt* y = bi_CreateFromLong(0, length);
-        BigInt* i69h = dh_ApowBmodN(extData, exchanger->x, p, length);
-        bi_Assign(y, i69h);
-        bi_Release(&i69h);
+unsigned int dh_GetWorstStepTime(void) {
+    return _WorstStepTime;
+}
 
-        unsigned char* result = malloc(length);
-        memcpy(result, y->buffer, length);
+static unsigned char* RunExchange(DiffieHellmanKeysExchanger* exchanger) {
+    while (dh_StepExchange(exchanger, UINT_MAX) == DhStepResult_IN_PROGRESS)
+        ;
+    return dh_TakeExchangeResult(exchanger);
+}
 
-        bi_Release(&y);
-        bi_Release(&extData);
-        bi_Release(&p);
-        return result;
+unsigned char* dh_GenerateExchangeData(DiffieHellmanKeysExchanger* exchanger) {
+    if (!dh_BeginGenerateExchangeData(exchanger)) {
+        return NULL;
     }
+    return RunExchange(exchanger);
+}
 
-    return NULL;
+unsigned char* dh_CompleteExchangeData(DiffieHellmanKeysExchanger* exchanger, unsigned char* externalData,
+        int dataLength) {
+    if (!dh_BeginCompleteExchangeData(exchanger, externalData, dataLength)) {
+        return NULL;
+    }
+    return RunExchange(exchanger);
 }
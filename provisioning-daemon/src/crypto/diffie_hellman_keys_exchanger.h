@@ -32,6 +32,7 @@
 #define __DIFFIE_HELLMAN_KEYS_EXCHANGER_H__
 
 #include "bigint.h"
+#include "dh_table.h"
 
 #include <stdio.h>
 #include <stdbool.h>
@@ -39,21 +40,76 @@
 
 typedef bool (*Randomizer)(unsigned char* array, int length);
 
+/**
+ * \brief Longest module supported by bigint.c, module and private exponent are kept inline in the exchanger.
+ */
+#define DH_MAX_MODULE_LENGTH (32)
+
+/**
+ * \brief Kind of exchange which is being computed step by step.
+ */
+typedef enum {
+  DhExchange_NONE,          /**< nothing pending */
+  DhExchange_GENERATE,      /**< computing g^x mod p, see dh_BeginGenerateExchangeData */
+  DhExchange_COMPLETE       /**< computing y^x mod p, see dh_BeginCompleteExchangeData */
+} DhExchangeType;
+
+/**
+ * \brief Result of dh_StepExchange.
+ */
+typedef enum {
+  DhStepResult_IN_PROGRESS, /**< budget used up, call dh_StepExchange again */
+  DhStepResult_DONE,        /**< result can be taken with dh_TakeExchangeResult */
+  DhStepResult_ERROR        /**< there is no exchange to step */
+} DhStepResult;
+
+/**
+ * \brief State of modular exponentiation kept between dh_StepExchange calls.
+ */
+typedef struct {
+  BigInt* result;
+  BigInt* counter;
+  BigInt* base;
+  BigInt* modulus;
+  BigInt* zero;
+  BigInt* one;
+  BigInt* two;
+  const DhTable* table;     /**< fixed-base table of base, NULL for square-and-multiply */
+  int window;               /**< next exponent digit looked up in table */
+} DhModExp;
+
 typedef struct {
 
-  unsigned char* pCryptoPModule;
+  unsigned char pCryptoPModule[DH_MAX_MODULE_LENGTH];
   unsigned int pModuleLength;
   unsigned int pCryptoGModule;
-  BigInt* x;
+  unsigned char x[DH_MAX_MODULE_LENGTH];  /**< private exponent, valid if hasX */
+  bool hasX;
   Randomizer randomizer;
 
+  DhExchangeType pending;   /**< exchange started by dh_Begin* functions */
+  DhModExp* modExp;         /**< exponentiation state of pending exchange, NULL if none */
+
 } DiffieHellmanKeysExchanger;
 
 /**
  * \brief Create new exchanger.
+ * @return exchanger or NULL if PModuleLength is bigger than DH_MAX_MODULE_LENGTH
  */
 DiffieHellmanKeysExchanger* dh_NewKeyExchanger(char* buffer, int PModuleLength, int pCryptoGModule, Randomizer randomizer);
 
+/**
+ * \brief Initialize exchanger embedded in other struct, it doesn't allocate anything until exchange is started.
+ * @return false if PModuleLength is bigger than DH_MAX_MODULE_LENGTH
+ */
+bool dh_InitKeyExchanger(DiffieHellmanKeysExchanger* exchanger, const char* buffer, int PModuleLength,
+        int pCryptoGModule, Randomizer randomizer);
+
+/**
+ * \brief Cancel pending exchange and wipe private exponent of exchanger initialized by dh_InitKeyExchanger.
+ */
+void dh_ClearKeyExchanger(DiffieHellmanKeysExchanger* exchanger);
+
 /**
  * \brief Release exchanger.
  */
@@ -71,5 +127,61 @@ unsigned char* dh_GenerateExchangeData(DiffieHellmanKeysExchanger* );
  */
 unsigned char* dh_CompleteExchangeData(DiffieHellmanKeysExchanger*, unsigned char* externalData, int dataLength);
 
+/**
+ * \brief Start generating exchange key, the work is done by subsequent dh_StepExchange calls.
+ * Any exchange already pending on this exchanger is cancelled.
+ * @return false if operation fails
+ */
+bool dh_BeginGenerateExchangeData(DiffieHellmanKeysExchanger*);
+
+/**
+ * \brief Start generating shared key from 2nd party exchange key (externalData), the work is done by subsequent
+ * dh_StepExchange calls. dh_BeginGenerateExchangeData must have finished on this exchanger before.
+ * @return false if operation fails
+ */
+bool dh_BeginCompleteExchangeData(DiffieHellmanKeysExchanger*, unsigned char* externalData, int dataLength);
+
+/**
+ * \brief Perform square-and-multiply steps of pending exchange until budgetUs microseconds are used. At least one
+ * step is always done, so single call may take up to budgetUs + dh_GetWorstStepTime().
+ * @return state of pending exchange after this call
+ */
+DhStepResult dh_StepExchange(DiffieHellmanKeysExchanger*, unsigned int budgetUs);
+
+/**
+ * \brief Take result of finished exchange, caller owns returned buffer (pModuleLength bytes).
+ * @return exchange key / shared key or NULL if exchange didn't finish yet
+ */
+unsigned char* dh_TakeExchangeResult(DiffieHellmanKeysExchanger*);
+
+/**
+ * \brief Like dh_TakeExchangeResult, but result is copied into caller provided buffer (pModuleLength bytes).
+ * @return false if exchange didn't finish yet
+ */
+bool dh_TakeExchangeResultInto(DiffieHellmanKeysExchanger*, unsigned char* result);
+
+/**
+ * \brief Drop pending exchange, if any.
+ */
+void dh_CancelExchange(DiffieHellmanKeysExchanger*);
+
+/**
+ * \brief Install table used by dh_BeginGenerateExchangeData of exchangers with matching module and generator,
+ * g^x mod p then costs one modular multiplication per window of x instead of up to two per bit. Table must stay
+ * valid while exchanges started with it are pending. NULL turns the table off.
+ */
+void dh_SetFixedBaseTable(const DhTable* table);
+
+/**
+ * \brief Table installed by dh_SetFixedBaseTable, NULL if none.
+ */
+const DhTable* dh_GetFixedBaseTable(void);
+
+/**
+ * \brief Longest time (in microseconds) a single square-and-multiply step took so far, in all exchangers.
+ * This is the amount by which dh_StepExchange may overrun its budget.
+ */
+unsigned int dh_GetWorstStepTime(void);
+
 
 #endif /* __DIFFIEHELLMANKEYSEXCHANGER_h__ */
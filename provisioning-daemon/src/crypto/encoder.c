@@ -30,57 +30,87 @@
 
 #include "encoder.h"
 #include "rijndael.h"
+#include "wipe.h"
 #include <string.h>
 #include <stdlib.h>
 
-uint8_t* softap_EncodeBytes(uint8_t* src, uint8_t len, uint8_t* key, uint8_t* outputSize) {
-    uint8_t IV[16];
+/**
+ * Blocks whitened ahead of each aes_Encrypt call, small enough to stay in cache while the cipher runs over them.
+ */
+#define ENCODE_CHUNK_BLOCKS (16)
+
+void softap_SetKey(SoftapKey* key, const uint8_t* sharedKey) {
     int t;
     for (t = 0; t < 15; t++) { //spare the last byte
-        IV[t] = key[15 - t];
+        key->iv[t] = sharedKey[15 - t];
     }
+    key->iv[15] = 0;
+    aes_SetKey(&key->aesKey, NULL, sharedKey);
+}
 
-    int paddedSize = (len / 16) * 16;
-    if (paddedSize < len) {
-        paddedSize += 16;
-    }
-    *outputSize = paddedSize;
-
-    uint8_t* result = malloc(paddedSize);
+void softap_WipeKey(SoftapKey* key) {
+    crypto_Wipe(key->iv, AES_BLOCK_SIZE);
+    aes_WipeKey(&key->aesKey);
+}
 
-    rijndael_ctx ctx;
-    rijndael_set_key(&ctx, key, 128);
+size_t softap_GetEncodedSize(size_t len) {
+    return (len + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+}
 
+void softap_EncodeInto(const uint8_t* src, size_t len, uint8_t* dst, const SoftapKey* key) {
+    size_t blocks = softap_GetEncodedSize(len) / AES_BLOCK_SIZE;
+    size_t block, chunk, count, pos;
     int y;
-    for (t = 0; t < paddedSize; t += 16) {
-        IV[15] = t / 16;
-        for (y = 0; y < 16; y++) {
-            src[t + y] ^= IV[y];
+
+    for (chunk = 0; chunk < blocks; chunk += count) {
+        count = blocks - chunk < ENCODE_CHUNK_BLOCKS ? blocks - chunk : ENCODE_CHUNK_BLOCKS;
+        for (block = chunk; block < chunk + count; block++) {
+            pos = block * AES_BLOCK_SIZE;
+            for (y = 0; y < AES_BLOCK_SIZE; y++, pos++) {
+                dst[pos] = (pos < len ? src[pos] : 0) ^ key->iv[y];
+            }
+            dst[pos - 1] ^= (uint8_t) block; //counter wraps every 256 blocks, as in the original format
         }
-        rijndael_encrypt(&ctx, src + t, result + t);
+        aes_Encrypt(&key->aesKey, dst + chunk * AES_BLOCK_SIZE, dst + chunk * AES_BLOCK_SIZE, count);
     }
-
-    return result;
 }
 
-void softap_DecodeBytes(uint8_t* data, uint8_t len, uint8_t* key_n_iv) {
-    uint8_t IV[16];
-    int t;
-    for (t = 0; t < 15; t++) { //spare the last byte
-        IV[t] = key_n_iv[16 + t];
-    }
-
-    rijndael_ctx ctx;
-    rijndael_set_key(&ctx, key_n_iv, 128);
+void softap_DecodeInto(const uint8_t* src, size_t len, uint8_t* dst, const uint8_t* key_n_iv) {
+    aes_u32 schedule[4 * (AES_MAXROUNDS + 1)];
+    size_t blocks = len / AES_BLOCK_SIZE;
+    size_t block, chunk, count, pos;
+    int rounds, y;
 
-    uint8_t tmp[16];
-    int y;
-    for (t = 0; t < len; t += 16) {
-        rijndael_decrypt(&ctx, data + t, tmp);
-        IV[15] = t / 16;
-        for (y = 0; y < 16; y++) {
-            tmp[y] ^= IV[y];
+    rounds = rijndaelKeySetupDec(schedule, key_n_iv, 128);
+    for (chunk = 0; chunk < blocks; chunk += count) {
+        count = blocks - chunk < ENCODE_CHUNK_BLOCKS ? blocks - chunk : ENCODE_CHUNK_BLOCKS;
+        rijndaelDecryptBlocks(schedule, rounds, src + chunk * AES_BLOCK_SIZE, dst + chunk * AES_BLOCK_SIZE, count);
+        for (block = chunk; block < chunk + count; block++) {
+            pos = block * AES_BLOCK_SIZE;
+            for (y = 0; y < AES_BLOCK_SIZE - 1; y++) { //spare the last byte
+                dst[pos + y] ^= key_n_iv[16 + y];
+            }
+            dst[pos + y] ^= (uint8_t) block;
         }
-        memcpy(data + t, tmp, 16);
     }
 }
+
+uint8_t* softap_EncodeBytesWithKey(uint8_t* src, uint8_t len, const SoftapKey* key, uint8_t* outputSize) {
+    size_t encodedSize = softap_GetEncodedSize(len);
+    *outputSize = encodedSize;
+    uint8_t* result = malloc(encodedSize);
+    softap_EncodeInto(src, len, result, key);
+    return result;
+}
+
+uint8_t* softap_EncodeBytes(uint8_t* src, uint8_t len, uint8_t* key, uint8_t* outputSize) {
+    SoftapKey softapKey;
+    softap_SetKey(&softapKey, key);
+    uint8_t* result = softap_EncodeBytesWithKey(src, len, &softapKey, outputSize);
+    softap_WipeKey(&softapKey);
+    return result;
+}
+
+void softap_DecodeBytes(uint8_t* data, uint8_t len, uint8_t* key_n_iv) {
+    softap_DecodeInto(data, len, data, key_n_iv);
+}
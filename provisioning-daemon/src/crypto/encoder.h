@@ -28,16 +28,68 @@
  * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef __SOFTAP_CRYPTO__
 #define __SOFTAP_CRYPTO__
 
+#include "aes_backend.h"
+
 #define WITH_AES_DECRYPT 1
 
 /**
- * @brief Allocate result buffer and encode given source bufffer. Rijndael AES128 in CTR mode is used.
- * @param[in] src buffer to encode, data inside will be changed!
+ * @brief Encryption key prepared once per session, so it can be reused for every payload.
+ */
+typedef struct {
+    AesKey aesKey;                  /**< encrypt only key schedule */
+    uint8_t iv[AES_BLOCK_SIZE];     /**< IV derived from the key, last byte is replaced by block counter */
+} SoftapKey;
+
+/**
+ * @brief Expand key for softap_EncodeBytesWithKey.
+ * @param[out] key prepared key, should be wiped with softap_WipeKey when not needed anymore
+ * @param[in] sharedKey key used in encryption, 16 bytes long
+ */
+void softap_SetKey(SoftapKey* key, const uint8_t* sharedKey);
+
+/**
+ * @brief Erase prepared key.
+ */
+void softap_WipeKey(SoftapKey* key);
+
+/**
+ * @brief Size of encoded data for given payload length, rounded up to whole AES blocks.
+ */
+size_t softap_GetEncodedSize(size_t len);
+
+/**
+ * @brief Encode payload into caller provided buffer, without allocating. Rijndael AES128 in CTR mode is used, last
+ * partial block is padded with zeros. Source is left untouched and src may be the same buffer as dst.
+ * @param[in] src buffer to encode
+ * @param[in] len size of source buffer
+ * @param[out] dst buffer for encoded data, at least softap_GetEncodedSize(len) bytes long
+ * @param[in] key key prepared by softap_SetKey
+ */
+void softap_EncodeInto(const uint8_t* src, size_t len, uint8_t* dst, const SoftapKey* key);
+
+/**
+ * @brief Decode data encoded by softap_EncodeInto into caller provided buffer, src may be the same buffer as dst.
+ * @param[in] src encrypted data to decode
+ * @param[in] len size of encrypted data, trailing bytes after the last whole block are ignored
+ * @param[out] dst buffer for decoded data, at least len bytes long
+ * @param[in] key_n_iv Key used in encryption, it should be 32 bytes long
+ */
+void softap_DecodeInto(const uint8_t* src, size_t len, uint8_t* dst, const uint8_t* key_n_iv);
+
+/**
+ * @brief Same as softap_EncodeBytes, but with key prepared by softap_SetKey.
+ */
+uint8_t* softap_EncodeBytesWithKey(uint8_t* src, uint8_t len, const SoftapKey* key, uint8_t* outputSize);
+
+/**
+ * @brief Allocate result buffer and encode given source bufffer, see softap_EncodeInto.
+ * @param[in] src buffer to encode
  * @param[in] len size of source buffer
  * @param[in] key_n_iv Key used in encryption, it should be 32 bytes long
  * @param[out] outputSize size of returned encrypted buffer
@@ -0,0 +1,127 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "random.h"
+#include "wipe.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+typedef struct {
+    unsigned char bytes[RNG_POOL_SIZE];
+    int available;                  /**< unread bytes, at the end of bytes */
+} RngPool;
+
+static __thread RngPool _Pool;
+
+static pthread_once_t _AtForkOnce = PTHREAD_ONCE_INIT;
+
+static bool ReadUrandom(unsigned char* buffer, size_t length) {
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    while (length > 0) {
+        ssize_t count = read(fd, buffer, length);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            close(fd);
+            return false;
+        }
+        buffer += count;
+        length -= count;
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * getrandom() blocks only until the kernel pool is initialised after boot. Kernels older than 3.17 don't have it,
+ * /dev/urandom is used then.
+ */
+static bool ReadKernel(unsigned char* buffer, size_t length) {
+#ifdef SYS_getrandom
+    while (length > 0) {
+        long count = syscall(SYS_getrandom, buffer, length, 0);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == ENOSYS ? ReadUrandom(buffer, length) : false;
+        }
+        buffer += count;
+        length -= count;
+    }
+    return true;
+#else
+    return ReadUrandom(buffer, length);
+#endif
+}
+
+static void RegisterAtFork(void) {
+    //only the forking thread exists in the child, its pool is the one that could be used there
+    pthread_atfork(NULL, NULL, rng_WipePool);
+}
+
+bool rng_GetBytes(unsigned char* array, int length) {
+    if (array == NULL || length < 0) {
+        return false;
+    }
+    pthread_once(&_AtForkOnce, RegisterAtFork);
+
+    if (length > RNG_POOL_SIZE) {
+        return ReadKernel(array, length);
+    }
+    if (_Pool.available < length) {
+        _Pool.available = 0;
+        if (!ReadKernel(_Pool.bytes, RNG_POOL_SIZE)) {
+            crypto_Wipe(_Pool.bytes, RNG_POOL_SIZE);
+            return false;
+        }
+        _Pool.available = RNG_POOL_SIZE;
+    }
+
+    unsigned char* start = _Pool.bytes + RNG_POOL_SIZE - _Pool.available;
+    memcpy(array, start, length);
+    crypto_Wipe(start, length);
+    _Pool.available -= length;
+    return true;
+}
+
+void rng_WipePool(void) {
+    crypto_Wipe(_Pool.bytes, RNG_POOL_SIZE);
+    _Pool.available = 0;
+}
@@ -0,0 +1,56 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __RANDOM_H__
+#define __RANDOM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Bytes fetched from the kernel per refill, one refill serves many DH private exponents */
+#define RNG_POOL_SIZE           (512)
+
+/**
+ * @brief Fill array with bytes from the kernel CSPRNG. Small requests are served from a per-thread pool refilled in
+ * bulk with getrandom(), so most calls don't enter the kernel. Bytes are erased from the pool once handed out and the
+ * pool is wiped in a forked child, so no two callers ever get the same bytes. Signature matches Randomizer, so it can
+ * be passed to dh_NewKeyExchanger directly.
+ * @param[out] array buffer to fill
+ * @param[in] length number of bytes to generate
+ * @return false if kernel failed to provide random data, array content is undefined then
+ */
+bool rng_GetBytes(unsigned char* array, int length);
+
+/**
+ * @brief Erase unread bytes of calling thread's pool, e.g. before the thread exits.
+ */
+void rng_WipePool(void);
+
+#endif
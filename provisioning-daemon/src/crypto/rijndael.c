@@ -1043,6 +1043,83 @@ rijndaelEncrypt(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 pt[16],
 	PUTU32(ct + 12, s3);
 }
 
+/*
+ * Multi-block paths: two independent blocks are carried through the rounds
+ * together, so the table lookups of one block fill the load delay of the
+ * other on in-order cores. Both states plus their next round still fit in
+ * the MIPS32 register file, wider interleaving would spill to the stack.
+ */
+#define ENC_ROUND(t0, t1, t2, t3, s0, s1, s2, s3, k) do { \
+	t0 = Te0[s0 >> 24] ^ Te1[(s1 >> 16) & 0xff] ^ \
+	    Te2[(s2 >> 8) & 0xff] ^ Te3[s3 & 0xff] ^ (k)[0]; \
+	t1 = Te0[s1 >> 24] ^ Te1[(s2 >> 16) & 0xff] ^ \
+	    Te2[(s3 >> 8) & 0xff] ^ Te3[s0 & 0xff] ^ (k)[1]; \
+	t2 = Te0[s2 >> 24] ^ Te1[(s3 >> 16) & 0xff] ^ \
+	    Te2[(s0 >> 8) & 0xff] ^ Te3[s1 & 0xff] ^ (k)[2]; \
+	t3 = Te0[s3 >> 24] ^ Te1[(s0 >> 16) & 0xff] ^ \
+	    Te2[(s1 >> 8) & 0xff] ^ Te3[s2 & 0xff] ^ (k)[3]; \
+} while (0)
+
+#define ENC_LAST(ct, t0, t1, t2, t3, k) do { \
+	PUTU32((ct)     , (Te4[t0 >> 24] & 0xff000000) ^ \
+	    (Te4[(t1 >> 16) & 0xff] & 0x00ff0000) ^ \
+	    (Te4[(t2 >> 8) & 0xff] & 0x0000ff00) ^ \
+	    (Te4[t3 & 0xff] & 0x000000ff) ^ (k)[0]); \
+	PUTU32((ct) +  4, (Te4[t1 >> 24] & 0xff000000) ^ \
+	    (Te4[(t2 >> 16) & 0xff] & 0x00ff0000) ^ \
+	    (Te4[(t3 >> 8) & 0xff] & 0x0000ff00) ^ \
+	    (Te4[t0 & 0xff] & 0x000000ff) ^ (k)[1]); \
+	PUTU32((ct) +  8, (Te4[t2 >> 24] & 0xff000000) ^ \
+	    (Te4[(t3 >> 16) & 0xff] & 0x00ff0000) ^ \
+	    (Te4[(t0 >> 8) & 0xff] & 0x0000ff00) ^ \
+	    (Te4[t1 & 0xff] & 0x000000ff) ^ (k)[2]); \
+	PUTU32((ct) + 12, (Te4[t3 >> 24] & 0xff000000) ^ \
+	    (Te4[(t0 >> 16) & 0xff] & 0x00ff0000) ^ \
+	    (Te4[(t1 >> 8) & 0xff] & 0x0000ff00) ^ \
+	    (Te4[t2 & 0xff] & 0x000000ff) ^ (k)[3]); \
+} while (0)
+
+/*
+ * Encrypt consecutive blocks. in and out may be the same buffer, both
+ * blocks of a pair are loaded before any of them is written back.
+ */
+void
+rijndaelEncryptBlocks(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr,
+    const aes_u8 *in, aes_u8 *out, size_t blocks)
+{
+	aes_u32 s0, s1, s2, s3, t0, t1, t2, t3;
+	aes_u32 u0, u1, u2, u3, v0, v1, v2, v3;
+	const aes_u32 *k;
+	int r;
+
+	for (; blocks >= 2; blocks -= 2) {
+		k = rk;
+		s0 = GETU32(in     ) ^ k[0];
+		s1 = GETU32(in +  4) ^ k[1];
+		s2 = GETU32(in +  8) ^ k[2];
+		s3 = GETU32(in + 12) ^ k[3];
+		u0 = GETU32(in + 16) ^ k[0];
+		u1 = GETU32(in + 20) ^ k[1];
+		u2 = GETU32(in + 24) ^ k[2];
+		u3 = GETU32(in + 28) ^ k[3];
+		for (r = Nr >> 1; ; ) {
+			ENC_ROUND(t0, t1, t2, t3, s0, s1, s2, s3, k + 4);
+			ENC_ROUND(v0, v1, v2, v3, u0, u1, u2, u3, k + 4);
+			k += 8;
+			if (--r == 0)
+				break;
+			ENC_ROUND(s0, s1, s2, s3, t0, t1, t2, t3, k);
+			ENC_ROUND(u0, u1, u2, u3, v0, v1, v2, v3, k);
+		}
+		ENC_LAST(out, t0, t1, t2, t3, k);
+		ENC_LAST(out + 16, v0, v1, v2, v3, k);
+		in += 32;
+		out += 32;
+	}
+	if (blocks > 0)
+		rijndaelEncrypt(rk, Nr, in, out);
+}
+
 #ifdef WITH_AES_DECRYPT
 static void
 rijndaelDecrypt(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 ct[16],
@@ -1227,6 +1304,77 @@ rijndaelDecrypt(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 ct[16],
    		rk[3];
 	PUTU32(pt + 12, s3);
 }
+
+#define DEC_ROUND(t0, t1, t2, t3, s0, s1, s2, s3, k) do { \
+	t0 = Td0[s0 >> 24] ^ Td1[(s3 >> 16) & 0xff] ^ \
+	    Td2[(s2 >> 8) & 0xff] ^ Td3[s1 & 0xff] ^ (k)[0]; \
+	t1 = Td0[s1 >> 24] ^ Td1[(s0 >> 16) & 0xff] ^ \
+	    Td2[(s3 >> 8) & 0xff] ^ Td3[s2 & 0xff] ^ (k)[1]; \
+	t2 = Td0[s2 >> 24] ^ Td1[(s1 >> 16) & 0xff] ^ \
+	    Td2[(s0 >> 8) & 0xff] ^ Td3[s3 & 0xff] ^ (k)[2]; \
+	t3 = Td0[s3 >> 24] ^ Td1[(s2 >> 16) & 0xff] ^ \
+	    Td2[(s1 >> 8) & 0xff] ^ Td3[s0 & 0xff] ^ (k)[3]; \
+} while (0)
+
+#define DEC_LAST(pt, t0, t1, t2, t3, k) do { \
+	PUTU32((pt)     , (Td4[t0 >> 24] & 0xff000000) ^ \
+	    (Td4[(t3 >> 16) & 0xff] & 0x00ff0000) ^ \
+	    (Td4[(t2 >> 8) & 0xff] & 0x0000ff00) ^ \
+	    (Td4[t1 & 0xff] & 0x000000ff) ^ (k)[0]); \
+	PUTU32((pt) +  4, (Td4[t1 >> 24] & 0xff000000) ^ \
+	    (Td4[(t0 >> 16) & 0xff] & 0x00ff0000) ^ \
+	    (Td4[(t3 >> 8) & 0xff] & 0x0000ff00) ^ \
+	    (Td4[t2 & 0xff] & 0x000000ff) ^ (k)[1]); \
+	PUTU32((pt) +  8, (Td4[t2 >> 24] & 0xff000000) ^ \
+	    (Td4[(t1 >> 16) & 0xff] & 0x00ff0000) ^ \
+	    (Td4[(t0 >> 8) & 0xff] & 0x0000ff00) ^ \
+	    (Td4[t3 & 0xff] & 0x000000ff) ^ (k)[2]); \
+	PUTU32((pt) + 12, (Td4[t3 >> 24] & 0xff000000) ^ \
+	    (Td4[(t2 >> 16) & 0xff] & 0x00ff0000) ^ \
+	    (Td4[(t1 >> 8) & 0xff] & 0x0000ff00) ^ \
+	    (Td4[t0 & 0xff] & 0x000000ff) ^ (k)[3]); \
+} while (0)
+
+/*
+ * Decrypt consecutive blocks, the counterpart of rijndaelEncryptBlocks.
+ */
+void
+rijndaelDecryptBlocks(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr,
+    const aes_u8 *in, aes_u8 *out, size_t blocks)
+{
+	aes_u32 s0, s1, s2, s3, t0, t1, t2, t3;
+	aes_u32 u0, u1, u2, u3, v0, v1, v2, v3;
+	const aes_u32 *k;
+	int r;
+
+	for (; blocks >= 2; blocks -= 2) {
+		k = rk;
+		s0 = GETU32(in     ) ^ k[0];
+		s1 = GETU32(in +  4) ^ k[1];
+		s2 = GETU32(in +  8) ^ k[2];
+		s3 = GETU32(in + 12) ^ k[3];
+		u0 = GETU32(in + 16) ^ k[0];
+		u1 = GETU32(in + 20) ^ k[1];
+		u2 = GETU32(in + 24) ^ k[2];
+		u3 = GETU32(in + 28) ^ k[3];
+		for (r = Nr >> 1; ; ) {
+			DEC_ROUND(t0, t1, t2, t3, s0, s1, s2, s3, k + 4);
+			DEC_ROUND(v0, v1, v2, v3, u0, u1, u2, u3, k + 4);
+			k += 8;
+			if (--r == 0)
+				break;
+			DEC_ROUND(s0, s1, s2, s3, t0, t1, t2, t3, k);
+			DEC_ROUND(u0, u1, u2, u3, v0, v1, v2, v3, k);
+		}
+		DEC_LAST(out, t0, t1, t2, t3, k);
+		DEC_LAST(out + 16, v0, v1, v2, v3, k);
+		in += 32;
+		out += 32;
+	}
+	if (blocks > 0)
+		rijndaelDecrypt(rk, Nr, in, out);
+}
+
 #endif
 
 /* setup key context for encryption only */
@@ -28,6 +28,7 @@
 #ifndef __RIJNDAEL_H__
 #define __RIJNDAEL_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define WITH_AES_DECRYPT 1
@@ -64,5 +65,9 @@ void	 rijndael_encrypt(rijndael_ctx *, const u_char *, u_char *);
 int	rijndaelKeySetupEnc(aes_u32 rk[/*4*(Nr + 1)*/], const aes_u8 cipherKey[], int keyBits);
 int	rijndaelKeySetupDec(aes_u32 rk[/*4*(Nr + 1)*/], const aes_u8 cipherKey[], int keyBits);
 void	rijndaelEncrypt(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 pt[16], aes_u8 ct[16]);
+void	rijndaelEncryptBlocks(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 *in, aes_u8 *out, size_t blocks);
+#ifdef WITH_AES_DECRYPT
+void	rijndaelDecryptBlocks(const aes_u32 rk[/*4*(Nr + 1)*/], int Nr, const aes_u8 *in, aes_u8 *out, size_t blocks);
+#endif
 
 #endif /* __RIJNDAEL_H */
@@ -0,0 +1,307 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  x25519.c
+ * @brief Constant time X25519 key exchange (RFC 7748). Field elements of GF(2^255 - 19) are kept in ten signed limbs
+ * of alternately 26 and 25 bits, so every product fits 64 bits even on 32-bit MIPS. No branch or memory access depends
+ * on secret data.
+ */
+
+#include "x25519.h"
+#include "sha256.h"
+#include "wipe.h"
+
+#include <string.h>
+
+typedef int64_t Fe[10];
+
+/** a24 = (486662 - 2) / 4 */
+#define A24     (121665)
+
+static int LimbBits(int index) {
+    return (index & 1) ? 25 : 26;
+}
+
+static void FeCarry(Fe h) {
+    int64_t carry;
+    int t;
+    for (t = 0; t < 9; t++) {
+        carry = h[t] >> LimbBits(t);
+        h[t + 1] += carry;
+        h[t] -= carry * ((int64_t) 1 << LimbBits(t));
+    }
+    carry = h[9] >> 25;
+    h[0] += carry * 19;
+    h[9] -= carry * ((int64_t) 1 << 25);
+    carry = h[0] >> 26;
+    h[1] += carry;
+    h[0] -= carry * ((int64_t) 1 << 26);
+}
+
+static void FeCopy(Fe h, const Fe f) {
+    memcpy(h, f, sizeof(Fe));
+}
+
+static void FeSetInt(Fe h, int value) {
+    memset(h, 0, sizeof(Fe));
+    h[0] = value;
+}
+
+static void FeAdd(Fe h, const Fe f, const Fe g) {
+    int t;
+    for (t = 0; t < 10; t++) {
+        h[t] = f[t] + g[t];
+    }
+}
+
+static void FeSub(Fe h, const Fe f, const Fe g) {
+    int t;
+    for (t = 0; t < 10; t++) {
+        h[t] = f[t] - g[t];
+    }
+}
+
+/**
+ * Inputs may be sums or differences of carried elements, limbs below 2^27, so the widest column is below 2^63.
+ */
+static void FeMul(Fe h, const Fe f, const Fe g) {
+    int64_t product[10] = {0};
+    int64_t term;
+    int i, j;
+    for (i = 0; i < 10; i++) {
+        for (j = 0; j < 10; j++) {
+            //limb offsets add up one bit short when both limbs are 25 bits wide
+            term = f[i] * ((i & j & 1) ? 2 * g[j] : g[j]);
+            if (i + j < 10) {
+                product[i + j] += term;
+            } else {
+                product[i + j - 10] += 19 * term;  //2^255 = 19 mod p
+            }
+        }
+    }
+    FeCarry(product);
+    FeCopy(h, product);
+}
+
+static void FeSquare(Fe h, const Fe f) {
+    FeMul(h, f, f);
+}
+
+static void FeSquareTimes(Fe h, const Fe f, int count) {
+    FeSquare(h, f);
+    while (--count > 0) {
+        FeSquare(h, h);
+    }
+}
+
+static void FeMulA24(Fe h, const Fe f) {
+    int t;
+    for (t = 0; t < 10; t++) {
+        h[t] = f[t] * A24;
+    }
+    FeCarry(h);
+}
+
+/**
+ * z^(p - 2) with the usual addition chain, 254 squarings and 11 multiplications.
+ */
+static void FeInvert(Fe out, const Fe z) {
+    Fe z2, z9, z11, z5_0, z10_0, z20_0, z50_0, z100_0, t;
+
+    FeSquare(z2, z);
+    FeSquareTimes(t, z2, 2);
+    FeMul(z9, t, z);
+    FeMul(z11, z9, z2);
+    FeSquare(t, z11);
+    FeMul(z5_0, t, z9);
+    FeSquareTimes(t, z5_0, 5);
+    FeMul(z10_0, t, z5_0);
+    FeSquareTimes(t, z10_0, 10);
+    FeMul(z20_0, t, z10_0);
+    FeSquareTimes(t, z20_0, 20);
+    FeMul(t, t, z20_0);
+    FeSquareTimes(t, t, 10);
+    FeMul(z50_0, t, z10_0);
+    FeSquareTimes(t, z50_0, 50);
+    FeMul(z100_0, t, z50_0);
+    FeSquareTimes(t, z100_0, 100);
+    FeMul(t, t, z100_0);
+    FeSquareTimes(t, t, 50);
+    FeMul(t, t, z50_0);
+    FeSquareTimes(t, t, 5);
+    FeMul(out, t, z11);
+}
+
+static void FeFromBytes(Fe h, const uint8_t* bytes) {
+    int offset = 0;
+    int t, bit;
+    for (t = 0; t < 10; t++) {
+        h[t] = 0;
+        for (bit = 0; bit < LimbBits(t); bit++, offset++) {
+            if (offset < 255) {  //top bit is ignored
+                h[t] |= (int64_t) ((bytes[offset / 8] >> (offset % 8)) & 1) << bit;
+            }
+        }
+    }
+}
+
+/**
+ * Fully reduce modulo p and serialise, h must be carried.
+ */
+static void FeToBytes(uint8_t* bytes, const Fe f) {
+    Fe h;
+    int64_t q, carry;
+    int offset = 0;
+    int t, bit;
+
+    FeCopy(h, f);
+    FeCarry(h);
+    //q = 1 if h >= p, computed from the carry out of h + 19
+    q = (19 * h[9] + ((int64_t) 1 << 24)) >> 25;
+    for (t = 0; t < 10; t++) {
+        q = (h[t] + q) >> LimbBits(t);
+    }
+    h[0] += 19 * q;
+    for (t = 0; t < 9; t++) {
+        carry = h[t] >> LimbBits(t);
+        h[t + 1] += carry;
+        h[t] -= carry * ((int64_t) 1 << LimbBits(t));
+    }
+    h[9] &= ((int64_t) 1 << 25) - 1;
+
+    memset(bytes, 0, X25519_KEY_SIZE);
+    for (t = 0; t < 10; t++) {
+        for (bit = 0; bit < LimbBits(t); bit++, offset++) {
+            bytes[offset / 8] |= ((h[t] >> bit) & 1) << (offset % 8);
+        }
+    }
+}
+
+static void FeConditionalSwap(Fe f, Fe g, int64_t swap) {
+    int64_t mask = -swap;
+    int64_t x;
+    int t;
+    for (t = 0; t < 10; t++) {
+        x = mask & (f[t] ^ g[t]);
+        f[t] ^= x;
+        g[t] ^= x;
+    }
+}
+
+void x25519_ScalarMult(uint8_t* result, const uint8_t* scalar, const uint8_t* point) {
+    uint8_t k[X25519_KEY_SIZE];
+    Fe x1, x2, z2, x3, z3, a, aa, b, bb, e, c, d, da, cb;
+    int64_t swap = 0;
+    int64_t bit;
+    int t;
+
+    memcpy(k, scalar, sizeof(k));
+    k[0] &= 248;
+    k[31] &= 127;
+    k[31] |= 64;
+
+    FeFromBytes(x1, point);
+    FeSetInt(x2, 1);
+    FeSetInt(z2, 0);
+    FeCopy(x3, x1);
+    FeSetInt(z3, 1);
+
+    for (t = 254; t >= 0; t--) {
+        bit = (k[t / 8] >> (t % 8)) & 1;
+        swap ^= bit;
+        FeConditionalSwap(x2, x3, swap);
+        FeConditionalSwap(z2, z3, swap);
+        swap = bit;
+
+        FeAdd(a, x2, z2);
+        FeSquare(aa, a);
+        FeSub(b, x2, z2);
+        FeSquare(bb, b);
+        FeSub(e, aa, bb);
+        FeAdd(c, x3, z3);
+        FeSub(d, x3, z3);
+        FeMul(da, d, a);
+        FeMul(cb, c, b);
+        FeAdd(x3, da, cb);
+        FeSquare(x3, x3);
+        FeSub(z3, da, cb);
+        FeSquare(z3, z3);
+        FeMul(z3, z3, x1);
+        FeMul(x2, aa, bb);
+        FeMulA24(z2, e);
+        FeAdd(z2, z2, aa);
+        FeMul(z2, z2, e);
+    }
+    FeConditionalSwap(x2, x3, swap);
+    FeConditionalSwap(z2, z3, swap);
+
+    FeInvert(z2, z2);
+    FeMul(x2, x2, z2);
+    FeToBytes(result, x2);
+
+    //ladder state tells which bits of scalar were set
+    crypto_Wipe(k, sizeof(k));
+    crypto_Wipe(x2, sizeof(Fe));
+    crypto_Wipe(z2, sizeof(Fe));
+    crypto_Wipe(x3, sizeof(Fe));
+    crypto_Wipe(z3, sizeof(Fe));
+}
+
+void x25519_PublicKey(uint8_t* publicKey, const uint8_t* privateKey) {
+    static const uint8_t basePoint[X25519_KEY_SIZE] = {9};
+    x25519_ScalarMult(publicKey, privateKey, basePoint);
+}
+
+bool x25519_DeriveKey(uint8_t* key, int keyLength, const uint8_t* privateKey, const uint8_t* initiatorPublic,
+        const uint8_t* responderPublic, bool isInitiator) {
+    uint8_t secret[X25519_KEY_SIZE];
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    Sha256Context sha;
+    uint8_t nonZero = 0;
+    int t;
+
+    x25519_ScalarMult(secret, privateKey, isInitiator ? responderPublic : initiatorPublic);
+    for (t = 0; t < X25519_KEY_SIZE; t++) {
+        nonZero |= secret[t];
+    }
+
+    sha256_Init(&sha);
+    sha256_Update(&sha, secret, sizeof(secret));
+    sha256_Update(&sha, initiatorPublic, X25519_KEY_SIZE);
+    sha256_Update(&sha, responderPublic, X25519_KEY_SIZE);
+    sha256_Final(&sha, digest);
+    memcpy(key, digest, keyLength);
+
+    crypto_Wipe(secret, sizeof(secret));
+    crypto_Wipe(digest, sizeof(digest));
+    crypto_Wipe(&sha, sizeof(sha));
+    return nonZero != 0;
+}
@@ -0,0 +1,66 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __X25519_H__
+#define __X25519_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define X25519_KEY_SIZE         (32)
+
+/**
+ * @brief Constant time X25519 (RFC 7748) scalar multiplication.
+ * @param[out] result u-coordinate of scalar * point
+ * @param[in] scalar private key, clamped internally
+ * @param[in] point u-coordinate of remote public key
+ */
+void x25519_ScalarMult(uint8_t* result, const uint8_t* scalar, const uint8_t* point);
+
+/**
+ * @brief Compute public key of given private key, i.e. multiply the base point.
+ */
+void x25519_PublicKey(uint8_t* publicKey, const uint8_t* privateKey);
+
+/**
+ * @brief Compute shared secret and derive symmetric key from it: first keyLength bytes of
+ * SHA-256(secret || initiatorPublic || responderPublic).
+ * @param[out] key derived key, at most 32 bytes
+ * @param[in] keyLength size of key
+ * @param[in] privateKey local private key
+ * @param[in] initiatorPublic public key of the side which offered X25519 (clicker)
+ * @param[in] responderPublic public key of the side which accepted it (daemon)
+ * @param[in] isInitiator true if privateKey belongs to initiator, false if to responder
+ * @return false if remote public key is a low order point, shared secret would be all zeros then
+ */
+bool x25519_DeriveKey(uint8_t* key, int keyLength, const uint8_t* privateKey, const uint8_t* initiatorPublic,
+        const uint8_t* responderPublic, bool isInitiator);
+
+#endif
@@ -0,0 +1,166 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+
+#include "epoch.h"
+
+struct EpochReader {
+    struct EpochReader *next;
+    gint inUse;                 /**< record belongs to a living thread */
+    gint active;                /**< thread is inside read-side section */
+    gint epoch;                 /**< global epoch seen on epoch_Enter */
+};
+
+typedef struct {
+    void *object;
+    EpochDestroy destroy;
+    gint epoch;                 /**< global epoch when object was retired */
+} RetiredObject;
+
+static void ReleaseReader(gpointer data);
+
+/** Global epoch, advanced when every active reader has seen the current one */
+static gint _Epoch = 0;
+
+/** Records of all threads that ever read, never freed but reused by new threads */
+static EpochReader *_Readers = NULL;
+
+/** Releases record of exiting thread */
+static GPrivate _ThreadReader = G_PRIVATE_INIT(ReleaseReader);
+
+/** Record of calling thread, cached here as GPrivate lookup is too slow for every section */
+static __thread EpochReader *_CachedReader = NULL;
+
+/** RetiredObject elements, accessed under writers lock only */
+static GSList *_Retired = NULL;
+
+static void ReleaseReader(gpointer data)
+{
+    EpochReader *reader = data;
+    g_atomic_int_set(&reader->active, 0);
+    g_atomic_int_set(&reader->inUse, 0);
+}
+
+static EpochReader *GetThreadReader(void)
+{
+    EpochReader *reader = _CachedReader;
+    if (reader != NULL)
+        return reader;
+
+    for (reader = g_atomic_pointer_get(&_Readers); reader != NULL; reader = reader->next)
+    {
+        if (g_atomic_int_compare_and_exchange(&reader->inUse, 0, 1))
+            break;
+    }
+    if (reader == NULL)
+    {
+        reader = g_new0(EpochReader, 1);
+        reader->inUse = 1;
+        do
+        {
+            reader->next = g_atomic_pointer_get(&_Readers);
+        } while (!g_atomic_pointer_compare_and_exchange(&_Readers, reader->next, reader));
+    }
+    g_private_set(&_ThreadReader, reader);
+    _CachedReader = reader;
+    return reader;
+}
+
+EpochReader *epoch_Enter(void)
+{
+    EpochReader *reader = GetThreadReader();
+    //glib atomics are full barriers, so loads inside the section can't be reordered before this
+    g_atomic_int_set(&reader->epoch, g_atomic_int_get(&_Epoch));
+    g_atomic_int_set(&reader->active, 1);
+    return reader;
+}
+
+void epoch_Leave(EpochReader *reader)
+{
+    g_atomic_int_set(&reader->active, 0);
+}
+
+/**
+ * Advance global epoch if no reader is still in older one, returns current epoch.
+ */
+static gint TryAdvance(void)
+{
+    gint epoch = g_atomic_int_get(&_Epoch);
+    for (EpochReader *reader = g_atomic_pointer_get(&_Readers); reader != NULL; reader = reader->next)
+    {
+        if (g_atomic_int_get(&reader->active) && g_atomic_int_get(&reader->epoch) != epoch)
+            return epoch;
+    }
+    g_atomic_int_inc(&_Epoch);
+    return g_atomic_int_get(&_Epoch);
+}
+
+void epoch_Reclaim(void)
+{
+    gint epoch = TryAdvance();
+    GSList **link = &_Retired;
+    while (*link != NULL)
+    {
+        RetiredObject *retired = (*link)->data;
+        //readers active in retired->epoch may still hold it, and those which entered in the next one too
+        if ((guint)epoch - (guint)retired->epoch >= 2)
+        {
+            retired->destroy(retired->object);
+            g_free(retired);
+            *link = g_slist_delete_link(*link, *link);
+        }
+        else
+        {
+            link = &(*link)->next;
+        }
+    }
+}
+
+void epoch_Retire(void *object, EpochDestroy destroy)
+{
+    RetiredObject *retired = g_new(RetiredObject, 1);
+    retired->object = object;
+    retired->destroy = destroy;
+    retired->epoch = g_atomic_int_get(&_Epoch);
+    _Retired = g_slist_prepend(_Retired, retired);
+    epoch_Reclaim();
+}
+
+void epoch_ReclaimAll(void)
+{
+    while (_Retired != NULL)
+    {
+        RetiredObject *retired = _Retired->data;
+        retired->destroy(retired->object);
+        g_free(retired);
+        _Retired = g_slist_delete_link(_Retired, _Retired);
+    }
+}
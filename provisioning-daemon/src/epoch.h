@@ -0,0 +1,73 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  epoch.h
+ * @brief Epoch based reclamation, lets readers walk shared structures without taking any lock.
+ *
+ * Readers wrap every access in epoch_Enter / epoch_Leave. Writers (serialised by their own lock) unlink object first
+ * and then pass it to epoch_Retire, it's destroyed once no reader which could have seen it is still inside.
+ */
+
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#include <stdbool.h>
+
+typedef struct EpochReader EpochReader;
+
+typedef void (*EpochDestroy)(void *object);
+
+/**
+ * @brief Start read-side section of calling thread. Sections must not be nested and should be short, pointers
+ * found inside are valid only until epoch_Leave.
+ * @return reader record of calling thread, pass it to epoch_Leave
+ */
+EpochReader *epoch_Enter(void);
+
+void epoch_Leave(EpochReader *reader);
+
+/**
+ * @brief Destroy object when all read-side sections which could see it have finished. Must be called with the
+ * writers lock held, after object has been unlinked.
+ */
+void epoch_Retire(void *object, EpochDestroy destroy);
+
+/**
+ * @brief Destroy retired objects whose grace period has elapsed. Must be called with the writers lock held.
+ */
+void epoch_Reclaim(void);
+
+/**
+ * @brief Destroy all retired objects regardless of readers, for shutdown when no reader is left.
+ */
+void epoch_ReclaimAll(void);
+
+#endif /* __EPOCH_H__ */
@@ -28,6 +28,7 @@
  * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "event.h"
+#include "crypto/wipe.h"
 
 static GQueue* _EventsQueue = NULL;
 static GMutex _Mutex;
@@ -44,6 +45,9 @@ char* EventTypeToString(EventType type) {
         case EventType_CLICKER_SELECT:
             return "CLICKER_SELECT";
 
+        case EventType_CLICKER_SELECT_NEXT:
+            return "CLICKER_SELECT_NEXT";
+
         case EventType_CLICKER_START_PROVISION:
             return "CLICKER_START_PROVISION";
 
@@ -65,6 +69,12 @@ char* EventTypeToString(EventType type) {
         case EventType_HISTORY_ADD:
             return "HISTORY_ADD";
 
+        case EventType_CLICKER_PROVISIONED:
+            return "CLICKER_PROVISIONED";
+
+        case EventType_CLICKER_RENAMED:
+            return "CLICKER_RENAMED";
+
         default:
             return "UNKNOWN";
     }
@@ -90,18 +100,20 @@ void event_PushEventWithInt(EventType type, int data) {
     event->type = type;
     event->intData  =data;
     event->freeDataPtrOnRelease = false;
+    event->wipeDataLength = 0;
     g_queue_push_tail(_EventsQueue, event);
     g_mutex_unlock(&_Mutex);
     g_message("[Event:%d] eventPtr:%p type:%s, int data:%d", event->id, event, EventTypeToString(type), data);
 }
 
-void event_PushEventWithPtr(EventType type, void* dataPtr, bool freeDataOnRelease) {
+static void PushPtrEvent(EventType type, void* dataPtr, bool freeDataOnRelease, size_t wipeLength) {
     g_mutex_lock(&_Mutex);
     Event* event = g_new(Event, 1);
     event->id = ++_NextEventId;
     event->type = type;
     event->ptrData = dataPtr;
     event->freeDataPtrOnRelease = freeDataOnRelease;
+    event->wipeDataLength = wipeLength;
 
     g_queue_push_tail(_EventsQueue, event);
     g_mutex_unlock(&_Mutex);
@@ -109,6 +121,14 @@ void event_PushEventWithPtr(EventType type, void* dataPtr, bool freeDataOnReleas
     g_message("[Event:%d] eventPtr:%p, type:%s, dataPtr:%p", event->id, event, EventTypeToString(type), dataPtr);
 }
 
+void event_PushEventWithPtr(EventType type, void* dataPtr, bool freeDataOnRelease) {
+    PushPtrEvent(type, dataPtr, freeDataOnRelease, 0);
+}
+
+void event_PushEventWithSecretPtr(EventType type, void* dataPtr, size_t length) {
+    PushPtrEvent(type, dataPtr, true, length);
+}
+
 Event* event_PopEvent(void) {
     g_mutex_lock(&_Mutex);
     Event* result = g_queue_pop_head(_EventsQueue);
@@ -120,6 +140,9 @@ void event_ReleaseEvent(Event** event) {
     if (*event != NULL) {
         if ((*event)->freeDataPtrOnRelease) {
             g_debug("[event:%d] release event DATA ptr: %p", (*event)->id, (*event)->ptrData);
+            if ((*event)->wipeDataLength > 0 && (*event)->ptrData != NULL) {
+                crypto_Wipe((*event)->ptrData, (*event)->wipeDataLength);
+            }
             g_free((*event)->ptrData);
         }
         g_debug("[event:%d] release event %s ptr: %p", (*event)->id, EventTypeToString((*event)->type), *event);
@@ -38,13 +38,16 @@ typedef enum {
     EventType_CLICKER_CREATE,   //int - id of clicker
     EventType_CLICKER_DESTROY,  //int - id of clicker
     EventType_CLICKER_SELECT, //int - id of clicker which should become selected one
+    EventType_CLICKER_SELECT_NEXT, //int - SelectFilter, next clicker matching it becomes selected one
     EventType_CLICKER_START_PROVISION, //int - id of clicker to do provision
     EventType_CONNECTION_SEND_COMMAND, //ptr - points to NetworkDataPack, ownership is passed to receiver
     EventType_CONNECTION_RECEIVED_COMMAND, //ptr - points to NetworkDataPack (will be released on event destruction)
-    EventType_PSK_OBTAINED, //ptr - points to PreSharedKey struct
+    EventType_PSK_OBTAINED, //ptr - points to PreSharedKey struct, pushed by event_PushEventWithSecretPtr
     EventType_TRY_TO_SEND_PSK_TO_CLICKER,  //int - id of clicker to which PSK should be send
     EventType_HISTORY_REMOVE, //int - id of clicker to remove from history
     EventType_HISTORY_ADD, //int - id of clicker to add to history
+    EventType_CLICKER_PROVISIONED, //int - id of clicker which got its configuration, it's disconnected after a while
+    EventType_CLICKER_RENAMED, //int - id of clicker which name has been changed
 } EventType;
 
 typedef struct {
@@ -55,6 +58,7 @@ typedef struct {
         void*   ptrData;
     };
     bool freeDataPtrOnRelease;
+    size_t wipeDataLength;  /**< bytes of ptrData wiped before it's released, for data which holds secrets */
 } Event;
 
 void event_Init(void);
@@ -66,6 +70,10 @@ void event_Shutdown(void);
  */
 void event_PushEventWithInt(EventType type, int data);
 void event_PushEventWithPtr(EventType type, void* dataPtr, bool freeDataOnRelease);
+/**
+ * Like event_PushEventWithPtr with freeDataOnRelease, but first length bytes of data are wiped before release.
+ */
+void event_PushEventWithSecretPtr(EventType type, void* dataPtr, size_t length);
 
 /**
  * Pops event from queue, if no events avail then NULL is returned. After handling returned event you should call
@@ -75,7 +83,8 @@ Event* event_PopEvent(void);
 
 /**
  * Releases event struct from memory, if data associated with this event is an pointer, and event has flag
- * freeDataPtrOnRelease set to true, then this pointer is also released by call to g_free().
+ * freeDataPtrOnRelease set to true, then this pointer is also released by call to g_free(), wiped first when it was
+ * pushed by event_PushEventWithSecretPtr.
  */
 void event_ReleaseEvent(Event** event);
 
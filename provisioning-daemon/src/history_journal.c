@@ -0,0 +1,367 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "history_journal.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib.h>
+
+#define JOURNAL_GROW_RECORDS        (256)           /**< file is extended by this many records at once */
+#define JOURNAL_BATCH_WINDOW_US     (50 * 1000)     /**< records queued within this time are synced together */
+#define JOURNAL_BATCH_MAX           (64)
+#define JOURNAL_COMPACT_SLACK       (256)           /**< superseded records tolerated on top of live ones */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint8_t reserved[116];
+} JournalHeader;
+
+G_STATIC_ASSERT(sizeof(JournalRecord) == 128);
+G_STATIC_ASSERT(sizeof(JournalHeader) == sizeof(JournalRecord));
+
+/**
+ * Open journal, owned by the writer thread between journal_Open and journal_Close.
+ */
+typedef struct {
+    char *path;
+    int fd;
+    uint8_t *map;
+    size_t capacity;        /**< records file has room for */
+    size_t count;           /**< records appended so far, the rest of file is zeroed */
+    GHashTable *live;       /**< clicker id -> copy of last PROVISIONED record not followed by REMOVED one */
+    int32_t highestClickerId;
+    GAsyncQueue *queue;     /**< JournalRecord copies waiting for writer thread */
+    GThread *writer;
+} Journal;
+
+static Journal _Journal = { .fd = -1 };
+
+/** Pushed to queue by journal_Close, writer thread ends after it */
+static JournalRecord _StopMarker;
+
+static uint32_t Checksum(const JournalRecord *record) {
+    //FNV-1a
+    const uint8_t *bytes = (const uint8_t *) record + sizeof(record->checksum);
+    uint32_t hash = 2166136261u;
+    for (size_t t = 0; t < sizeof(*record) - sizeof(record->checksum); t++) {
+        hash ^= bytes[t];
+        hash *= 16777619u;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+static size_t MappedSize(size_t capacity) {
+    return sizeof(JournalHeader) + capacity * sizeof(JournalRecord);
+}
+
+static JournalRecord *RecordAt(uint8_t *map, size_t index) {
+    return (JournalRecord *) (map + sizeof(JournalHeader)) + index;
+}
+
+static void InitHeader(uint8_t *map) {
+    JournalHeader *header = (JournalHeader *) map;
+    memset(header, 0, sizeof(*header));
+    header->magic = JOURNAL_MAGIC;
+    header->version = JOURNAL_VERSION;
+    header->recordSize = sizeof(JournalRecord);
+}
+
+/**
+ * Resize file to capacity records and map it, space it grows by reads as zeros.
+ */
+static uint8_t *MapFile(int fd, size_t capacity) {
+    if (ftruncate(fd, MappedSize(capacity)) != 0) {
+        return NULL;
+    }
+    void *map = mmap(NULL, MappedSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return map != MAP_FAILED ? map : NULL;
+}
+
+/**
+ * Flush records [first, end) to disk.
+ */
+static void SyncRecords(size_t first, size_t end) {
+    if (first == end) {
+        return;
+    }
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t start = MappedSize(first) / pageSize * pageSize;
+    if (msync(_Journal.map + start, MappedSize(end) - start, MS_SYNC) != 0) {
+        g_warning("Journal: can't sync %s", _Journal.path);
+    }
+}
+
+static void UpdateLive(const JournalRecord *record) {
+    _Journal.highestClickerId = MAX(_Journal.highestClickerId, record->clickerId);
+    if (record->type == JournalRecord_PROVISIONED) {
+        JournalRecord *copy = g_new(JournalRecord, 1);
+        memcpy(copy, record, sizeof(*copy));
+        g_hash_table_insert(_Journal.live, GINT_TO_POINTER(record->clickerId), copy);
+    } else {
+        g_hash_table_remove(_Journal.live, GINT_TO_POINTER(record->clickerId));
+    }
+}
+
+static bool NeedsCompaction(void) {
+    return _Journal.count > 2 * g_hash_table_size(_Journal.live) + JOURNAL_COMPACT_SLACK;
+}
+
+static gint CompareTimestamps(gconstpointer a, gconstpointer b) {
+    const JournalRecord *first = a;
+    const JournalRecord *second = b;
+    if (first->timestamp != second->timestamp) {
+        return first->timestamp < second->timestamp ? -1 : 1;
+    }
+    //ids grow with time, so they keep order of records made within the same millisecond
+    return first->clickerId < second->clickerId ? -1 : (first->clickerId > second->clickerId ? 1 : 0);
+}
+
+/**
+ * Make rename of journal durable, it's an entry of its directory.
+ */
+static void SyncDirectory(const char *path) {
+    gchar *directory = g_path_get_dirname(path);
+    int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) != 0) {
+        g_warning("Journal: can't sync directory %s, compaction may be lost on power failure", directory);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    g_free(directory);
+}
+
+/**
+ * Rewrite journal with live records only, in order of their timestamps. New file is synced before it replaces the old
+ * one, so crash in the middle leaves either of them complete. If the highest clicker id isn't live any more, REMOVED
+ * record of it is kept, so ids are not given out again after restart.
+ */
+static void Compact(void) {
+    gchar *temporary = g_strconcat(_Journal.path, ".XXXXXX", NULL);
+    int fd = g_mkstemp(temporary);
+    if (fd < 0) {
+        g_warning("Journal: can't create %s for compaction", temporary);
+        g_free(temporary);
+        return;
+    }
+
+    bool keepHighest = !g_hash_table_contains(_Journal.live, GINT_TO_POINTER(_Journal.highestClickerId));
+    size_t count = g_hash_table_size(_Journal.live) + (keepHighest ? 1 : 0);
+    size_t capacity = (count / JOURNAL_GROW_RECORDS + 1) * JOURNAL_GROW_RECORDS;
+    uint8_t *map = MapFile(fd, capacity);
+    bool result = map != NULL;
+    if (result) {
+        InitHeader(map);
+        size_t index = 0;
+        if (keepHighest) {
+            JournalRecord *removed = RecordAt(map, index++);
+            removed->type = JournalRecord_REMOVED;
+            removed->clickerId = _Journal.highestClickerId;
+            removed->checksum = Checksum(removed);
+        }
+        GList *records = g_list_sort(g_hash_table_get_values(_Journal.live), CompareTimestamps);
+        for (GList *record = records; record != NULL; record = record->next) {
+            memcpy(RecordAt(map, index++), record->data, sizeof(JournalRecord));
+        }
+        g_list_free(records);
+        result = msync(map, MappedSize(capacity), MS_SYNC) == 0 && fchmod(fd, 0644) == 0 &&
+                rename(temporary, _Journal.path) == 0;
+    }
+    if (!result) {
+        g_warning("Journal: compaction of %s failed, keeping it as it is", _Journal.path);
+        if (map != NULL) {
+            munmap(map, MappedSize(capacity));
+        }
+        close(fd);
+        unlink(temporary);
+        g_free(temporary);
+        return;
+    }
+
+    SyncDirectory(_Journal.path);
+    g_debug("Journal: compacted %zu records to %zu", _Journal.count, count);
+    munmap(_Journal.map, MappedSize(_Journal.capacity));
+    close(_Journal.fd);
+    _Journal.fd = fd;
+    _Journal.map = map;
+    _Journal.capacity = capacity;
+    _Journal.count = count;
+    g_free(temporary);
+}
+
+static void WriteRecord(const JournalRecord *record) {
+    if (_Journal.count == _Journal.capacity) {
+        size_t capacity = _Journal.capacity + JOURNAL_GROW_RECORDS;
+        uint8_t *map = MapFile(_Journal.fd, capacity);
+        if (map == NULL) {
+            g_warning("Journal: can't grow %s, record of clicker %d is lost", _Journal.path, record->clickerId);
+            return;
+        }
+        munmap(_Journal.map, MappedSize(_Journal.capacity));
+        _Journal.map = map;
+        _Journal.capacity = capacity;
+    }
+    memcpy(RecordAt(_Journal.map, _Journal.count), record, sizeof(*record));
+    _Journal.count++;
+    UpdateLive(record);
+}
+
+static gpointer WriterThread(gpointer data) {
+    bool running = true;
+    while (running) {
+        JournalRecord *record = g_async_queue_pop(_Journal.queue);
+        size_t first = _Journal.count;
+        gint64 batchEnd = g_get_monotonic_time() + JOURNAL_BATCH_WINDOW_US;
+        for (int batched = 0; record != NULL; batched++) {
+            if (record == &_StopMarker) {
+                running = false;
+                break;
+            }
+            WriteRecord(record);
+            g_free(record);
+            if (batched + 1 >= JOURNAL_BATCH_MAX) {
+                break;
+            }
+            gint64 left = batchEnd - g_get_monotonic_time();
+            record = left > 0 ? g_async_queue_timeout_pop(_Journal.queue, left) : g_async_queue_try_pop(_Journal.queue);
+        }
+        SyncRecords(first, _Journal.count);
+        if (NeedsCompaction()) {
+            Compact();
+        }
+    }
+    return NULL;
+}
+
+bool journal_Open(const char *path, JournalReplayCallback replay, void *context) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        g_warning("Journal: can't open %s", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    size_t stored = info.st_size > sizeof(JournalHeader) ?
+            (info.st_size - sizeof(JournalHeader)) / sizeof(JournalRecord) : 0;
+    size_t capacity = MAX((stored + JOURNAL_GROW_RECORDS - 1) / JOURNAL_GROW_RECORDS, 1) * JOURNAL_GROW_RECORDS;
+    uint8_t *map = MapFile(fd, capacity);
+    if (map == NULL) {
+        g_warning("Journal: can't map %s", path);
+        close(fd);
+        return false;
+    }
+
+    const JournalHeader *header = (const JournalHeader *) map;
+    if (header->magic != JOURNAL_MAGIC || header->version != JOURNAL_VERSION ||
+            header->recordSize != sizeof(JournalRecord)) {
+        if (info.st_size > 0) {
+            g_warning("Journal: %s has unknown format, starting new journal", path);
+        }
+        memset(map, 0, MappedSize(capacity));
+        InitHeader(map);
+        stored = 0;
+    }
+
+    _Journal.path = g_strdup(path);
+    _Journal.fd = fd;
+    _Journal.map = map;
+    _Journal.capacity = capacity;
+    _Journal.highestClickerId = 0;
+    _Journal.live = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+    size_t count = 0;
+    while (count < stored) {
+        const JournalRecord *record = RecordAt(map, count);
+        if (record->checksum != Checksum(record)) {
+            break;
+        }
+        UpdateLive(record);
+        replay(record, context);
+        count++;
+    }
+    //anything after the first bad record comes from unsynced batch, it must not reappear once this slot is reused
+    size_t damaged = 0;
+    for (size_t t = count; t < stored; t++) {
+        damaged += RecordAt(map, t)->checksum != 0 ? 1 : 0;
+    }
+    if (damaged > 0) {
+        g_warning("Journal: %s ends with %zu damaged records, they are dropped", path, damaged);
+    }
+    memset(RecordAt(map, count), 0, (capacity - count) * sizeof(JournalRecord));
+    msync(map, MappedSize(capacity), MS_SYNC);
+    _Journal.count = count;
+    if (NeedsCompaction()) {
+        Compact();
+    }
+
+    _Journal.queue = g_async_queue_new();
+    _Journal.writer = g_thread_new("journal", WriterThread, NULL);
+    return true;
+}
+
+void journal_Append(const JournalRecord *record) {
+    if (_Journal.queue == NULL) {
+        return;
+    }
+    JournalRecord *copy = g_new(JournalRecord, 1);
+    memcpy(copy, record, sizeof(*copy));
+    copy->checksum = Checksum(copy);
+    g_async_queue_push(_Journal.queue, copy);
+}
+
+void journal_Close(void) {
+    if (_Journal.writer == NULL) {
+        return;
+    }
+    g_async_queue_push(_Journal.queue, &_StopMarker);
+    g_thread_join(_Journal.writer);
+    _Journal.writer = NULL;
+    g_async_queue_unref(_Journal.queue);
+    _Journal.queue = NULL;
+
+    munmap(_Journal.map, MappedSize(_Journal.capacity));
+    _Journal.map = NULL;
+    close(_Journal.fd);
+    _Journal.fd = -1;
+    g_hash_table_destroy(_Journal.live);
+    _Journal.live = NULL;
+    g_free(_Journal.path);
+    _Journal.path = NULL;
+}
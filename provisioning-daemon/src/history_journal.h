@@ -0,0 +1,96 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  history_journal.h
+ * @brief Append-only file of provisioning outcomes, so history survives restarts.
+ *
+ * File is a header followed by fixed size records, it's memory-mapped and appended by a writer thread which syncs
+ * records in batches. Record with bad checksum ends the journal, so a torn write on crash loses only the batch
+ * which wasn't synced. When most records are superseded, journal is rewritten with live records only.
+ */
+
+#ifndef __HISTORY_JOURNAL_H__
+#define __HISTORY_JOURNAL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define JOURNAL_MAGIC               (0x4A484450)    /* "PDHJ", also rejects files written with other byte order */
+#define JOURNAL_VERSION             (1)
+#define JOURNAL_NAME_LENGTH         (40)
+#define JOURNAL_IDENTITY_LENGTH     (32)
+
+typedef enum {
+    JournalRecord_PROVISIONED = 1,  /**< clicker got PSK, replaces earlier record of the same clicker */
+    JournalRecord_REMOVED           /**< record of the clicker is dropped */
+} JournalRecordType;
+
+/**
+ * @brief Single outcome, 128 bytes.
+ */
+typedef struct {
+    uint32_t checksum;                      /**< of the rest of the record, never 0, so zeroed space ends the journal */
+    uint8_t type;                           /**< JournalRecordType */
+    uint8_t isErrored;
+    uint8_t reserved[2];
+    int32_t clickerId;
+    int32_t error;
+    int64_t timestamp;                      /**< unix time in millis */
+    char name[JOURNAL_NAME_LENGTH];         /**< endpoint name, null terminated */
+    char identity[JOURNAL_IDENTITY_LENGTH]; /**< PSK identity, null terminated */
+    uint8_t padding[32];
+} JournalRecord;
+
+/**
+ * @brief Called for every record found when journal is opened, in order they were appended.
+ */
+typedef void (*JournalReplayCallback)(const JournalRecord *record, void *context);
+
+/**
+ * @brief Open (or create) journal file, pass its records to replay and start writer thread.
+ * @param[in] path journal file
+ * @param[in] replay called for every record before this function returns
+ * @param[in] context passed to replay
+ * @return false if file can't be used, appends are then dropped
+ */
+bool journal_Open(const char *path, JournalReplayCallback replay, void *context);
+
+/**
+ * @brief Queue copy of record to be appended, returns without waiting for any I/O. Checksum is filled in.
+ */
+void journal_Append(const JournalRecord *record);
+
+/**
+ * @brief Append and sync queued records, stop writer thread and close the file.
+ */
+void journal_Close(void);
+
+#endif /* __HISTORY_JOURNAL_H__ */
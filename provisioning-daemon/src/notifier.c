@@ -0,0 +1,186 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "notifier.h"
+
+#include <libubox/blobmsg.h>
+#include <string.h>
+#include <glib.h>
+
+#include "controls.h"
+#include "errors.h"
+#include "state_snapshot.h"
+#include "ubus_agent.h"
+
+#define NOTIFY_MIN_INTERVAL_MS      (100)
+#define NOTIFY_MAX_BATCH            (128)   /**< notifications above it are only counted, getState tells the rest */
+
+typedef enum {
+    NotificationType_CONNECTED,
+    NotificationType_SELECTED,
+    NotificationType_PROVISIONING_STARTED,
+    NotificationType_PSK_OBTAINED,
+    NotificationType_CONFIG_SENT,
+    NotificationType_ERROR,
+    NotificationType_DISCONNECTED
+} NotificationType;
+
+static const char* const _NotificationNames[] = {
+    [NotificationType_CONNECTED] = "connected",
+    [NotificationType_SELECTED] = "selected",
+    [NotificationType_PROVISIONING_STARTED] = "provisioningStarted",
+    [NotificationType_PSK_OBTAINED] = "pskObtained",
+    [NotificationType_CONFIG_SENT] = "configSent",
+    [NotificationType_ERROR] = "error",
+    [NotificationType_DISCONNECTED] = "disconnected",
+};
+
+typedef struct {
+    NotificationType type;
+    int clickerId;
+    int error;
+} Notification;
+
+static GArray* _Pending = NULL;
+static unsigned int _Dropped = 0;
+static int _SelectedId = -1;
+static gint64 _LastBatchTime = 0;
+static unsigned int _SentBatches = 0;
+static unsigned int _SentNotifications = 0;
+
+static void Collect(NotificationType type, int clickerId, int error) {
+    if (!ubusagent_HasSubscribers()) {
+        return;
+    }
+    if (_Pending->len >= NOTIFY_MAX_BATCH) {
+        _Dropped++;
+        return;
+    }
+    Notification notification = { .type = type, .clickerId = clickerId, .error = error };
+    g_array_append_val(_Pending, notification);
+}
+
+void notifier_Init(void) {
+    _Pending = g_array_sized_new(FALSE, FALSE, sizeof(Notification), NOTIFY_MAX_BATCH);
+    _Dropped = 0;
+    _SelectedId = -1;
+    _LastBatchTime = 0;
+}
+
+void notifier_Shutdown(void) {
+    g_message("Notifier: sent %u notifications in %u batches", _SentNotifications, _SentBatches);
+    g_array_free(_Pending, TRUE);
+    _Pending = NULL;
+}
+
+bool notifier_ConsumeEvent(Event* event) {
+    switch (event->type) {
+        case EventType_CLICKER_CREATE:
+            Collect(NotificationType_CONNECTED, event->intData, 0);
+            break;
+
+        case EventType_CLICKER_DESTROY:
+            Collect(NotificationType_DISCONNECTED, event->intData, 0);
+            break;
+
+        case EventType_CLICKER_START_PROVISION:
+            Collect(NotificationType_PROVISIONING_STARTED, event->intData, 0);
+            break;
+
+        case EventType_PSK_OBTAINED: {
+            PreSharedKey* psk = event->ptrData;
+            if (psk->pskLen > 0) {
+                Collect(NotificationType_PSK_OBTAINED, psk->clickerId, 0);
+            } else {
+                Collect(NotificationType_ERROR, psk->clickerId, pd_Error_GENERATE_PSK);
+            }
+            break;
+        }
+
+        case EventType_CLICKER_PROVISIONED:
+            Collect(NotificationType_CONFIG_SENT, event->intData, 0);
+            break;
+
+        default:
+            break;
+    }
+    return false;
+}
+
+void notifier_Update(void) {
+    //selection changes in several ways (events, buttons, removal of selected clicker), so it's compared instead
+    int selectedId = controls_GetSelectedClickerId();
+    if (selectedId != _SelectedId) {
+        _SelectedId = selectedId;
+        if (selectedId >= 0) {
+            Collect(NotificationType_SELECTED, selectedId, 0);
+        }
+    }
+
+    if (_Pending->len == 0 && _Dropped == 0) {
+        return;
+    }
+    gint64 now = g_get_monotonic_time() / 1000;
+    if (now - _LastBatchTime < NOTIFY_MIN_INTERVAL_MS) {
+        return;
+    }
+    _LastBatchTime = now;
+
+    struct blob_buf message = {0, NULL, 0, NULL};
+    blob_buf_init(&message, 0);
+    //subscriber can ask for delta since the version it had
+    StateSnapshot* snapshot = snapshot_Acquire();
+    if (snapshot != NULL) {
+        blobmsg_add_u64(&message, "version", snapshot->version);
+        snapshot_Release(snapshot);
+    }
+    void* cookie_array = blobmsg_open_array(&message, "events");
+    for (guint t = 0; t < _Pending->len; t++) {
+        const Notification* notification = &g_array_index(_Pending, Notification, t);
+        void* cookie_item = blobmsg_open_table(&message, NULL);
+        blobmsg_add_string(&message, "event", _NotificationNames[notification->type]);
+        blobmsg_add_u32(&message, "clickerID", notification->clickerId);
+        if (notification->type == NotificationType_ERROR) {
+            blobmsg_add_u32(&message, "error", notification->error);
+        }
+        blobmsg_close_table(&message, cookie_item);
+    }
+    blobmsg_close_array(&message, cookie_array);
+    if (_Dropped > 0) {
+        blobmsg_add_u32(&message, "dropped", _Dropped);
+    }
+
+    _SentNotifications += _Pending->len;
+    _SentBatches++;
+    g_array_set_size(_Pending, 0);
+    _Dropped = 0;
+    ubusagent_Notify("state", blob_memdup(message.head));
+    blob_buf_free(&message);
+}
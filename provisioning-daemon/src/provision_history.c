@@ -36,105 +36,261 @@
 #include <glib.h>
 
 #include "provision_history.h"
+#include "history_journal.h"
 #include "clicker.h"
 #include "utils.h"
 
-//10 minutes
-#define MAX_LIVE_TIME  (10 * 60 * 1000)
-
 typedef struct {
-    char name[MAX_HISTORY_NAME];
-    gint64 timestamp;
-    int id;
-    bool isErrored;
+    HistoryItem item;
+    gint64 addedAt;     /**< monotonic time in millis, age is measured from it so wall clock steps don't matter */
+    GList* ageLink;     /**< node of _EntriesByAge */
 } HistoryEntry;
 
-static GSList* _HistoryElements = NULL;
+G_STATIC_ASSERT(MAX_HISTORY_NAME == JOURNAL_NAME_LENGTH);
+G_STATIC_ASSERT(MAX_HISTORY_IDENTITY == JOURNAL_IDENTITY_LENGTH);
+
+/** Provisioned clickers by id, owns entries */
+static GHashTable* _EntriesById = NULL;
+/** The same entries by endpoint name, each name (owned copy) maps to GQueue of entries, the newest at tail */
+static GHashTable* _EntriesByName = NULL;
+/** The same entries ordered by addedAt, the oldest at head, so expired ones are popped from there */
+static GQueue _EntriesByAge = G_QUEUE_INIT;
+static gint64 _MaxAge = 0;
+static unsigned int _MaxEntries = 0;
+/** Incremented on every change of entries */
+static gint _Version = 0;
+static bool _JournalOpened = false;
+static int _LastClickerId = 0;
 static GMutex _Mutex;
 
-void history_Init(void) {
+static void RemoveEntry(HistoryEntry* entry) {
+    //NOTE: called from inside mutex
+    g_atomic_int_inc(&_Version);
+    g_queue_delete_link(&_EntriesByAge, entry->ageLink);
+    GQueue* sameName = g_hash_table_lookup(_EntriesByName, entry->item.name);
+    if (sameName != NULL) {
+        g_queue_remove(sameName, entry);
+        if (g_queue_is_empty(sameName)) {
+            g_hash_table_remove(_EntriesByName, entry->item.name);
+        }
+    }
+    g_hash_table_remove(_EntriesById, GINT_TO_POINTER(entry->item.id));
+}
+
+static void InsertEntry(HistoryEntry* entry) {
+    //NOTE: called from inside mutex
+    HistoryEntry* old = g_hash_table_lookup(_EntriesById, GINT_TO_POINTER(entry->item.id));
+    if (old != NULL) {
+        RemoveEntry(old);
+    }
+    g_atomic_int_inc(&_Version);
+    g_hash_table_insert(_EntriesById, GINT_TO_POINTER(entry->item.id), entry);
+    GQueue* sameName = g_hash_table_lookup(_EntriesByName, entry->item.name);
+    if (sameName == NULL) {
+        sameName = g_queue_new();
+        g_hash_table_replace(_EntriesByName, g_strdup(entry->item.name), sameName);
+    }
+    g_queue_push_tail(sameName, entry);
+
+    //entries come in time order, except replayed ones, so this walks back rarely and only over a few entries
+    GList* previous = _EntriesByAge.tail;
+    while (previous != NULL && ((HistoryEntry*) previous->data)->addedAt > entry->addedAt) {
+        previous = previous->prev;
+    }
+    if (previous == NULL) {
+        g_queue_push_head(&_EntriesByAge, entry);
+        entry->ageLink = _EntriesByAge.head;
+    } else {
+        g_queue_insert_after(&_EntriesByAge, previous, entry);
+        entry->ageLink = previous->next;
+    }
+}
+
+static HistoryEntry* NewEntry(int id) {
+    HistoryEntry* entry = g_new0(HistoryEntry, 1);
+    entry->item.id = id;
+    return entry;
+}
+
+static void JournalEntry(JournalRecordType type, const HistoryEntry* entry) {
+    if (!_JournalOpened) {
+        return;
+    }
+    JournalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.clickerId = entry->item.id;
+    if (type == JournalRecord_PROVISIONED) {
+        record.isErrored = entry->item.isErrored;
+        record.error = entry->item.error;
+        record.timestamp = entry->item.timestamp;
+        strlcpy(record.name, entry->item.name, sizeof(record.name));
+        strlcpy(record.identity, entry->item.identity, sizeof(record.identity));
+    }
+    journal_Append(&record);
+}
+
+/**
+ * Drop entries older than _MaxAge and the oldest ones above _MaxEntries, either limit is off when zero. Each entry
+ * is popped once, so cost is constant per entry, not per call.
+ */
+static void PurgeOld(void) {
+    //NOTE: called from inside mutex
+    gint64 oldest = g_get_monotonic_time() / 1000 - _MaxAge;
+    while (_EntriesByAge.head != NULL) {
+        HistoryEntry* entry = _EntriesByAge.head->data;
+        bool tooOld = _MaxAge != 0 && entry->addedAt < oldest;
+        bool overLimit = _MaxEntries != 0 && _EntriesByAge.length > _MaxEntries;
+        if (!tooOld && !overLimit) {
+            break;
+        }
+        JournalEntry(JournalRecord_REMOVED, entry);
+        RemoveEntry(entry);
+    }
+}
+
+static void ReplayRecord(const JournalRecord* record, void* context) {
+    //NOTE: called from history_Init, before anything else touches history
+    _LastClickerId = MAX(_LastClickerId, record->clickerId);
+    if (record->type != JournalRecord_PROVISIONED) {
+        HistoryEntry* entry = g_hash_table_lookup(_EntriesById, GINT_TO_POINTER(record->clickerId));
+        if (entry != NULL) {
+            RemoveEntry(entry);
+        }
+        return;
+    }
+    HistoryEntry* entry = NewEntry(record->clickerId);
+    strlcpy(entry->item.name, record->name, sizeof(entry->item.name));
+    strlcpy(entry->item.identity, record->identity, sizeof(entry->item.identity));
+    entry->item.timestamp = record->timestamp;
+    //age is known only from wall clock here, clicker which seems to come from the future (clock not set yet after boot)
+    //is taken as just provisioned
+    gint64 age = g_get_real_time() / 1000 - record->timestamp;
+    entry->addedAt = g_get_monotonic_time() / 1000 - MAX(age, 0);
+    entry->item.error = record->error;
+    entry->item.isErrored = record->isErrored;
+    InsertEntry(entry);
+}
+
+void history_Init(const char* journalPath, int maxAge, int maxEntries) {
     g_mutex_init(&_Mutex);
+    _EntriesById = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    _EntriesByName = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_queue_free);
+    g_queue_init(&_EntriesByAge);
+    _MaxAge = (gint64) maxAge * 1000;
+    _MaxEntries = maxEntries;
+
+    if (journalPath == NULL || journalPath[0] == '\0') {
+        g_message("History journal is disabled, history is kept in memory only");
+        return;
+    }
+    gchar* directory = g_path_get_dirname(journalPath);
+    if (g_mkdir_with_parents(directory, 0755) != 0) {
+        g_warning("Can't create directory %s for history journal", directory);
+    }
+    g_free(directory);
+
+    _JournalOpened = journal_Open(journalPath, ReplayRecord, NULL);
+    if (_JournalOpened) {
+        g_mutex_lock(&_Mutex);
+        PurgeOld();
+        g_mutex_unlock(&_Mutex);
+        g_message("Loaded %u provisioned clickers from history journal %s", g_hash_table_size(_EntriesById),
+                journalPath);
+    } else {
+        g_warning("History journal %s can't be used, history is kept in memory only", journalPath);
+    }
 }
 
 void history_Destroy(void) {
+    journal_Close();
+    _JournalOpened = false;
+    g_queue_clear(&_EntriesByAge);
+    g_hash_table_destroy(_EntriesByName);
+    g_hash_table_destroy(_EntriesById);
     g_mutex_clear(&_Mutex);
 }
 
 void AddToHistory(int clickerId) {
-    Clicker *clicker = clicker_AcquireOwnership(clickerId);
+    const Clicker *clicker = clicker_AcquireReadOnly(clickerId);
     if (clicker == NULL) {
         g_critical("AddToHistory: Can't acquire clicker with id:%d, this is probably internal error", clickerId);
         return;
     }
 
-    HistoryEntry* entry = g_malloc(sizeof(HistoryEntry));
-    entry->timestamp = g_get_monotonic_time() / 1000;
-    entry->id = clickerId;
-    entry->isErrored = false;
-    strlcpy(entry->name, clicker->name, MAX_HISTORY_NAME);
+    HistoryEntry* entry = NewEntry(clickerId);
+    entry->item.timestamp = g_get_real_time() / 1000;
+    entry->addedAt = g_get_monotonic_time() / 1000;
+    entry->item.error = clicker->error;
+    entry->item.isErrored = clicker->error > 0;
+    strlcpy(entry->item.name, clicker->name, MAX_HISTORY_NAME);
+    strlcpy(entry->item.identity, (const char*)clicker->identity, MAX_HISTORY_IDENTITY);
 
-    clicker_ReleaseOwnership(clicker);
+    clicker_ReleaseReadOnly(clicker);
 
     g_mutex_lock(&_Mutex);
-    _HistoryElements = g_slist_prepend(_HistoryElements, entry);
+    InsertEntry(entry);
+    JournalEntry(JournalRecord_PROVISIONED, entry);
+    PurgeOld();
     g_mutex_unlock(&_Mutex);
+}
+
+GArray* history_GetProvisioned(void) {
+    g_mutex_lock(&_Mutex);
+    PurgeOld();
 
+    GArray* result = g_array_sized_new(FALSE, FALSE, sizeof(HistoryItem), _EntriesByAge.length);
+    for (GList* link = _EntriesByAge.tail; link != NULL; link = link->prev) {
+        g_array_append_val(result, ((HistoryEntry*) link->data)->item);
+    }
+    g_mutex_unlock(&_Mutex);
+    return result;
 }
 
-void PurgeOld(void) {
-    //NOTE: called from inside mutex
-    unsigned long current = g_get_monotonic_time() / 1000;
-
-    GSList* prev = NULL;
-    for (GSList* iter = _HistoryElements; iter != NULL; iter = iter->next) {
-        HistoryEntry* entry = (HistoryEntry*) iter->data;
-        if ((current - entry->timestamp) > MAX_LIVE_TIME) {
-            if (prev == NULL)
-                _HistoryElements = iter->next;
-            else
-                prev->next = iter->next;
-
-            g_free(entry);
-            break;
-        }
-        prev = iter;
+static bool CopyEntry(const HistoryEntry* entry, HistoryItem* item) {
+    if (entry != NULL && item != NULL) {
+        *item = entry->item;
     }
+    return entry != NULL;
 }
 
-GArray* history_GetProvisioned(void) {
+bool history_FindById(int id, HistoryItem* item) {
     g_mutex_lock(&_Mutex);
     PurgeOld();
-
-    GArray* result = g_array_new(FALSE, FALSE, sizeof(HistoryItem));
-    for (GSList* iter = _HistoryElements; iter != NULL; iter = iter->next) {
-        HistoryEntry* entry = (HistoryEntry*) iter->data;
-        HistoryItem item;
-        item.id = entry->id;
-        memset(item.name, 0, MAX_HISTORY_NAME);
-        strcpy(item.name, entry->name);
-        item.isErrored = entry->isErrored;
-        g_array_append_val(result, item);
-    }
+    bool result = CopyEntry(g_hash_table_lookup(_EntriesById, GINT_TO_POINTER(id)), item);
     g_mutex_unlock(&_Mutex);
+    return result;
+}
 
+bool history_FindByName(const char* name, HistoryItem* item) {
+    g_mutex_lock(&_Mutex);
+    PurgeOld();
+    GQueue* sameName = g_hash_table_lookup(_EntriesByName, name);
+    bool result = CopyEntry(sameName != NULL ? g_queue_peek_tail(sameName) : NULL, item);
+    g_mutex_unlock(&_Mutex);
     return result;
 }
 
+void history_Expire(void) {
+    g_mutex_lock(&_Mutex);
+    PurgeOld();
+    g_mutex_unlock(&_Mutex);
+}
+
+guint history_GetVersion(void) {
+    return g_atomic_int_get(&_Version);
+}
+
+int history_GetLastClickerId(void) {
+    return _LastClickerId;
+}
+
 void history_RemoveProvisioned(int id) {
     g_mutex_lock(&_Mutex);
-    GSList* prev = NULL;
-    for (GSList* iter = _HistoryElements; iter != NULL; iter = iter->next) {
-        HistoryEntry* entry = (HistoryEntry*) iter->data;
-        if (entry->id == id) {
-            if (prev == NULL)
-                _HistoryElements = iter->next;
-            else
-                prev->next = iter->next;
-
-            g_free(entry);
-            break;
-        }
-        prev = iter;
+    HistoryEntry* entry = g_hash_table_lookup(_EntriesById, GINT_TO_POINTER(id));
+    if (entry != NULL) {
+        JournalEntry(JournalRecord_REMOVED, entry);
+        RemoveEntry(entry);
     }
     g_mutex_unlock(&_Mutex);
 }
@@ -35,21 +35,60 @@
 #include "event.h"
 
 #define MAX_HISTORY_NAME 40
+#define MAX_HISTORY_IDENTITY 32
 
 typedef struct {
     int id;
     char name[MAX_HISTORY_NAME];
+    char identity[MAX_HISTORY_IDENTITY];    /**< PSK identity given to clicker */
+    gint64 timestamp;                       /**< unix time in millis when clicker got PSK */
+    int error;
     bool isErrored;
 } HistoryItem;
 
-void history_Init(void);
+/**
+ * @brief Load history kept in journal file and keep appending to it.
+ * @param[in] journalPath journal file, NULL or empty to keep history in memory only
+ * @param[in] maxAge seconds for which clicker is kept in history, 0 for no limit
+ * @param[in] maxEntries number of clickers kept in history, the oldest ones are dropped above it, 0 for no limit
+ */
+void history_Init(const char* journalPath, int maxAge, int maxEntries);
 void history_Destroy(void);
 
 /**
- * @brief Returns array of HistoryItems.
+ * @brief Returns array of HistoryItems, newest first.
  */
 GArray* history_GetProvisioned(void);
 
+/**
+ * @brief Look up provisioned clicker by id.
+ * @param[out] item filled in if found, may be NULL
+ * @return true if clicker is in history
+ */
+bool history_FindById(int id, HistoryItem* item);
+
+/**
+ * @brief Look up provisioned clicker by endpoint name, the newest one if name was given more times.
+ * @param[out] item filled in if found, may be NULL
+ * @return true if clicker is in history
+ */
+bool history_FindByName(const char* name, HistoryItem* item);
+
+/**
+ * @brief Drop entries which exceeded retention now, otherwise it's done on next insertion or lookup.
+ */
+void history_Expire(void);
+
+/**
+ * @brief Number which changes whenever any entry is added or removed, so readers can tell if history changed.
+ */
+guint history_GetVersion(void);
+
+/**
+ * @brief Highest clicker id found in journal, ids given to new connections have to be higher.
+ */
+int history_GetLastClickerId(void);
+
 bool history_ConsumeEvent(Event* event);
 
 #endif /* __PROVISION_HISTORY_H__ */
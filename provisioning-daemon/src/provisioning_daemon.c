@@ -45,15 +45,21 @@
 #include <glib.h>
 
 #include "provisioning_daemon.h"
+#include "autotune.h"
 #include "clicker.h"
 #include "clicker_sm.h"
 #include "commands.h"
 #include "connection_manager.h"
+#include "crypto/aes_backend.h"
 #include "crypto/bigint.h"
 #include "crypto/crypto_config.h"
+#include "crypto/dh_table.h"
+#include "crypto/diffie_hellman_keys_exchanger.h"
 #include "errors.h"
 #include "controls.h"
+#include "notifier.h"
 #include "provision_history.h"
+#include "state_snapshot.h"
 #include "ubus_agent.h"
 #include "utils.h"
 #include "event.h"
@@ -69,6 +75,23 @@
 #define CONFIG_DEFAULT_ENDPOINT_PATTERN         "cd_{t}_{i}"
 #define CONFIG_DEFAULT_LOCAL_PROV_CTRL          (true)
 #define CONFIG_DEFAULT_REMOTE_PROV_CTRL         (false)
+#define CONFIG_DEFAULT_DH_STEP_BUDGET_US        (10000)
+#define CONFIG_DEFAULT_AES_BACKEND              "auto"
+#define CONFIG_DEFAULT_DH_TABLE_FILE            "/var/lib/provisioning_daemon/dh_table.bin"
+#define CONFIG_DEFAULT_AUTOTUNE                 (false)
+#define CONFIG_DEFAULT_HISTORY_JOURNAL_FILE     "/etc/provisioning_daemon/history.journal"
+#define CONFIG_DEFAULT_HISTORY_MAX_AGE_S        (10 * 60)
+#define CONFIG_DEFAULT_HISTORY_MAX_ENTRIES      (1000)
+#define CONFIG_DEFAULT_PSK_MAX_IN_FLIGHT        (4)
+#define CONFIG_DEFAULT_PSK_TIMEOUT_MS           (10000)
+#define CONFIG_DEFAULT_PSK_RETRIES              (2)
+#define CONFIG_DEFAULT_PSK_RETRY_BACKOFF_MS     (1000)
+#define CONFIG_DEFAULT_PSK_RESERVOIR_DEPTH      (0)
+#define CONFIG_DEFAULT_PSK_RESERVOIR_MAX_AGE_S  (60 * 60)
+#define CONFIG_DEFAULT_PSK_RESERVOIR_SHUTDOWN   "discard"
+
+/** Autotuner choice is cached in file next to the config file, with this suffix */
+#define AUTOTUNE_CACHE_SUFFIX                   ".tune"
 //! @cond Doxygen_Suppress
 
 /***************************************************************************************************
@@ -84,6 +107,18 @@ static FILE * _DebugStream = NULL;
 
 static config_t _Cfg;
 
+/**
+ * Fixed-base table used to generate Diffie-Hellman exchange keys, NULL if disabled.
+ */
+static DhTable* _DhTable = NULL;
+
+/**
+ * Window of Diffie-Hellman table, picked by autotuner when it's enabled.
+ */
+static int _DhWindowBits = DH_TABLE_DEFAULT_WINDOW_BITS;
+
+static gchar *_AutotuneCachePath = NULL;
+
 pd_Config _PDConfig = {
     .tcpPort = 0,
     .defaultRouteUri = NULL,
@@ -92,7 +127,21 @@ pd_Config _PDConfig = {
     .endPointNamePattern = NULL,
     .logLevel = 0,
     .localProvisionControl = false,
-    .remoteProvisionControl = false
+    .remoteProvisionControl = false,
+    .dhStepBudget = 0,
+    .aesBackend = NULL,
+    .dhTableFile = NULL,
+    .autotune = false,
+    .historyJournalFile = NULL,
+    .historyMaxAge = 0,
+    .historyMaxEntries = 0,
+    .pskMaxInFlight = 0,
+    .pskTimeoutMs = 0,
+    .pskRetries = 0,
+    .pskRetryBackoffMs = 0,
+    .pskReservoirDepth = 0,
+    .pskReservoirMaxAge = 0,
+    .pskReservoirShutdown = NULL
 };
 
 GMutex _LogMutex;
@@ -110,6 +159,23 @@ static void CtrlCHandler(int signal)
     _KeepRunning = false;
 }
 
+/**
+ * @brief Reads integer option, default is used when it's missing or lower than minimum.
+ */
+static void LookupIntAtLeast(const char *name, int *value, int defaultValue, int minimum)
+{
+    if(!config_lookup_int(&_Cfg, name, value))
+    {
+        g_warning("Config file does not contain %s property, using default: %d", name, defaultValue);
+        *value = defaultValue;
+    }
+    else if (*value < minimum)
+    {
+        g_warning("Config file contains illegal value of %s, using default: %d", name, defaultValue);
+        *value = defaultValue;
+    }
+}
+
 static bool ReadConfigFile(const char *filePath)
 {
     config_init(&_Cfg);
@@ -200,9 +266,156 @@ static bool ReadConfigFile(const char *filePath)
         }
     }
 
+    if(!config_lookup_int(&_Cfg, "DH_STEP_BUDGET_US", &_PDConfig.dhStepBudget))
+    {
+        g_warning("Config file does not contain DH_STEP_BUDGET_US property, using default: %d",
+                CONFIG_DEFAULT_DH_STEP_BUDGET_US);
+        _PDConfig.dhStepBudget = CONFIG_DEFAULT_DH_STEP_BUDGET_US;
+    }
+    else if (_PDConfig.dhStepBudget < 0)
+    {
+        g_warning("Config file contains illegal value of DH_STEP_BUDGET_US, forcing blocking key exchange");
+        _PDConfig.dhStepBudget = 0;
+    }
+
+    if(!config_lookup_string(&_Cfg, "AES_BACKEND", &_PDConfig.aesBackend))
+    {
+        g_warning("Config file does not contain AES_BACKEND property, using default: %s", CONFIG_DEFAULT_AES_BACKEND);
+        _PDConfig.aesBackend = CONFIG_DEFAULT_AES_BACKEND;
+    }
+
+    if(!config_lookup_string(&_Cfg, "DH_TABLE_FILE", &_PDConfig.dhTableFile))
+    {
+        g_warning("Config file does not contain DH_TABLE_FILE property, using default: %s",
+                CONFIG_DEFAULT_DH_TABLE_FILE);
+        _PDConfig.dhTableFile = CONFIG_DEFAULT_DH_TABLE_FILE;
+    }
+
+    if(!config_lookup_bool(&_Cfg, "AUTOTUNE", &_PDConfig.autotune))
+    {
+        g_warning("Config file does not contain AUTOTUNE property, using default: %d", CONFIG_DEFAULT_AUTOTUNE);
+        _PDConfig.autotune = CONFIG_DEFAULT_AUTOTUNE;
+    }
+
+    if(!config_lookup_string(&_Cfg, "HISTORY_JOURNAL_FILE", &_PDConfig.historyJournalFile))
+    {
+        g_warning("Config file does not contain HISTORY_JOURNAL_FILE property, using default: %s",
+                CONFIG_DEFAULT_HISTORY_JOURNAL_FILE);
+        _PDConfig.historyJournalFile = CONFIG_DEFAULT_HISTORY_JOURNAL_FILE;
+    }
+
+    if(!config_lookup_int(&_Cfg, "HISTORY_MAX_AGE_S", &_PDConfig.historyMaxAge))
+    {
+        g_warning("Config file does not contain HISTORY_MAX_AGE_S property, using default: %d",
+                CONFIG_DEFAULT_HISTORY_MAX_AGE_S);
+        _PDConfig.historyMaxAge = CONFIG_DEFAULT_HISTORY_MAX_AGE_S;
+    }
+    else if (_PDConfig.historyMaxAge < 0)
+    {
+        g_warning("Config file contains illegal value of HISTORY_MAX_AGE_S, using default: %d",
+                CONFIG_DEFAULT_HISTORY_MAX_AGE_S);
+        _PDConfig.historyMaxAge = CONFIG_DEFAULT_HISTORY_MAX_AGE_S;
+    }
+
+    if(!config_lookup_int(&_Cfg, "HISTORY_MAX_ENTRIES", &_PDConfig.historyMaxEntries))
+    {
+        g_warning("Config file does not contain HISTORY_MAX_ENTRIES property, using default: %d",
+                CONFIG_DEFAULT_HISTORY_MAX_ENTRIES);
+        _PDConfig.historyMaxEntries = CONFIG_DEFAULT_HISTORY_MAX_ENTRIES;
+    }
+    else if (_PDConfig.historyMaxEntries < 0)
+    {
+        g_warning("Config file contains illegal value of HISTORY_MAX_ENTRIES, using default: %d",
+                CONFIG_DEFAULT_HISTORY_MAX_ENTRIES);
+        _PDConfig.historyMaxEntries = CONFIG_DEFAULT_HISTORY_MAX_ENTRIES;
+    }
+
+    LookupIntAtLeast("PSK_MAX_IN_FLIGHT", &_PDConfig.pskMaxInFlight, CONFIG_DEFAULT_PSK_MAX_IN_FLIGHT, 1);
+    LookupIntAtLeast("PSK_TIMEOUT_MS", &_PDConfig.pskTimeoutMs, CONFIG_DEFAULT_PSK_TIMEOUT_MS, 1);
+    LookupIntAtLeast("PSK_RETRIES", &_PDConfig.pskRetries, CONFIG_DEFAULT_PSK_RETRIES, 0);
+    LookupIntAtLeast("PSK_RETRY_BACKOFF_MS", &_PDConfig.pskRetryBackoffMs, CONFIG_DEFAULT_PSK_RETRY_BACKOFF_MS, 0);
+    LookupIntAtLeast("PSK_RESERVOIR_DEPTH", &_PDConfig.pskReservoirDepth, CONFIG_DEFAULT_PSK_RESERVOIR_DEPTH, 0);
+    LookupIntAtLeast("PSK_RESERVOIR_MAX_AGE_S", &_PDConfig.pskReservoirMaxAge, CONFIG_DEFAULT_PSK_RESERVOIR_MAX_AGE_S,
+            0);
+
+    if(!config_lookup_string(&_Cfg, "PSK_RESERVOIR_SHUTDOWN", &_PDConfig.pskReservoirShutdown))
+    {
+        g_warning("Config file does not contain PSK_RESERVOIR_SHUTDOWN property, using default: %s",
+                CONFIG_DEFAULT_PSK_RESERVOIR_SHUTDOWN);
+        _PDConfig.pskReservoirShutdown = CONFIG_DEFAULT_PSK_RESERVOIR_SHUTDOWN;
+    }
+    else if (strcmp(_PDConfig.pskReservoirShutdown, "discard") != 0 &&
+            strcmp(_PDConfig.pskReservoirShutdown, "report") != 0)
+    {
+        g_warning("Config file contains illegal value of PSK_RESERVOIR_SHUTDOWN, using default: %s",
+                CONFIG_DEFAULT_PSK_RESERVOIR_SHUTDOWN);
+        _PDConfig.pskReservoirShutdown = CONFIG_DEFAULT_PSK_RESERVOIR_SHUTDOWN;
+    }
+
     return true;
 }
 
+static void SelectAesBackend(void)
+{
+    const AesBackend *backend = aes_SelectBackend(_PDConfig.aesBackend);
+    if (backend == NULL)
+    {
+        g_warning("AES backend %s is unknown or not supported by this CPU, selecting automatically",
+                _PDConfig.aesBackend);
+        backend = aes_SelectBackend(NULL);
+    }
+    g_message("Using %s AES backend%s", backend->name, backend->constantTime ? "" : " (not constant time)");
+}
+
+/**
+ * @brief Picks crypto variants fastest on this CPU when AUTOTUNE is on. AES_BACKEND set to other value than auto
+ * still wins over the tuned backend.
+ */
+static void Autotune(void)
+{
+    if (!_PDConfig.autotune)
+        return;
+
+    const AutotuneResult *result = autotune_Init(_AutotuneCachePath);
+    if (_PDConfig.aesBackend == NULL || strcmp(_PDConfig.aesBackend, "auto") == 0)
+        _PDConfig.aesBackend = result->aesBackend;
+
+    _DhWindowBits = result->dhWindowBits;
+}
+
+/**
+ * @brief Maps fixed-base Diffie-Hellman table from DH_TABLE_FILE, file is (re)computed when it's missing or was
+ * made for other parameters. Failure to save it only costs computing it again on next start.
+ */
+static void LoadDhTable(void)
+{
+    const char *path = _PDConfig.dhTableFile;
+    if (path == NULL || path[0] == '\0')
+    {
+        g_message("Diffie-Hellman fixed-base table is disabled");
+        return;
+    }
+
+    gint64 start = g_get_monotonic_time();
+    _DhTable = dh_LoadTable(path, g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, _DhWindowBits);
+    if (_DhTable != NULL)
+    {
+        g_message("Mapped Diffie-Hellman table %s in %" G_GINT64_FORMAT " us", path, g_get_monotonic_time() - start);
+    }
+    else
+    {
+        _DhTable = dh_BuildTable(g_KeyBuffer, P_MODULE_LENGTH, CRYPTO_G_MODULE, _DhWindowBits);
+        g_message("Computed Diffie-Hellman table in %" G_GINT64_FORMAT " us", g_get_monotonic_time() - start);
+
+        gchar *directory = g_path_get_dirname(path);
+        if (g_mkdir_with_parents(directory, 0755) != 0 || !dh_SaveTable(_DhTable, path))
+            g_warning("Unable to save Diffie-Hellman table to %s, it will be computed again on next start", path);
+
+        g_free(directory);
+    }
+    dh_SetFixedBaseTable(_DhTable);
+}
+
 static void Daemonise(void)
 {
     pid_t pid;
@@ -285,6 +498,7 @@ static int ParseCommandArgs(int argc, char *argv[], const char **fptr)
         sprintf(configFilePath, "%s", DEFAULT_PATH_CONFIG_FILE);
     }
 
+    _AutotuneCachePath = g_strconcat(configFilePath, AUTOTUNE_CACHE_SUFFIX, NULL);
     if (ReadConfigFile(configFilePath) == false)
         return -1;
 
@@ -297,6 +511,12 @@ static int ParseCommandArgs(int argc, char *argv[], const char **fptr)
 void CleanupOnExit(void)
 {
     ubusagent_Destroy();
+    snapshot_Shutdown();
+    notifier_Shutdown();
+    dh_SetFixedBaseTable(NULL);
+    dh_ReleaseTable(&_DhTable);
+    g_free(_AutotuneCachePath);
+    _AutotuneCachePath = NULL;
     bi_ReleaseConst();
     controls_Shutdown();
 
@@ -404,11 +624,26 @@ int main(int argc, char **argv)
 
     srand(time(NULL));
     bi_GenerateConst();
-    history_Init();
+    Autotune();
+    LoadDhTable();
+    SelectAesBackend();
+    history_Init(_PDConfig.historyJournalFile, _PDConfig.historyMaxAge, _PDConfig.historyMaxEntries);
+    con_SkipClickerIds(history_GetLastClickerId());
     controls_Init(_PDConfig.localProvisionControl != 0);
     clicker_Init();
-
-    if (ubusagent_Init() == false)
+    snapshot_Init();
+    notifier_Init();
+
+    PskRequestConfig pskConfig = {
+        .maxInFlight = _PDConfig.pskMaxInFlight,
+        .timeoutMs = _PDConfig.pskTimeoutMs,
+        .retries = _PDConfig.pskRetries,
+        .retryBackoffMs = _PDConfig.pskRetryBackoffMs,
+        .reservoirDepth = _PDConfig.pskReservoirDepth,
+        .reservoirMaxAgeS = _PDConfig.pskReservoirMaxAge,
+        .reportUnusedOnShutdown = strcmp(_PDConfig.pskReservoirShutdown, "report") == 0
+    };
+    if (ubusagent_Init(&pskConfig) == false)
     {
         g_critical("Unable to register to uBus!");
         CleanupOnExit();
@@ -444,11 +679,17 @@ int main(int argc, char **argv)
             controls_ConsumeEvent(event);
             clicker_sm_ConsumeEvent(event);
             history_ConsumeEvent(event);
+            snapshot_ConsumeEvent(event);
+            notifier_ConsumeEvent(event);
 
             event_ReleaseEvent(&event);
         }
         //-----------------
 
+        clicker_sm_Update();
+        snapshot_Update();
+        notifier_Update();
+
         gint64 loopEndTime = g_get_monotonic_time() / 1000;
         if (loopEndTime - loopStartTime < 50)
             usleep(1000 * (50 - (loopEndTime - loopStartTime)));
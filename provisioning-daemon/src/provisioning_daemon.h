@@ -30,6 +30,20 @@ typedef struct {
     int logLevel;
     int localProvisionControl;
     int remoteProvisionControl;
+    int dhStepBudget;
+    const char *aesBackend;
+    const char *dhTableFile;
+    int autotune;
+    const char *historyJournalFile;
+    int historyMaxAge;
+    int historyMaxEntries;
+    int pskMaxInFlight;
+    int pskTimeoutMs;
+    int pskRetries;
+    int pskRetryBackoffMs;
+    int pskReservoirDepth;
+    int pskReservoirMaxAge;
+    const char *pskReservoirShutdown;
 } pd_Config;
 
 extern pd_Config _PDConfig;
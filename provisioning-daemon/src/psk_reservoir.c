@@ -0,0 +1,164 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "psk_reservoir.h"
+#include "crypto/wipe.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <glib.h>
+
+typedef struct {
+    PreSharedKey psk;
+    gint64 obtainedAt;      /**< monotonic time in microseconds */
+} ReservoirEntry;
+
+/** Ring of entries, the oldest one is at _Head */
+static ReservoirEntry* _Entries = NULL;
+static size_t _EntriesSize = 0;
+static int _Depth = 0;
+static int _Head = 0;
+static int _Count = 0;
+static gint64 _MaxAgeUs = 0;
+
+bool pskreservoir_Init(int depth, int maxAgeS)
+{
+    if (depth <= 0)
+        return true;
+
+    _EntriesSize = sizeof(ReservoirEntry) * depth;
+    _Entries = mmap(NULL, _EntriesSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (_Entries == MAP_FAILED)
+    {
+        g_critical("PSK reservoir: Can't allocate memory: %s", strerror(errno));
+        _Entries = NULL;
+        return false;
+    }
+    if (mlock(_Entries, _EntriesSize) != 0)
+        g_warning("PSK reservoir: Can't lock memory, entries may be swapped out: %s", strerror(errno));
+
+#ifdef MADV_DONTDUMP
+    madvise(_Entries, _EntriesSize, MADV_DONTDUMP);
+#endif
+
+    _Depth = depth;
+    _Head = 0;
+    _Count = 0;
+    _MaxAgeUs = (gint64)maxAgeS * G_USEC_PER_SEC;
+    g_message("PSK reservoir: keeping %d entries", depth);
+    return true;
+}
+
+static ReservoirEntry* Oldest(void)
+{
+    return &_Entries[_Head];
+}
+
+static void DropOldest(void)
+{
+    crypto_Wipe(Oldest(), sizeof(ReservoirEntry));
+    _Head = (_Head + 1) % _Depth;
+    _Count--;
+}
+
+static void Expire(void)
+{
+    if (_MaxAgeUs == 0)
+        return;
+
+    gint64 now = g_get_monotonic_time();
+    while (_Count > 0 && now - Oldest()->obtainedAt > _MaxAgeUs)
+    {
+        g_message("PSK reservoir: identity %s expired", Oldest()->psk.identity);
+        DropOldest();
+    }
+}
+
+void pskreservoir_Shutdown(bool reportUnused)
+{
+    if (_Entries == NULL)
+        return;
+
+    while (_Count > 0)
+    {
+        if (reportUnused)
+            g_message("PSK reservoir: identity %s hasn't been used", Oldest()->psk.identity);
+
+        DropOldest();
+    }
+    crypto_Wipe(_Entries, _EntriesSize);
+    munlock(_Entries, _EntriesSize);
+    munmap(_Entries, _EntriesSize);
+    _Entries = NULL;
+    _Depth = 0;
+}
+
+int pskreservoir_GetMissing(void)
+{
+    if (_Entries == NULL)
+        return 0;
+
+    Expire();
+    return _Depth - _Count;
+}
+
+void pskreservoir_Put(const PreSharedKey* psk)
+{
+    if (_Entries == NULL)
+        return;
+
+    if (_Count == _Depth)
+    {
+        g_warning("PSK reservoir: full, dropping identity %s", psk->identity);
+        return;
+    }
+    ReservoirEntry* entry = &_Entries[(_Head + _Count) % _Depth];
+    memcpy(&entry->psk, psk, sizeof(entry->psk));
+    entry->psk.clickerId = 0;
+    entry->obtainedAt = g_get_monotonic_time();
+    _Count++;
+}
+
+bool pskreservoir_Take(PreSharedKey* psk)
+{
+    if (_Entries == NULL)
+        return false;
+
+    Expire();
+    if (_Count == 0)
+        return false;
+
+    int clickerId = psk->clickerId;
+    memcpy(psk, &Oldest()->psk, sizeof(*psk));
+    psk->clickerId = clickerId;
+    DropOldest();
+    return true;
+}
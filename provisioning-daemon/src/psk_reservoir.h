@@ -0,0 +1,75 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  psk_reservoir.h
+ * @brief Keeps PSK/identity pairs obtained from Device Server before any clicker asks for them, so provisioning
+ * doesn't have to wait for generatePsk round trip.
+ *
+ * Entries live in memory which is locked (not swapped out) and excluded from core dumps, they are wiped when taken,
+ * expired or discarded. Entry is taken oldest first and dropped when it's older than maximum age. Not thread safe,
+ * used only by ubus thread.
+ */
+
+#ifndef __PSK_RESERVOIR_H__
+#define __PSK_RESERVOIR_H__
+
+#include <stdbool.h>
+#include "ubus_agent.h"
+
+/**
+ * @brief Allocate space for depth entries, reservoir is disabled (all calls are no-ops) when depth is 0.
+ * @param[in] maxAgeS entries older than it are dropped, 0 means no limit
+ */
+bool pskreservoir_Init(int depth, int maxAgeS);
+
+/**
+ * @brief Wipe and release all entries.
+ * @param[in] reportUnused log identities of entries which were never used, so they can be removed from Device Server
+ */
+void pskreservoir_Shutdown(bool reportUnused);
+
+/**
+ * @brief Number of entries needed to fill reservoir to its depth, expired entries are dropped first.
+ */
+int pskreservoir_GetMissing(void);
+
+/**
+ * @brief Store copy of PSK, nothing is stored when reservoir is full. Caller should wipe its own copy.
+ */
+void pskreservoir_Put(const PreSharedKey* psk);
+
+/**
+ * @brief Move the oldest entry which hasn't expired to psk (clickerId is left untouched).
+ * @return false if reservoir is empty
+ */
+bool pskreservoir_Take(PreSharedKey* psk);
+
+#endif /* __PSK_RESERVOIR_H__ */
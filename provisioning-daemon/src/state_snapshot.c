@@ -0,0 +1,420 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "state_snapshot.h"
+
+#include <string.h>
+
+#include "clicker.h"
+#include "commands.h"
+#include "controls.h"
+#include "provision_history.h"
+#include "ubus_agent.h"
+#include "utils.h"
+
+#define HISTORY_EXPIRY_INTERVAL_MS  (1000)
+#define MAX_DELTA_CHANGES           (512)       /**< changes kept for delta replies, older clients get full one */
+
+/**
+ * Clicker as listed in reply, either connected one or entry of history.
+ */
+typedef struct {
+    int id;
+    char name[COMMAND_ENDPOINT_NAME_LENGTH];
+    bool selected;
+    bool inProvisionState;
+    bool isProvisioned;
+    bool isError;
+} StateRow;
+
+/**
+ * Row which changed in given version, removed rows are reported by id only.
+ */
+typedef struct {
+    uint64_t version;
+    bool removed;
+    StateRow row;
+} StateChange;
+
+/** Connected clickers by id, ordered by id so reply lists them in order of connection */
+static GTree* _ConnectedRows = NULL;
+/** Provisioned clickers, newest first, reloaded when history version changes */
+static GArray* _HistoryRows = NULL;
+/** Id -> HistoryItem in _HistoryRows */
+static GHashTable* _HistoryIds = NULL;
+static guint _HistoryVersion = 0;
+static gint64 _LastHistoryExpiry = 0;
+/** Ids of clickers touched by events since last update */
+static GHashTable* _DirtyIds = NULL;
+/** Id -> StateRow as it was last published, for change detection */
+static GHashTable* _VisibleRows = NULL;
+static int _SelectedId = -1;
+
+static GMutex _Mutex;
+/** Guarded by _Mutex: */
+static StateSnapshot* _Published = NULL;
+static uint64_t _Version = 0;
+/** StateChange ordered by version, at most MAX_DELTA_CHANGES of them */
+static GArray* _Changes = NULL;
+/** Delta can be built for versions since this one, changes after it are all in _Changes */
+static uint64_t _OldestDeltaVersion = 0;
+
+static gint CompareIds(gconstpointer a, gconstpointer b, gpointer data) {
+    int first = GPOINTER_TO_INT(a);
+    int second = GPOINTER_TO_INT(b);
+    return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+static void MarkDirty(GHashTable* ids, int clickerId) {
+    if (clickerId >= 0) {
+        g_hash_table_add(ids, GINT_TO_POINTER(clickerId));
+    }
+}
+
+static void RefreshConnectedRow(int clickerId) {
+    const Clicker* clicker = clicker_AcquireReadOnly(clickerId);
+    if (clicker == NULL) {
+        //destroyed
+        g_tree_remove(_ConnectedRows, GINT_TO_POINTER(clickerId));
+        return;
+    }
+
+    StateRow* row = g_new0(StateRow, 1);
+    row->id = clicker->clickerID;
+    strlcpy(row->name, clicker->name, sizeof(row->name));
+    row->selected = clicker->clickerID == _SelectedId;
+    row->inProvisionState = clicker->provisioningInProgress;
+    row->isProvisioned = false;
+    row->isError = clicker->error > 0;
+    clicker_ReleaseReadOnly(clicker);
+    g_tree_insert(_ConnectedRows, GINT_TO_POINTER(clickerId), row);
+}
+
+static void HistoryRow(const HistoryItem* history, StateRow* row) {
+    memset(row, 0, sizeof(*row));
+    row->id = history->id;
+    strlcpy(row->name, history->name, sizeof(row->name));
+    row->selected = false;
+    row->inProvisionState = false;
+    row->isProvisioned = true;
+    row->isError = history->isErrored;
+}
+
+/**
+ * Reload history if it changed, ids which were in old or are in new history are added to touched.
+ */
+static void RefreshHistory(GHashTable* touched) {
+    if (g_get_monotonic_time() / 1000 - _LastHistoryExpiry >= HISTORY_EXPIRY_INTERVAL_MS) {
+        history_Expire();
+        _LastHistoryExpiry = g_get_monotonic_time() / 1000;
+    }
+
+    guint version = history_GetVersion();
+    if (version == _HistoryVersion && _HistoryRows != NULL) {
+        return;
+    }
+    _HistoryVersion = version;
+
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, _HistoryIds);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        MarkDirty(touched, GPOINTER_TO_INT(key));
+    }
+    g_hash_table_remove_all(_HistoryIds);
+    if (_HistoryRows != NULL) {
+        g_array_free(_HistoryRows, TRUE);
+    }
+
+    _HistoryRows = history_GetProvisioned();
+    for (guint t = 0; t < _HistoryRows->len; t++) {
+        HistoryItem* history = &g_array_index(_HistoryRows, HistoryItem, t);
+        g_hash_table_insert(_HistoryIds, GINT_TO_POINTER(history->id), history);
+        MarkDirty(touched, history->id);
+    }
+}
+
+static void AddRow(struct blob_buf* reply, const StateRow* row) {
+    void* cookie_item = blobmsg_open_table(reply, "clicker");
+    blobmsg_add_u32(reply, "id", row->id);
+    blobmsg_add_string(reply, "name", row->name);
+    blobmsg_add_u8(reply, "selected", row->selected);
+    blobmsg_add_u8(reply, "inProvisionState", row->inProvisionState);
+    blobmsg_add_u8(reply, "isProvisioned", row->isProvisioned);
+    blobmsg_add_u8(reply, "isError", row->isError);
+    blobmsg_close_table(reply, cookie_item);
+}
+
+static gboolean AddConnectedRow(gpointer key, gpointer value, gpointer data) {
+    //provisioned clickers are already listed from history
+    if (!g_hash_table_contains(_HistoryIds, key)) {
+        AddRow(data, value);
+    }
+    return FALSE;
+}
+
+/**
+ * Compare what reply should show for the clicker with what was published and record the change.
+ * @return true if row changed
+ */
+static bool RecordChange(int clickerId, uint64_t version) {
+    StateChange change;
+    memset(&change, 0, sizeof(change));
+    change.version = version;
+
+    const HistoryItem* history = g_hash_table_lookup(_HistoryIds, GINT_TO_POINTER(clickerId));
+    const StateRow* connected = g_tree_lookup(_ConnectedRows, GINT_TO_POINTER(clickerId));
+    if (history != NULL) {
+        HistoryRow(history, &change.row);
+    } else if (connected != NULL) {
+        change.row = *connected;
+    } else {
+        change.removed = true;
+        change.row.id = clickerId;
+    }
+
+    StateRow* visible = g_hash_table_lookup(_VisibleRows, GINT_TO_POINTER(clickerId));
+    if (change.removed) {
+        if (visible == NULL) {
+            return false;
+        }
+        g_hash_table_remove(_VisibleRows, GINT_TO_POINTER(clickerId));
+    } else {
+        if (visible != NULL && memcmp(visible, &change.row, sizeof(StateRow)) == 0) {
+            return false;
+        }
+        g_hash_table_insert(_VisibleRows, GINT_TO_POINTER(clickerId), g_memdup(&change.row, sizeof(StateRow)));
+    }
+
+    //NOTE: called from inside mutex
+    if (_Changes->len == MAX_DELTA_CHANGES) {
+        _OldestDeltaVersion = g_array_index(_Changes, StateChange, 0).version;
+        g_array_remove_index(_Changes, 0);
+    }
+    g_array_append_val(_Changes, change);
+    return true;
+}
+
+static StateSnapshot* BuildSnapshot(uint64_t version) {
+    StateSnapshot* snapshot = g_new0(StateSnapshot, 1);
+    snapshot->refCount = 1;
+    snapshot->version = version;
+    blob_buf_init(&snapshot->reply, 0);
+
+    blobmsg_add_u64(&snapshot->reply, "version", version);
+    blobmsg_add_u8(&snapshot->reply, "full", true);
+    void* cookie_array = blobmsg_open_array(&snapshot->reply, "clickers");
+    for (guint t = 0; t < _HistoryRows->len; t++) {
+        StateRow row;
+        HistoryRow(&g_array_index(_HistoryRows, HistoryItem, t), &row);
+        AddRow(&snapshot->reply, &row);
+    }
+    g_tree_foreach(_ConnectedRows, AddConnectedRow, &snapshot->reply);
+    blobmsg_close_array(&snapshot->reply, cookie_array);
+    return snapshot;
+}
+
+void snapshot_Init(void) {
+    g_mutex_init(&_Mutex);
+    _ConnectedRows = g_tree_new_full(CompareIds, NULL, NULL, g_free);
+    _HistoryIds = g_hash_table_new(g_direct_hash, g_direct_equal);
+    _DirtyIds = g_hash_table_new(g_direct_hash, g_direct_equal);
+    _VisibleRows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    _Changes = g_array_new(FALSE, FALSE, sizeof(StateChange));
+    _SelectedId = -1;
+    //versions keep growing over restarts (there are fewer changes than milliseconds), so version given out by previous
+    //run of daemon is always too old for delta
+    _Version = g_get_real_time() / 1000;
+    _OldestDeltaVersion = _Version;
+
+    snapshot_Update();
+    if (_Published == NULL) {
+        _Published = BuildSnapshot(_Version);
+    }
+}
+
+void snapshot_Shutdown(void) {
+    g_mutex_lock(&_Mutex);
+    StateSnapshot* old = _Published;
+    _Published = NULL;
+    g_mutex_unlock(&_Mutex);
+    if (old != NULL) {
+        snapshot_Release(old);
+    }
+
+    g_tree_destroy(_ConnectedRows);
+    _ConnectedRows = NULL;
+    if (_HistoryRows != NULL) {
+        g_array_free(_HistoryRows, TRUE);
+        _HistoryRows = NULL;
+    }
+    g_hash_table_destroy(_HistoryIds);
+    _HistoryIds = NULL;
+    g_hash_table_destroy(_DirtyIds);
+    _DirtyIds = NULL;
+    g_hash_table_destroy(_VisibleRows);
+    _VisibleRows = NULL;
+    g_array_free(_Changes, TRUE);
+    _Changes = NULL;
+    g_mutex_clear(&_Mutex);
+}
+
+bool snapshot_ConsumeEvent(Event* event) {
+    switch (event->type) {
+        case EventType_CLICKER_CREATE:
+        case EventType_CLICKER_DESTROY:
+        case EventType_CLICKER_RENAMED:
+        case EventType_CLICKER_START_PROVISION:
+        case EventType_TRY_TO_SEND_PSK_TO_CLICKER:
+        case EventType_CLICKER_PROVISIONED:
+        case EventType_HISTORY_ADD:
+        case EventType_HISTORY_REMOVE:
+            MarkDirty(_DirtyIds, event->intData);
+            break;
+
+        case EventType_PSK_OBTAINED:
+            MarkDirty(_DirtyIds, ((PreSharedKey*) event->ptrData)->clickerId);
+            break;
+
+        default:
+            break;
+    }
+    return false;
+}
+
+void snapshot_Update(void) {
+    int selectedId = controls_GetSelectedClickerId();
+    if (selectedId != _SelectedId) {
+        MarkDirty(_DirtyIds, _SelectedId);
+        MarkDirty(_DirtyIds, selectedId);
+        _SelectedId = selectedId;
+    }
+
+    GHashTable* touched = g_hash_table_new(g_direct_hash, g_direct_equal);
+    RefreshHistory(touched);
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, _DirtyIds);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        RefreshConnectedRow(GPOINTER_TO_INT(key));
+        MarkDirty(touched, GPOINTER_TO_INT(key));
+    }
+    g_hash_table_remove_all(_DirtyIds);
+
+    g_mutex_lock(&_Mutex);
+    uint64_t version = _Version + 1;
+    bool changed = false;
+    g_hash_table_iter_init(&iter, touched);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        changed |= RecordChange(GPOINTER_TO_INT(key), version);
+    }
+    //version goes up together with its changes, so delta never has changes newer than version it reports; snapshot
+    //published below lags behind for a while, client which gets it asks for these changes by delta later
+    if (changed) {
+        _Version = version;
+    }
+    g_mutex_unlock(&_Mutex);
+    g_hash_table_destroy(touched);
+    if (!changed) {
+        return;
+    }
+
+    StateSnapshot* snapshot = BuildSnapshot(version);
+    g_mutex_lock(&_Mutex);
+    StateSnapshot* old = _Published;
+    _Published = snapshot;
+    g_mutex_unlock(&_Mutex);
+    if (old != NULL) {
+        snapshot_Release(old);
+    }
+}
+
+StateSnapshot* snapshot_Acquire(void) {
+    g_mutex_lock(&_Mutex);
+    StateSnapshot* snapshot = _Published;
+    if (snapshot != NULL) {
+        g_atomic_int_inc(&snapshot->refCount);
+    }
+    g_mutex_unlock(&_Mutex);
+    return snapshot;
+}
+
+void snapshot_Release(StateSnapshot* snapshot) {
+    if (g_atomic_int_dec_and_test(&snapshot->refCount)) {
+        blob_buf_free(&snapshot->reply);
+        g_free(snapshot);
+    }
+}
+
+bool snapshot_BuildDelta(uint64_t sinceVersion, struct blob_buf* reply) {
+    g_mutex_lock(&_Mutex);
+    if (sinceVersion < _OldestDeltaVersion || sinceVersion > _Version) {
+        g_mutex_unlock(&_Mutex);
+        return false;
+    }
+
+    blobmsg_add_u64(reply, "version", _Version);
+    blobmsg_add_u8(reply, "full", false);
+    //newest change of each clicker wins, walk from the end until version client already has
+    GHashTable* seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GPtrArray* latest = g_ptr_array_new();
+    for (guint t = _Changes->len; t > 0; t--) {
+        const StateChange* change = &g_array_index(_Changes, StateChange, t - 1);
+        if (change->version <= sinceVersion) {
+            break;
+        }
+        if (!g_hash_table_contains(seen, GINT_TO_POINTER(change->row.id))) {
+            g_hash_table_add(seen, GINT_TO_POINTER(change->row.id));
+            g_ptr_array_add(latest, (gpointer) change);
+        }
+    }
+
+    void* cookie_clickers = blobmsg_open_array(reply, "clickers");
+    for (guint t = 0; t < latest->len; t++) {
+        const StateChange* change = g_ptr_array_index(latest, t);
+        if (!change->removed) {
+            AddRow(reply, &change->row);
+        }
+    }
+    blobmsg_close_array(reply, cookie_clickers);
+
+    void* cookie_removed = blobmsg_open_array(reply, "removed");
+    for (guint t = 0; t < latest->len; t++) {
+        const StateChange* change = g_ptr_array_index(latest, t);
+        if (change->removed) {
+            blobmsg_add_u32(reply, NULL, change->row.id);
+        }
+    }
+    blobmsg_close_array(reply, cookie_removed);
+    g_mutex_unlock(&_Mutex);
+    g_ptr_array_free(latest, TRUE);
+    g_hash_table_destroy(seen);
+    return true;
+}
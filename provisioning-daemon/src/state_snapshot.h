@@ -0,0 +1,87 @@
+/***************************************************************************************************
+ * Copyright (c) 2016, Imagination Technologies Limited and/or its affiliated group companies
+ * and/or licensors
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+ *    and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list of
+ *    conditions and the following disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file  state_snapshot.h
+ * @brief State of connected and provisioned clickers as served by ubus getState.
+ *
+ * Main loop keeps a row per clicker and refreshes only rows touched by events, when any of them really changed the
+ * version is incremented and reply is serialized once. ubus thread takes reference of the last published snapshot and
+ * sends it as it is, so getState doesn't touch clickers, history or controls at all. Recent changes are kept too, so
+ * client which already has some version gets only clickers changed since then.
+ */
+
+#ifndef __STATE_SNAPSHOT_H__
+#define __STATE_SNAPSHOT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+#include <libubox/blobmsg.h>
+#include "event.h"
+
+/**
+ * @brief Serialized getState reply, immutable once published.
+ */
+typedef struct {
+    gint refCount;
+    uint64_t version;       /**< incremented on every change of state */
+    struct blob_buf reply;
+} StateSnapshot;
+
+void snapshot_Init(void);
+void snapshot_Shutdown(void);
+
+/**
+ * @brief Remember clickers touched by event, their rows are refreshed by snapshot_Update. Has to be called after
+ * consumers which change clicker state (con, clicker, controls, clicker_sm, history), so it sees state after they
+ * handled the event. notifier_ConsumeEvent only reads the event, so it may follow.
+ */
+bool snapshot_ConsumeEvent(Event* event);
+
+/**
+ * @brief Refresh rows changed since last call and publish new snapshot if state changed. Called from main loop.
+ */
+void snapshot_Update(void);
+
+/**
+ * @brief Take reference of the last published snapshot, thread safe. Has to be released by snapshot_Release.
+ */
+StateSnapshot* snapshot_Acquire(void);
+void snapshot_Release(StateSnapshot* snapshot);
+
+/**
+ * @brief Fill reply with clickers changed and ids of clickers removed since given version, thread safe.
+ * @return false if changes since that version are no longer kept (or version is unknown), full snapshot has to be
+ * sent then
+ */
+bool snapshot_BuildDelta(uint64_t sinceVersion, struct blob_buf* reply);
+
+#endif /* __STATE_SNAPSHOT_H__ */
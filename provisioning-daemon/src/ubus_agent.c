@@ -25,18 +25,25 @@
 #include <libubus.h>
 #include <libubox/blobmsg_json.h>
 #include <unistd.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
-#include <semaphore.h>
+#include <sys/eventfd.h>
 #include <sys/prctl.h>
 #include <glib.h>
 
+#include "autotune.h"
 #include "clicker.h"
 #include "controls.h"
 #include "provision_history.h"
+#include "psk_reservoir.h"
+#include "state_snapshot.h"
 #include "utils.h"
 #include "commands.h"
+#include "crypto/aes_backend.h"
+#include "crypto/diffie_hellman_keys_exchanger.h"
+#include "crypto/wipe.h"
 
 //forward declarations
 static int GetStateMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
@@ -45,32 +52,98 @@ static int GetStateMethodHandler(struct ubus_context *ctx, struct ubus_object *o
 static int SelectMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
         const char *method, struct blob_attr *msg);
 
+static int SelectNextMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
+        const char *method, struct blob_attr *msg);
+
 static int StartProvisionMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
         const char *method, struct blob_attr *msg);
 
 static int SetClickerNameMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
         const char *method, struct blob_attr *msg);
 
+static int GetTuningMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
+        const char *method, struct blob_attr *msg);
+
+static int GetHistoryMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
+        const char *method, struct blob_attr *msg);
+
+/** clickerId of generatePsk request which fills PSK reservoir */
+#define PSK_PREFETCH_ID                 (-1)
+/** Expired and missing reservoir entries are replaced at least this often */
+#define RESERVOIR_CHECK_INTERVAL_MS     (30 * 1000)
+/** Upper bound of delay before retry of generatePsk, however large PSK_RETRY_BACKOFF_MS is */
+#define PSK_MAX_RETRY_DELAY_MS          (10 * 60 * 1000)
+
 //variables & structs
+/**
+ * generatePsk call made for a clicker or PSK reservoir, with its retries. Used only by ubus thread.
+ */
 typedef struct {
     int clickerId;
-    bool toDelete;
+    int attempts;               //made so far
+    bool inFlight;
+    bool succeeded;             //PSK has been obtained and passed to main loop
     struct ubus_request request;
+    struct uloop_timeout deadline;
+    struct uloop_timeout retryTimer;
     struct blob_buf replyBloob;
-} UBusMemoryBlock;
+} PskRequest;
 
 static struct ubus_context *_UbusCTX;
 static pthread_t _UbusThread;
+static bool _UbusThreadStarted = false;
+static bool _UbusStopRequested = false;
 static char *_Path;
-static GMutex _Mutex;
-static bool _UBusRunning = false;
-static bool _UBusInterruption = false;
-static bool _UBusInInterState = false;
-struct uloop_timeout _UBusHelperProcess;
-//holds UBusMemoryBlock elements
-GSList* _UBusRequestMemory = NULL;
+static PskRequestConfig _PskConfig;
+//holds all PskRequest elements, used only by ubus thread
+static GSList* _PskRequests = NULL;
+//PskRequest elements waiting for free slot, at most _PskConfig.maxInFlight requests are sent at once
+static GQueue _PendingPskRequests = G_QUEUE_INIT;
+static int _PskRequestsInFlight = 0;
+//PskRequest elements made for PSK reservoir, sent or not
+static int _PrefetchesInProgress = 0;
+static struct uloop_timeout _ReservoirTimer;
+
+typedef enum {
+    UBusCommandType_NOTIFY,
+    UBusCommandType_GENERATE_PSK,
+    UBusCommandType_ADD_OBJECT,
+    UBusCommandType_STOP
+} UBusCommandType;
+
+/**
+ * Request posted by main thread, executed by ubus thread.
+ */
+typedef struct {
+    UBusCommandType type;
+    int clickerId;              //GENERATE_PSK
+    const char* notification;   //NOTIFY
+    struct blob_attr* message;  //NOTIFY
+} UBusCommand;
+
+static GAsyncQueue* _Commands = NULL;
+/** Signalled by PostCommand to wake up ubus thread, which executes queued commands */
+static int _CommandFd = -1;
+static struct uloop_fd _CommandUloopFd;
+
+/** Result of ubus_add_object, reported by ubus thread to ubusagent_EnableRemoteControl */
+static GMutex _AddObjectMutex;
+static GCond _AddObjectCond;
+static bool _AddObjectDone = false;
+static int _AddObjectResult = 0;
+
+enum {
+    GET_STATE_SINCE_VERSION,
+
+    GET_STATE_LAST_ENUM
+};
 
 static const struct blobmsg_policy _GetStatePolicy[] = {
+    //int32 or int64, depending on how big the number is
+    [GET_STATE_SINCE_VERSION] = { .name = "sinceVersion", .type = BLOBMSG_TYPE_UNSPEC },
+};
+
+static const struct blobmsg_policy _GetTuningPolicy[] = {
 };
 
 
@@ -84,10 +157,32 @@ static const struct blobmsg_policy _SelectPolicy[] = {
     [SELECT_CLICKER_ID] = { .name = "clickerID", .type = BLOBMSG_TYPE_INT32 },
 };
 
+enum {
+    SELECT_NEXT_FILTER,
+
+    SELECT_NEXT_LAST_ENUM
+};
+
+static const struct blobmsg_policy _SelectNextPolicy[] = {
+    [SELECT_NEXT_FILTER] = { .name = "filter", .type = BLOBMSG_TYPE_STRING },
+};
+
 static const struct blobmsg_policy _StartProvisionPolicy[] = {
     [SELECT_CLICKER_ID] = { .name = "clickerID", .type = BLOBMSG_TYPE_INT32 },
 };
 
+enum {
+    GET_HISTORY_CLICKER_ID,
+    GET_HISTORY_NAME,
+
+    GET_HISTORY_LAST_ENUM
+};
+
+static const struct blobmsg_policy _GetHistoryPolicy[] = {
+    [GET_HISTORY_CLICKER_ID] = { .name = "clickerID", .type = BLOBMSG_TYPE_INT32 },
+    [GET_HISTORY_NAME] = { .name = "name", .type = BLOBMSG_TYPE_STRING },
+};
+
 enum {
      SET_CLICKER_NAME_CLICKER_ID,
      SET_CLICKER_NAME_CLICKER_NAME,
@@ -103,8 +198,11 @@ enum {
 static const struct ubus_method _UBusAgentMethods[] = {
     UBUS_METHOD("getState", GetStateMethodHandler, _GetStatePolicy),
     UBUS_METHOD("select", SelectMethodHandler, _SelectPolicy),
+    UBUS_METHOD("selectNext", SelectNextMethodHandler, _SelectNextPolicy),
     UBUS_METHOD("startProvision", StartProvisionMethodHandler, _StartProvisionPolicy),
-    UBUS_METHOD("setClickerName", SetClickerNameMethodHandler, _SetClickerNamePolicy)
+    UBUS_METHOD("setClickerName", SetClickerNameMethodHandler, _SetClickerNamePolicy),
+    UBUS_METHOD("getTuning", GetTuningMethodHandler, _GetTuningPolicy),
+    UBUS_METHOD("getHistory", GetHistoryMethodHandler, _GetHistoryPolicy)
 };
 
 static struct ubus_object_type _UBusAgentObjectType = UBUS_OBJECT_TYPE("provisioning-daemon", _UBusAgentMethods);
@@ -132,21 +230,32 @@ static const struct blobmsg_policy _GeneratePskResponsePolicy[GENERATE_PSK_RESPO
     [GENERATE_PSK_RESPONSE_ERROR] = {.name = "error", .type = BLOBMSG_TYPE_STRING},
 };
 
-static UBusMemoryBlock* CreateUBusMemoryBlock() {
-    //Note: Should be called from critical section
-    UBusMemoryBlock* result = g_malloc0(sizeof(UBusMemoryBlock));
-    _UBusRequestMemory = g_slist_prepend(_UBusRequestMemory, result);
+static void PskDeadlineHandler(struct uloop_timeout *t);
+static void PskRetryHandler(struct uloop_timeout *t);
+static void DispatchPskRequests(void);
+
+static PskRequest* CreatePskRequest(int clickerId) {
+    PskRequest* result = g_malloc0(sizeof(PskRequest));
+    _PskRequests = g_slist_prepend(_PskRequests, result);
+    result->clickerId = clickerId;
+    if (clickerId == PSK_PREFETCH_ID)
+        _PrefetchesInProgress++;
+    result->deadline.cb = PskDeadlineHandler;
+    result->retryTimer.cb = PskRetryHandler;
     memset(&result->replyBloob, 0, sizeof(result->replyBloob));
     blob_buf_init(&result->replyBloob, 0);
-    result->toDelete = false;
     return result;
 }
 
-static void ReleaseUBusMemoryBlock(UBusMemoryBlock* block) {
-    //Note: Should be called from critical section
-    _UBusRequestMemory = g_slist_remove(_UBusRequestMemory, block);
-    blob_buf_free(&block->replyBloob);
-    g_free(block);
+static void ReleasePskRequest(PskRequest* request) {
+    if (request->clickerId == PSK_PREFETCH_ID)
+        _PrefetchesInProgress--;
+    _PskRequests = g_slist_remove(_PskRequests, request);
+    g_queue_remove(&_PendingPskRequests, request);
+    uloop_timeout_cancel(&request->deadline);
+    uloop_timeout_cancel(&request->retryTimer);
+    blob_buf_free(&request->replyBloob);
+    g_free(request);
 }
 
 static int SetClickerNameMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
@@ -179,13 +288,10 @@ static int SetClickerNameMethodHandler(struct ubus_context *ctx, struct ubus_obj
         return UBUS_STATUS_NO_DATA;
     }
 
-    g_free(clicker->name);
-    int size = strlen(clickerName);
-    size = size > COMMAND_ENDPOINT_NAME_LENGTH ? COMMAND_ENDPOINT_NAME_LENGTH : size;
-    clicker->name = g_malloc( size );
-    strlcpy(clicker->name, clickerName, COMMAND_ENDPOINT_NAME_LENGTH);
+    strlcpy(clicker->name, clickerName, sizeof(clicker->name));
 
     clicker_ReleaseOwnership(clicker);
+    event_PushEventWithInt(EventType_CLICKER_RENAMED, clickerID);
 
     return UBUS_STATUS_OK;
 }
@@ -212,6 +318,34 @@ static int SelectMethodHandler(struct ubus_context *ctx, struct ubus_object *obj
     return UBUS_STATUS_OK;
 }
 
+/**
+ * @brief Select clicker following the selected one, optional filter "unprovisioned" skips clickers which are
+ * provisioned or being provisioned, default "any" doesn't skip anything.
+ */
+static int SelectNextMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
+        const char *method, struct blob_attr *msg)
+{
+    struct blob_attr* argBuffer[SELECT_NEXT_LAST_ENUM];
+
+    blobmsg_parse(_SelectNextPolicy, ARRAY_SIZE(_SelectNextPolicy), argBuffer, blob_data(msg), blob_len(msg));
+
+    SelectFilter filter = SelectFilter_ANY;
+    if (argBuffer[SELECT_NEXT_FILTER]) {
+        const char* name = blobmsg_get_string(argBuffer[SELECT_NEXT_FILTER]);
+        if (strcmp(name, "unprovisioned") == 0) {
+            filter = SelectFilter_UNPROVISIONED;
+        } else if (strcmp(name, "any") != 0) {
+            return UBUS_STATUS_INVALID_ARGUMENT;
+        }
+    }
+
+    g_info("uBusAgent: SelectNext, filter:%d", filter);
+
+    event_PushEventWithInt(EventType_CLICKER_SELECT_NEXT, filter);
+
+    return UBUS_STATUS_OK;
+}
+
 static int StartProvisionMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
         const char *method, struct blob_attr *msg)
 {
@@ -231,87 +365,121 @@ static int StartProvisionMethodHandler(struct ubus_context *ctx, struct ubus_obj
     return UBUS_STATUS_OK;
 }
 
-static int GetStateMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
-        const char *method, struct blob_attr *msg)
+/**
+ * @brief Reads state version passed by client. Besides integers it's accepted as decimal string, because some
+ * ubus bindings (e.g. older Lua one) can't pass numbers wider than 32 bits.
+ * @return true if version was given and is valid
+ */
+static bool GetVersionArg(struct blob_attr* attr, uint64_t* version)
 {
-    //g_debug("uBusAgent: Requested GetState");
-
-    GArray* connectedClickers = controls_GetAllClickersIds();
-    int selClickerId = controls_GetSelectedClickerId();
-    //g_debug("uBusAgent: GetState clicker count:%d, selected id:%d", connectedClickers->len, selClickerId);
+    if (attr == NULL)
+        return false;
 
-    //add history data
-    GArray* historyItems = history_GetProvisioned();
-    struct blob_buf replyBloob = {0, NULL, 0, NULL};
-    blob_buf_init(&replyBloob, 0);
-    void* cookie_array = blobmsg_open_array(&replyBloob, "clickers");
-    for(int t = 0; t < historyItems->len; t++)
+    switch (blobmsg_type(attr))
     {
-        void* cookie_item = blobmsg_open_table(&replyBloob, "clicker");
-        HistoryItem* history = &g_array_index(historyItems, HistoryItem, t);
-        blobmsg_add_u32(&replyBloob, "id", history->id);
-        blobmsg_add_string(&replyBloob, "name", history->name);
-        blobmsg_add_u8(&replyBloob, "selected", false);
-        blobmsg_add_u8(&replyBloob, "inProvisionState", false);
-        blobmsg_add_u8(&replyBloob, "isProvisioned", true);
-        blobmsg_add_u8(&replyBloob, "isError", history->isErrored);
-        blobmsg_close_table(&replyBloob, cookie_item);
+        case BLOBMSG_TYPE_INT64:
+            *version = blobmsg_get_u64(attr);
+            return true;
+        case BLOBMSG_TYPE_INT32:
+            *version = blobmsg_get_u32(attr);
+            return true;
+        case BLOBMSG_TYPE_STRING:
+        {
+            const char* text = blobmsg_get_string(attr);
+            char* end = NULL;
+            *version = g_ascii_strtoull(text, &end, 10);
+            return end != text && *end == '\0';
+        }
+        default:
+            return false;
     }
+}
 
-    bool alreadyProvisioned = false;
+static int GetStateMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
+        const char *method, struct blob_attr *msg)
+{
+    struct blob_attr* argBuffer[GET_STATE_LAST_ENUM];
+    blobmsg_parse(_GetStatePolicy, ARRAY_SIZE(_GetStatePolicy), argBuffer, blob_data(msg), blob_len(msg));
 
-    for(int t = 0; t < connectedClickers->len; t++)
+    uint64_t sinceVersion;
+    if (GetVersionArg(argBuffer[GET_STATE_SINCE_VERSION], &sinceVersion))
     {
-        Clicker* clk = clicker_AcquireOwnership( g_array_index(connectedClickers, int, t) );
-        if (clk == NULL)
-            continue;
+        struct blob_buf replyBloob = {0, NULL, 0, NULL};
+        blob_buf_init(&replyBloob, 0);
+        bool isDelta = snapshot_BuildDelta(sinceVersion, &replyBloob);
+        if (isDelta)
+            ubus_send_reply(ctx, req, replyBloob.head);
+        blob_buf_free(&replyBloob);
+        if (isDelta)
+            return UBUS_STATUS_OK;
+    }
 
-        alreadyProvisioned = false;
-        for(int j = 0; j < historyItems->len; j++)
-        {
-            HistoryItem* history = &g_array_index(historyItems, HistoryItem, j);
-            if (history->id == clk->clickerID)
-            {
-                alreadyProvisioned = true;
-                break;
-            }
-        }
+    //full reply is prepared by main loop, see state_snapshot.h
+    StateSnapshot* snapshot = snapshot_Acquire();
+    if (snapshot == NULL)
+        return UBUS_STATUS_NO_DATA;
 
-        if (alreadyProvisioned)
-        {
-            clicker_ReleaseOwnership(clk);
-            continue;
-        }
-        void* cookie_item = blobmsg_open_table(&replyBloob, "clicker");
+    ubus_send_reply(ctx, req, snapshot->reply.head);
+    snapshot_Release(snapshot);
+    return UBUS_STATUS_OK;
+}
 
-        blobmsg_add_u32(&replyBloob, "id", clk->clickerID);
-        blobmsg_add_string(&replyBloob, "name", clk->name);
-        blobmsg_add_u8(&replyBloob, "selected", clk->clickerID == selClickerId);
-        blobmsg_add_u8(&replyBloob, "inProvisionState", clk->provisioningInProgress);
-        blobmsg_add_u8(&replyBloob, "isProvisioned", false);
-        blobmsg_add_u8(&replyBloob, "isError", clk->error > 0 ? true : false);
+/**
+ * @brief Reports crypto variants in use and, when autotuner is enabled, how they were chosen.
+ */
+static int GetTuningMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
+        const char *method, struct blob_attr *msg)
+{
+    const AutotuneResult* result = autotune_GetResult();
+    const DhTable* dhTable = dh_GetFixedBaseTable();
+    struct blob_buf replyBloob = {0, NULL, 0, NULL};
+    blob_buf_init(&replyBloob, 0);
 
-        blobmsg_close_table(&replyBloob, cookie_item);
+    blobmsg_add_string(&replyBloob, "aesBackend", aes_GetBackend()->name);
+    blobmsg_add_u32(&replyBloob, "dhWindowBits", dhTable ? dhTable->image->windowBits : 0);
+    blobmsg_add_u8(&replyBloob, "autotune", result != NULL);
+    if (result != NULL)
+    {
+        blobmsg_add_string(&replyBloob, "source", result->source == AutotuneSource_CACHE ? "cache" : "measured");
+        blobmsg_add_string(&replyBloob, "cpu", result->cpu);
+        blobmsg_add_u32(&replyBloob, "durationMs", result->durationUs / 1000);
 
-        clicker_ReleaseOwnership(clk);
+        void* cookie_array = blobmsg_open_array(&replyBloob, "measurements");
+        for(int t = 0; t < result->measurementCount; t++)
+        {
+            void* cookie_item = blobmsg_open_table(&replyBloob, "measurement");
+            blobmsg_add_string(&replyBloob, "name", result->measurements[t].name);
+            blobmsg_add_u32(&replyBloob, "nsPerOp", (uint32_t) result->measurements[t].nsPerOp);
+            blobmsg_close_table(&replyBloob, cookie_item);
+        }
+        blobmsg_close_array(&replyBloob, cookie_array);
     }
-    g_array_free(historyItems, TRUE);
-    g_array_free(connectedClickers, TRUE);
-    blobmsg_close_array(&replyBloob, cookie_array);
 
     ubus_send_reply(ctx, req, replyBloob.head);
     blob_buf_free(&replyBloob);
     return UBUS_STATUS_OK;
 }
 
+static const char* PskRequestName(const PskRequest* request)
+{
+    static char name[32];
+    if (request->clickerId == PSK_PREFETCH_ID)
+        return "reservoir";
+
+    g_snprintf(name, sizeof(name), "clicker %d", request->clickerId);
+    return name;
+}
+
 static void GeneratePskResponseHandler(struct ubus_request *req, int type, struct blob_attr *msg)
 {
-    g_critical("Got: %p", msg);
     struct blob_attr *args[GENERATE_PSK_RESPONSE_MAX];
 
     blobmsg_parse(_GeneratePskResponsePolicy, GENERATE_PSK_RESPONSE_MAX, args, blob_data(msg), blob_len(msg));
-    UBusMemoryBlock* block = (UBusMemoryBlock*)req->priv;
+    PskRequest* request = (PskRequest*)req->priv;
+    if (request->succeeded)
+        return;
 
+    //failures are handled when request completes, it may be retried then
     char *error = NULL;
     if (args[GENERATE_PSK_RESPONSE_ERROR]) {
         error = blobmsg_get_string(args[GENERATE_PSK_RESPONSE_ERROR]);
@@ -319,10 +487,6 @@ static void GeneratePskResponseHandler(struct ubus_request *req, int type, struc
 
     if (error) {
         g_critical("uBusAgent: Error while generating PSK : %s", error);
-        PreSharedKey* eventData = g_new0(PreSharedKey, 1);
-        eventData->clickerId = block->clickerId;
-        event_PushEventWithPtr(EventType_PSK_OBTAINED, eventData, true);
-        block->toDelete = true;
         return;
     }
 
@@ -331,124 +495,291 @@ static void GeneratePskResponseHandler(struct ubus_request *req, int type, struc
         psk = blobmsg_get_string(args[GENERATE_PSK_RESPONSE_PSK_SECRET]);
     }
 
-    if (!psk) {
-        g_critical("uBusAgent: UNKNOWN PSK");
-        PreSharedKey* eventData = g_new0(PreSharedKey, 1);
-        eventData->clickerId = block->clickerId;
-        event_PushEventWithPtr(EventType_PSK_OBTAINED, eventData, true);
-        block->toDelete = true;
-        return;
-    }
-
-    char *identity;
+    char *identity = NULL;
     if (args[GENERATE_PSK_RESPONSE_PSK_IDENTITY]) {
         identity = blobmsg_get_string(args[GENERATE_PSK_RESPONSE_PSK_IDENTITY]);
     }
 
-    if (!identity) {
+    if (!psk || !identity || psk[0] == '\0') {
         g_critical("uBusAgent: UNKNOWN PSK");
-        PreSharedKey* eventData = g_new0(PreSharedKey, 1);
-        eventData->clickerId = block->clickerId;
-        event_PushEventWithPtr(EventType_PSK_OBTAINED, eventData, true);
-        block->toDelete = true;
         return;
     }
 
-    g_message("uBusAgent: Obtained PSK: %s and IDENTITY: %s", psk, identity);
+    g_message("uBusAgent: Obtained PSK for %s, IDENTITY: %s", PskRequestName(request), identity);
+
+    PreSharedKey key;
+    memset(&key, 0, sizeof(key));
+    key.clickerId = request->clickerId;
+
+    strlcpy(key.identity, identity, PSK_ARRAYS_SIZE);
+    key.identityLen = strlen(identity);
+    key.identityLen = key.identityLen > PSK_ARRAYS_SIZE ? PSK_ARRAYS_SIZE : key.identityLen;
+
+    strlcpy(key.psk, psk, PSK_ARRAYS_SIZE);
+    key.pskLen = strlen(psk);
+    key.pskLen = key.pskLen > PSK_ARRAYS_SIZE ? PSK_ARRAYS_SIZE : key.pskLen;
 
+    if (request->clickerId == PSK_PREFETCH_ID)
+        pskreservoir_Put(&key);
+    else
+        event_PushEventWithSecretPtr(EventType_PSK_OBTAINED, g_memdup(&key, sizeof(key)), sizeof(key));
+
+    crypto_Wipe(&key, sizeof(key));
+    request->succeeded = true;
+}
+
+static void PushPskError(int clickerId)
+{
     PreSharedKey* eventData = g_new0(PreSharedKey, 1);
-    eventData->clickerId = block->clickerId;
+    eventData->clickerId = clickerId;
+    event_PushEventWithSecretPtr(EventType_PSK_OBTAINED, eventData, sizeof(*eventData));
+}
 
-    strlcpy(eventData->identity, identity, PSK_ARRAYS_SIZE);
-    eventData->identityLen = strlen(identity);
-    eventData->identityLen = eventData->identityLen > PSK_ARRAYS_SIZE ? PSK_ARRAYS_SIZE : eventData->identityLen;
+/**
+ * @brief Called once attempt is over (answered, timed out or not sent at all). Failed request is retried after
+ * backoff until its retries are used up, then main loop gets PSK_OBTAINED event without PSK.
+ */
+static void FinishPskAttempt(PskRequest* request)
+{
+    if (request->inFlight) {
+        request->inFlight = false;
+        _PskRequestsInFlight--;
+    }
 
-    strlcpy(eventData->psk, psk, PSK_ARRAYS_SIZE);
-    eventData->pskLen = strlen(psk);
-    eventData->pskLen = eventData->pskLen > PSK_ARRAYS_SIZE ? PSK_ARRAYS_SIZE : eventData->pskLen;
+    if (request->succeeded) {
+        ReleasePskRequest(request);
+        return;
+    }
 
-    event_PushEventWithPtr(EventType_PSK_OBTAINED, eventData, true);
-    block->toDelete = true;
-    return;
+    if (request->attempts <= _PskConfig.retries) {
+        gint64 delay = (gint64) _PskConfig.retryBackoffMs << MIN(request->attempts - 1, 10);
+        int backoff = (int) MIN(delay, PSK_MAX_RETRY_DELAY_MS);
+        g_warning("uBusAgent: generatePsk for %s failed, retrying in %d ms", PskRequestName(request), backoff);
+        uloop_timeout_set(&request->retryTimer, backoff);
+        return;
+    }
+
+    g_critical("uBusAgent: generatePsk for %s failed %d times, giving up", PskRequestName(request),
+            request->attempts);
+    if (request->clickerId != PSK_PREFETCH_ID)
+        PushPskError(request->clickerId);
+    ReleasePskRequest(request);
 }
 
-void HelperTimeoutHandler(struct uloop_timeout *t)
+static void GeneratePskCompleteHandler(struct ubus_request *req, int ret)
 {
-    g_mutex_lock(&_Mutex);
-    if (_UBusInterruption)
-        uloop_cancelled = true;
+    PskRequest* request = (PskRequest*)req->priv;
+    uloop_timeout_cancel(&request->deadline);
+    FinishPskAttempt(request);
+    DispatchPskRequests();
+}
 
-    g_mutex_unlock(&_Mutex);
-    uloop_timeout_set(&_UBusHelperProcess, 500);
+static void PskDeadlineHandler(struct uloop_timeout *t)
+{
+    PskRequest* request = container_of(t, PskRequest, deadline);
+    g_warning("uBusAgent: generatePsk for %s got no answer in %d ms", PskRequestName(request),
+            _PskConfig.timeoutMs);
+    ubus_abort_request(_UbusCTX, &request->request);
+    FinishPskAttempt(request);
+    DispatchPskRequests();
 }
 
-static void* PDUbusLoop(void *arg)
+/**
+ * @brief Requests made for clickers are sent before the ones which only fill PSK reservoir.
+ */
+static void EnqueuePskRequest(PskRequest* request)
 {
-    g_message("uBusAgent: uBus thread started.\n");
-    while(true)
+    GList* link = NULL;
+    if (request->clickerId != PSK_PREFETCH_ID) {
+        for (link = _PendingPskRequests.head; link != NULL; link = link->next) {
+            if (((PskRequest*)link->data)->clickerId == PSK_PREFETCH_ID)
+                break;
+        }
+    }
+    if (link != NULL)
+        g_queue_insert_before(&_PendingPskRequests, link, request);
+    else
+        g_queue_push_tail(&_PendingPskRequests, request);
+}
+
+static void PskRetryHandler(struct uloop_timeout *t)
+{
+    PskRequest* request = container_of(t, PskRequest, retryTimer);
+    EnqueuePskRequest(request);
+    DispatchPskRequests();
+}
+
+static void SendPskRequest(PskRequest* request)
+{
+    request->attempts++;
+
+    uint32_t id;
+    int ret = ubus_lookup_id(_UbusCTX, "creator", &id);
+    if (ret)
     {
-        g_mutex_lock(&_Mutex);
-        if (_UBusRunning == false)
-        {
-            g_mutex_unlock(&_Mutex);
+        g_critical("uBusAgent: creator ubus service not available");
+        FinishPskAttempt(request);
+        return;
+    }
+
+    memset(&request->request, 0, sizeof(request->request));
+    ret = ubus_invoke_async(_UbusCTX, id, "generatePsk", request->replyBloob.head, &request->request);
+    if (ret)
+    {
+        g_critical("uBusAgent: Filed to invoke generatePsk");
+        FinishPskAttempt(request);
+        return;
+    }
+    request->request.priv = (void*)request;
+    request->request.data_cb = GeneratePskResponseHandler;
+    request->request.complete_cb = GeneratePskCompleteHandler;
+    request->inFlight = true;
+    _PskRequestsInFlight++;
+    ubus_complete_request_async(_UbusCTX, &request->request);
+    uloop_timeout_set(&request->deadline, _PskConfig.timeoutMs);
+}
+
+static void DispatchPskRequests(void)
+{
+    while (!g_queue_is_empty(&_PendingPskRequests)) {
+        //requests for reservoir leave one slot free, so clicker doesn't wait for them
+        PskRequest* next = g_queue_peek_head(&_PendingPskRequests);
+        int limit = _PskConfig.maxInFlight;
+        if (next->clickerId == PSK_PREFETCH_ID && limit > 1)
+            limit--;
+
+        if (_PskRequestsInFlight >= limit)
             break;
-        }
 
-        while(_UBusInterruption)
-        {
-            _UBusInInterState = true;
-            g_debug("Interrupt state");
-            g_mutex_unlock(&_Mutex);
-            usleep(1000 * 1000);
-            g_mutex_lock(&_Mutex);
-            _UBusInInterState = false;
-        }
-        //check for memory removal
-        if (_UBusRequestMemory != NULL) {
-            UBusMemoryBlock* block = (UBusMemoryBlock*)_UBusRequestMemory->data;
-            if ( block->toDelete ) {
-                ReleaseUBusMemoryBlock(block);
-            }
+        SendPskRequest(g_queue_pop_head(&_PendingPskRequests));
+    }
+}
+
+static void RefillReservoir(void)
+{
+    int missing = pskreservoir_GetMissing() - _PrefetchesInProgress;
+    for (int t = 0; t < missing; t++)
+        EnqueuePskRequest(CreatePskRequest(PSK_PREFETCH_ID));
+
+    DispatchPskRequests();
+}
+
+static void ReservoirTimerHandler(struct uloop_timeout *t)
+{
+    RefillReservoir();
+    uloop_timeout_set(&_ReservoirTimer, RESERVOIR_CHECK_INTERVAL_MS);
+}
+
+static void QueuePskRequest(int clickerId)
+{
+    for (GSList* it = _PskRequests; it != NULL; it = it->next) {
+        if (((PskRequest*)it->data)->clickerId == clickerId) {
+            g_debug("uBusAgent: PSK for clicker %d has been requested already", clickerId);
+            return;
         }
-        g_mutex_unlock(&_Mutex);
-        uloop_run();
     }
-    g_message("uBusAgent: uBus thread finish.\n");
-    return NULL;
+
+    PreSharedKey* key = g_new0(PreSharedKey, 1);
+    key->clickerId = clickerId;
+    if (pskreservoir_Take(key)) {
+        g_message("uBusAgent: PSK for clicker %d taken from reservoir, IDENTITY: %s", clickerId, key->identity);
+        event_PushEventWithSecretPtr(EventType_PSK_OBTAINED, key, sizeof(*key));
+        RefillReservoir();
+        return;
+    }
+    crypto_Wipe(key, sizeof(*key));
+    g_free(key);
+
+    EnqueuePskRequest(CreatePskRequest(clickerId));
+    DispatchPskRequests();
 }
 
-static void SetUBusRunning(bool state)
+static void AddObject(void)
 {
-    g_mutex_lock(&_Mutex);
-    _UBusRunning = state;
-    g_mutex_unlock(&_Mutex);
+    g_message("uBusAgent: Enabling provision control through uBus");
+    int ret = ubus_add_object(_UbusCTX, &_UBusAgentObject);
+    if (ret)
+        g_critical("uBusAgent: Failed to add object: %s\n", ubus_strerror(ret));
+
+    g_mutex_lock(&_AddObjectMutex);
+    _AddObjectResult = ret;
+    _AddObjectDone = true;
+    g_cond_signal(&_AddObjectCond);
+    g_mutex_unlock(&_AddObjectMutex);
 }
 
-static void SetUBusLoopInterruption(bool state)
+static void ReleaseCommand(UBusCommand* command)
 {
-    g_mutex_lock(&_Mutex);
-    _UBusInterruption = state;
-    uloop_cancelled = state;
-    g_mutex_unlock(&_Mutex);
+    free(command->message);
+    g_free(command);
 }
 
-static void WaitForInterruptState(void)
+static void CommandFdHandler(struct uloop_fd *fd, unsigned int events)
 {
-    while(true)
+    uint64_t counter;
+    if (read(fd->fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN)
+        g_warning("uBusAgent: Can't read command counter: %s", strerror(errno));
+
+    UBusCommand* command;
+    while ((command = g_async_queue_try_pop(_Commands)) != NULL)
     {
-        g_mutex_lock(&_Mutex);
-        bool ok = _UBusInInterState;
-        g_mutex_unlock(&_Mutex);
-        if (ok)
-            break;
+        switch (command->type)
+        {
+            case UBusCommandType_NOTIFY:
+                if (_UBusAgentObject.has_subscribers)
+                    ubus_notify(_UbusCTX, &_UBusAgentObject, command->notification, command->message, -1);
+                break;
+
+            case UBusCommandType_GENERATE_PSK:
+                QueuePskRequest(command->clickerId);
+                break;
+
+            case UBusCommandType_ADD_OBJECT:
+                AddObject();
+                break;
+
+            case UBusCommandType_STOP:
+                _UbusStopRequested = true;
+                uloop_end();
+                break;
+        }
+        ReleaseCommand(command);
+    }
+}
 
-        usleep(200 * 1000);
+/**
+ * @brief Queue command for ubus thread and wake it up, doesn't wait for its execution.
+ * @return false if ubus thread isn't running, command is released then
+ */
+static bool PostCommand(UBusCommand* command)
+{
+    if (!_UbusThreadStarted)
+    {
+        ReleaseCommand(command);
+        return false;
     }
+    g_async_queue_push(_Commands, command);
+    uint64_t one = 1;
+    if (write(_CommandFd, &one, sizeof(one)) < 0)
+        g_warning("uBusAgent: Can't wake up ubus thread: %s", strerror(errno));
+
+    return true;
+}
+
+static void* PDUbusLoop(void *arg)
+{
+    g_message("uBusAgent: uBus thread started.\n");
+    //uloop_run returns also when process gets signal
+    while (!_UbusStopRequested)
+        uloop_run();
+
+    g_message("uBusAgent: uBus thread finish.\n");
+    return NULL;
 }
 
-bool ubusagent_Init(void)
+bool ubusagent_Init(const PskRequestConfig* pskConfig)
 {
-    g_mutex_init(&_Mutex);
+    _PskConfig = *pskConfig;
     uloop_init();
     _UbusCTX = ubus_connect(_Path);
     if (!_UbusCTX)
@@ -458,83 +789,167 @@ bool ubusagent_Init(void)
     }
     ubus_add_uloop(_UbusCTX);
 
-    memset(&_UBusHelperProcess, 0, sizeof(_UBusHelperProcess));
-    _UBusHelperProcess.cb = HelperTimeoutHandler;
-    uloop_timeout_set(&_UBusHelperProcess, 500);
+    _Commands = g_async_queue_new();
+    _CommandFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_CommandFd < 0)
+    {
+        g_critical("uBusAgent: Can't create eventfd: %s", strerror(errno));
+        return false;
+    }
+    memset(&_CommandUloopFd, 0, sizeof(_CommandUloopFd));
+    _CommandUloopFd.fd = _CommandFd;
+    _CommandUloopFd.cb = CommandFdHandler;
+    uloop_fd_add(&_CommandUloopFd, ULOOP_READ);
 
-    SetUBusRunning(true);
-    SetUBusLoopInterruption(false);
-    _UBusInInterState = false;
+    if (pskConfig->reservoirDepth > 0 && pskreservoir_Init(pskConfig->reservoirDepth, pskConfig->reservoirMaxAgeS))
+    {
+        //filled as soon as ubus thread starts
+        memset(&_ReservoirTimer, 0, sizeof(_ReservoirTimer));
+        _ReservoirTimer.cb = ReservoirTimerHandler;
+        uloop_timeout_set(&_ReservoirTimer, 0);
+    }
 
-    if (pthread_create(&_UbusThread, NULL, PDUbusLoop, NULL) < 0)
+    if (pthread_create(&_UbusThread, NULL, PDUbusLoop, NULL) != 0)
     {
         g_critical("uBusAgent: Error creating thread.");
         return false;
     }
+    _UbusThreadStarted = true;
     return true;
 }
 
 bool ubusagent_EnableRemoteControl(void)
 {
-    SetUBusLoopInterruption(true);
-    WaitForInterruptState();
-    g_message("uBusAgent: Enabling provision control through uBus");
-    int ret = ubus_add_object(_UbusCTX, &_UBusAgentObject);
-    if (ret)
-        g_critical("uBusAgent: Failed to add object: %s\n", ubus_strerror(ret));
+    g_mutex_lock(&_AddObjectMutex);
+    _AddObjectDone = false;
+    g_mutex_unlock(&_AddObjectMutex);
+
+    UBusCommand* command = g_new0(UBusCommand, 1);
+    command->type = UBusCommandType_ADD_OBJECT;
+    if (!PostCommand(command))
+        return false;
 
-    SetUBusLoopInterruption(false);
+    //called once at startup, so it waits for the result, which comes as soon as ubusd answers
+    g_mutex_lock(&_AddObjectMutex);
+    while (!_AddObjectDone)
+        g_cond_wait(&_AddObjectCond, &_AddObjectMutex);
+
+    int ret = _AddObjectResult;
+    g_mutex_unlock(&_AddObjectMutex);
 
     return ret == 0;
 }
 
 void ubusagent_Destroy(void)
 {
-    SetUBusLoopInterruption(false);
-    SetUBusRunning(false);
+    if (_UbusThreadStarted)
+    {
+        UBusCommand* command = g_new0(UBusCommand, 1);
+        command->type = UBusCommandType_STOP;
+        PostCommand(command);
+        pthread_join(_UbusThread, NULL);
+        _UbusThreadStarted = false;
+    }
+
     if (_UbusCTX)
+    {
         ubus_free(_UbusCTX);
+        _UbusCTX = NULL;
+    }
+
+    //requests which didn't complete
+    while (_PskRequests != NULL)
+        ReleasePskRequest((PskRequest*) _PskRequests->data);
+    _PskRequestsInFlight = 0;
+    uloop_timeout_cancel(&_ReservoirTimer);
+    pskreservoir_Shutdown(_PskConfig.reportUnusedOnShutdown);
 
+    if (_CommandFd >= 0)
+    {
+        uloop_fd_delete(&_CommandUloopFd);
+        close(_CommandFd);
+        _CommandFd = -1;
+    }
     uloop_done();
 
-    while (_UBusRequestMemory != NULL) {
-        UBusMemoryBlock* block = (UBusMemoryBlock*) _UBusRequestMemory->data;
-        if (block->toDelete) {
-            ReleaseUBusMemoryBlock(block);
-        }
+    if (_Commands != NULL)
+    {
+        UBusCommand* command;
+        while ((command = g_async_queue_try_pop(_Commands)) != NULL)
+            ReleaseCommand(command);
+
+        g_async_queue_unref(_Commands);
+        _Commands = NULL;
     }
-    g_mutex_clear(&_Mutex);
 }
 
-//Warn: this is blocking call
 bool ubusagent_SendGeneratePskMessage(int clickerId)
 {
-    SetUBusLoopInterruption(true);
-    WaitForInterruptState();
-    uint32_t id, ret;
-    ret = ubus_lookup_id(_UbusCTX, "creator", &id);
-    if (ret)
-    {
-        g_critical("uBusAgent: creator ubus service not available");
-        SetUBusLoopInterruption(false);
-        return false;
-    }
+    UBusCommand* command = g_new0(UBusCommand, 1);
+    command->type = UBusCommandType_GENERATE_PSK;
+    command->clickerId = clickerId;
+    return PostCommand(command);
+}
 
-    g_mutex_lock(&_Mutex);
-    UBusMemoryBlock* block = CreateUBusMemoryBlock();
-    g_mutex_unlock(&_Mutex);
-    block->clickerId = clickerId;
-    ret = ubus_invoke_async(_UbusCTX, id, "generatePsk", block->replyBloob.head, &block->request);
-    block->request.priv = (void*)block;
-    block->request.data_cb = GeneratePskResponseHandler;
-    ubus_complete_request_async(_UbusCTX, &block->request);
+bool ubusagent_HasSubscribers(void)
+{
+    return _UbusThreadStarted && _UBusAgentObject.has_subscribers;
+}
 
-    if (ret)
+void ubusagent_Notify(const char* type, struct blob_attr* message)
+{
+    UBusCommand* command = g_new0(UBusCommand, 1);
+    command->type = UBusCommandType_NOTIFY;
+    command->notification = type;
+    command->message = message;
+    PostCommand(command);
+}
+
+static void AddHistoryItem(struct blob_buf *replyBloob, const HistoryItem *history)
+{
+    void* cookie_item = blobmsg_open_table(replyBloob, "clicker");
+    blobmsg_add_u32(replyBloob, "id", history->id);
+    blobmsg_add_string(replyBloob, "name", history->name);
+    blobmsg_add_string(replyBloob, "identity", history->identity);
+    blobmsg_add_u64(replyBloob, "timestamp", history->timestamp);
+    blobmsg_add_u32(replyBloob, "error", history->error);
+    blobmsg_add_u8(replyBloob, "isError", history->isErrored);
+    blobmsg_close_table(replyBloob, cookie_item);
+}
+
+/**
+ * @brief Reports provisioned clickers kept in history, optionally only the one with given clickerID or name.
+ */
+static int GetHistoryMethodHandler(struct ubus_context *ctx, struct ubus_object *obj, struct ubus_request_data *req,
+        const char *method, struct blob_attr *msg)
+{
+    struct blob_attr* argBuffer[GET_HISTORY_LAST_ENUM];
+
+    blobmsg_parse(_GetHistoryPolicy, ARRAY_SIZE(_GetHistoryPolicy), argBuffer, blob_data(msg), blob_len(msg));
+
+    struct blob_buf replyBloob = {0, NULL, 0, NULL};
+    blob_buf_init(&replyBloob, 0);
+    void* cookie_array = blobmsg_open_array(&replyBloob, "clickers");
+    if (argBuffer[GET_HISTORY_CLICKER_ID] || argBuffer[GET_HISTORY_NAME])
     {
-        g_critical("uBusAgent: Filed to invoke generatePsk");
-        SetUBusLoopInterruption(false);
-        return false;
+        HistoryItem history;
+        bool found = argBuffer[GET_HISTORY_CLICKER_ID] ?
+                history_FindById(blobmsg_get_u32(argBuffer[GET_HISTORY_CLICKER_ID]), &history) :
+                history_FindByName(blobmsg_get_string(argBuffer[GET_HISTORY_NAME]), &history);
+        if (found)
+            AddHistoryItem(&replyBloob, &history);
     }
-    SetUBusLoopInterruption(false);
-    return true;
+    else
+    {
+        GArray* historyItems = history_GetProvisioned();
+        for (int t = 0; t < historyItems->len; t++)
+            AddHistoryItem(&replyBloob, &g_array_index(historyItems, HistoryItem, t));
+
+        g_array_free(historyItems, TRUE);
+    }
+    blobmsg_close_array(&replyBloob, cookie_array);
+
+    ubus_send_reply(ctx, req, replyBloob.head);
+    blob_buf_free(&replyBloob);
+    return UBUS_STATUS_OK;
 }
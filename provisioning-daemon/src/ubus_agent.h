@@ -26,6 +26,8 @@
 
 #define PSK_ARRAYS_SIZE 255
 
+struct blob_attr;
+
 typedef struct  {
     int clickerId;
 
@@ -36,22 +38,52 @@ typedef struct  {
     uint8_t identityLen;
 } PreSharedKey;
 
+/**
+ * Limits of generatePsk calls made by ubus agent.
+ */
+typedef struct {
+    int maxInFlight;        //calls awaiting answer at once, further requests are queued
+    int timeoutMs;          //time after which call without answer is considered failed
+    int retries;            //additional attempts made after failure
+    int retryBackoffMs;     //delay before first retry, doubled with every next one up to 10 minutes
+    int reservoirDepth;     //PSKs obtained in advance, before any clicker asks for them, 0 disables reservoir
+    int reservoirMaxAgeS;   //PSK obtained in advance is dropped after this time, 0 means no limit
+    bool reportUnusedOnShutdown;    //log identities of PSKs obtained in advance which were never used
+} PskRequestConfig;
+
 /**
  * @brief Init ubus mechanism, register objects
  */
-bool ubusagent_Init(void);
+bool ubusagent_Init(const PskRequestConfig* pskConfig);
 void ubusagent_Destroy(void);
 
+/**
+ * @brief Register provisioning-daemon object, waits until ubus thread gets answer from ubusd.
+ */
 bool ubusagent_EnableRemoteControl(void);
 
 /**
- * @brief Send "generatePsk" call to "imgtec" object through ubus.
- * This call is blocking, and may take up to 10 seconds to return.
+ * @brief Queue "generatePsk" call to "creator" object, it's sent from ubus thread. Doesn't block.
+ * Failed or unanswered calls are retried according to PskRequestConfig, request made for a clicker which still
+ * waits for PSK is ignored. When PSK reservoir has an entry, it's used at once instead of the call.
  *
  * @param[in] clickerId which asks for psk, it will be used with event: EventType_PSK_OBTAINED
- * @return true if request has been successfully performed, false otherwise. This
- * only means that request went away successfully there still may error return in EventType_PSK_OBTAINED event.
+ * @return true if request has been queued, false otherwise. Result comes in exactly one EventType_PSK_OBTAINED
+ * event, with pskLen 0 if PSK couldn't be obtained.
  */
 bool ubusagent_SendGeneratePskMessage(int clickerId);
 
+/**
+ * @brief Whether anybody is subscribed to provisioning-daemon object, notifications are not worth building otherwise.
+ */
+bool ubusagent_HasSubscribers(void);
+
+/**
+ * @brief Queue notification of provisioning-daemon object, it's sent from ubus thread. Thread safe.
+ *
+ * @param[in] type notification type, has to be a string constant
+ * @param[in] message allocated by malloc (e.g. blob_memdup), ownership is passed to ubus agent
+ */
+void ubusagent_Notify(const char* type, struct blob_attr* message);
+
 #endif /* UBUS_AGENT_H_ */
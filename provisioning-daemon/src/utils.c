@@ -72,16 +72,6 @@ void HexStringToByteArray(const char* hexstr, uint8_t * dst, size_t len)
         dst[j] = (hexstr[i] % 32 + 9) % 25 * 16 + (hexstr[i+1] % 32 + 9) % 25;
 }
 
-bool GenerateRandomX(unsigned char* array, int length)
-{
-    if (array == NULL) return false;
-
-    for (int i = 0; i < length; ++i)
-        array[i] = g_random_int() % 9;
-
-    return true;
-}
-
 void GenerateClickerTimeHash(char *buffer)
 {
     gint64 currentTimeSeconds = g_get_monotonic_time() / (1000 * 1000);
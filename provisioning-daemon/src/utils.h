@@ -51,8 +51,6 @@
  */
 void HexStringToByteArray(const char* hexstr, uint8_t * dst, size_t len);
 
-bool GenerateRandomX(unsigned char* array, int length);
-
 void GenerateClickerNameHash(char *buffer);
 
 void GenerateClickerTimeHash(char *buffer);
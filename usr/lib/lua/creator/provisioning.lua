@@ -44,6 +44,68 @@ function getProvisioningDaemonState()
 
 end
 
+-- Returns changes of daemon state since given version (see getState in README), whole state when version is nil,
+-- too old or comes from previous run of daemon.
+function getProvisioningDaemonStateSince(version, connection)
+    local args = {}
+    if (version ~= nil) then
+        -- passed as string, numbers wider than 32 bits don't survive conversion to blobmsg
+        args.sinceVersion = string.format("%.0f", version)
+    end
+    local res, status = (connection or conn):call("provisioning-daemon", "getState", args)
+    if (status == nil) then
+        return res
+    elseif (status == 4) then
+        error({code = status, message = "Provisioning daemon is not running or has been started without '-r' param.", data = nil})
+    else
+        error({code = status, message = "ubus error", data = nil})
+    end
+end
+
+local function hasChanges(state)
+    return state.full or (state.clickers ~= nil and #state.clickers > 0) or (state.removed ~= nil and #state.removed > 0)
+end
+
+-- Long poll for state changes. Returns as soon as state differs from given version, otherwise waits up to timeoutMs
+-- for "state" notification of daemon and returns state (possibly with no changes) after that, with longPoll set.
+-- Without uloop binding nothing can wake it up, so delta is returned right away and caller should wait before it asks
+-- again, polling ubus in a loop here would only keep uhttpd worker busy.
+function waitForProvisioningDaemonState(version, timeoutMs)
+    if (version == nil) then
+        return getProvisioningDaemonStateSince(nil)
+    end
+
+    local hasUloop, uloop = pcall(require, "uloop")
+    if (hasUloop) then
+        uloop.init()
+        -- separate connection, so it's attached to uloop, subscription is made before state is checked so no
+        -- notification is missed in between
+        local subscriber = ubus.connect()
+        local subscribed = subscriber ~= nil and subscriber.subscribe ~= nil and pcall(subscriber.subscribe, subscriber,
+            "provisioning-daemon", { notify = function(msg, name) uloop.cancel() end })
+        if (subscribed) then
+            local ok, state = pcall(getProvisioningDaemonStateSince, version, subscriber)
+            if (ok and not hasChanges(state)) then
+                local timer = uloop.timer(function() uloop.cancel() end, timeoutMs)
+                uloop.run()
+                timer:cancel()
+                ok, state = pcall(getProvisioningDaemonStateSince, version, subscriber)
+            end
+            subscriber:close()
+            if (not ok) then
+                error(state)
+            end
+            state.longPoll = true
+            return state
+        end
+        if (subscriber ~= nil) then
+            subscriber:close()
+        end
+    end
+
+    return getProvisioningDaemonStateSince(version)
+end
+
 function startProvisioning(clickerID)
     local res, status = conn:call("provisioning-daemon", "startProvision", {clickerID = clickerID})
     if (status == nil) then